@@ -0,0 +1,413 @@
+#include "gpu_core.h"
+#include "memory_hierarchy.h"
+#include "graphics_pipeline.h"
+#include "texture_cache.h"
+#include "performance_monitor.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace gpu_sim;
+
+namespace {
+
+/**
+ * One benchmark configuration. Every frame draws the scene once, split into
+ * one draw per texture of the working set, then runs the compute dispatch.
+ */
+struct Scenario {
+    std::string name;
+    uint32_t triangles;
+    float triangle_size;        // Edge length in pixels
+    uint32_t viewport_width;
+    uint32_t viewport_height;
+    uint32_t textures;          // Texture working set, 0 for untextured
+    uint32_t texture_size;      // Texels per side
+    uint32_t compute_threads;   // Threads dispatched per frame, 0 for none
+    size_t texture_cache_mb;
+    size_t l1_kb;
+    size_t l2_kb;
+    ReplacementPolicy cache_policy;
+};
+
+struct BenchOptions {
+    std::string format = "json";
+    std::string output;
+    std::string scenario = "all";
+    uint32_t warmup = 3;
+    uint32_t repeat = 10;
+    bool list = false;
+};
+
+struct BenchResult {
+    Scenario scenario;
+    std::vector<uint64_t> frame_ns;  // Sorted
+    double mean_ns;
+    uint64_t texture_samples;        // Per frame
+    uint64_t fragments_processed;    // Per frame
+    double texture_hit_rate;
+};
+
+std::vector<Scenario> builtin_scenarios() {
+    const ReplacementPolicy lru = ReplacementPolicy::LRU;
+    return {
+        {"small_triangles", 4000, 8.0f, 256, 256, 1, 64, 0, 16, 32, 512, lru},
+        {"large_triangles", 64, 192.0f, 512, 512, 1, 256, 0, 16, 32, 512, lru},
+        {"texture_working_set", 512, 48.0f, 256, 256, 16, 256, 0, 1, 32, 512, lru},
+        {"compute_dispatch", 16, 32.0f, 128, 128, 0, 0, 16384, 16, 32, 512, lru},
+        {"small_l2_plru", 4000, 8.0f, 256, 256, 1, 64, 4096, 16, 16, 128, ReplacementPolicy::TREE_PLRU},
+    };
+}
+
+const char* policy_name(ReplacementPolicy policy) {
+    switch (policy) {
+        case ReplacementPolicy::TREE_PLRU: return "plru";
+        case ReplacementPolicy::SRRIP: return "srrip";
+        case ReplacementPolicy::BRRIP: return "brrip";
+        case ReplacementPolicy::RANDOM: return "random";
+        case ReplacementPolicy::LRU:
+        default: return "lru";
+    }
+}
+
+bool parse_policy(const std::string& name, ReplacementPolicy& policy) {
+    const ReplacementPolicy policies[] = {ReplacementPolicy::LRU, ReplacementPolicy::TREE_PLRU,
+                                          ReplacementPolicy::SRRIP, ReplacementPolicy::BRRIP,
+                                          ReplacementPolicy::RANDOM};
+    for (ReplacementPolicy candidate : policies) {
+        if (name == policy_name(candidate)) {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+Texture make_texture(uint32_t size, uint32_t seed) {
+    Texture texture;
+    texture.width = size;
+    texture.height = size;
+    texture.format = 0;
+    texture.mip_levels = 1;
+    texture.data.resize(static_cast<size_t>(size) * size * 4);
+    for (size_t i = 0; i < texture.data.size(); ++i) {
+        texture.data[i] = static_cast<uint8_t>((i * 31 + seed * 97) & 0xFF);
+    }
+    return texture;
+}
+
+// Triangles at deterministic pseudo-random positions, so every run of a
+// scenario draws the same scene
+std::vector<Vertex> make_triangles(const Scenario& scenario) {
+    std::vector<Vertex> vertices;
+    vertices.reserve(static_cast<size_t>(scenario.triangles) * 3);
+
+    uint32_t state = 0x12345678u;
+    auto next_unit = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+    };
+
+    const float size_x = 2.0f * scenario.triangle_size / scenario.viewport_width;
+    const float size_y = 2.0f * scenario.triangle_size / scenario.viewport_height;
+    for (uint32_t i = 0; i < scenario.triangles; ++i) {
+        float x = next_unit() * (2.0f - size_x) - 1.0f;
+        float y = next_unit() * (2.0f - size_y) - 1.0f;
+        float z = next_unit();
+        Vertex v0 = {{x, y, z, 1.0f}, {1.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+        Vertex v1 = {{x + size_x, y, z, 1.0f}, {0.0f, 1.0f, 0.0f, 1.0f}, {1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+        Vertex v2 = {{x, y + size_y, z, 1.0f}, {0.0f, 0.0f, 1.0f, 1.0f}, {0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}};
+        vertices.insert(vertices.end(), {v0, v1, v2});
+    }
+    return vertices;
+}
+
+BenchResult run_scenario(const Scenario& scenario, const BenchOptions& options) {
+    MemoryConfig memory_config;
+    memory_config.l1_size = scenario.l1_kb * 1024;
+    memory_config.l2_size = scenario.l2_kb * 1024;
+    memory_config.l1_policy = scenario.cache_policy;
+    memory_config.l2_policy = scenario.cache_policy;
+
+    auto memory = std::make_shared<MemoryHierarchy>(memory_config);
+    auto gpu_core = std::make_shared<GPUCore>(16);
+    auto texture_cache = std::make_shared<TextureCache>(scenario.texture_cache_mb);
+    auto pipeline = std::make_shared<GraphicsPipeline>();
+    gpu_core->initialize(memory, nullptr);
+    texture_cache->initialize(memory, nullptr);
+    pipeline->initialize(gpu_core, memory, texture_cache, nullptr);
+
+    PipelineState state;
+    state.depth_test_enabled = true;
+    state.viewport_width = scenario.viewport_width;
+    state.viewport_height = scenario.viewport_height;
+    pipeline->set_pipeline_state(state);
+
+    std::vector<uint64_t> texture_ids;
+    for (uint32_t i = 0; i < scenario.textures; ++i) {
+        texture_ids.push_back(texture_cache->register_texture(make_texture(scenario.texture_size, i)));
+    }
+
+    // One draw per texture; untextured scenes are a single draw
+    std::vector<Vertex> vertices = make_triangles(scenario);
+    size_t draws = std::max<size_t>(texture_ids.size(), 1);
+    size_t triangles_per_draw = (scenario.triangles + draws - 1) / draws;
+    std::vector<std::vector<Vertex>> draw_vertices;
+    for (size_t draw = 0; draw < draws; ++draw) {
+        size_t first = std::min(vertices.size(), draw * triangles_per_draw * 3);
+        size_t last = std::min(vertices.size(), first + triangles_per_draw * 3);
+        draw_vertices.emplace_back(vertices.begin() + first, vertices.begin() + last);
+    }
+
+    const std::vector<uint32_t> compute_program = {0x01, 0, 1, 2,   // ADD
+                                                   0x02, 3, 0, 1};  // MUL
+    auto run_frame = [&]() {
+        pipeline->begin_frame();
+        for (size_t draw = 0; draw < draws; ++draw) {
+            if (!texture_ids.empty()) {
+                pipeline->bind_texture(0, texture_ids[draw]);
+            }
+            pipeline->draw_triangles(draw_vertices[draw]);
+        }
+        pipeline->end_frame();
+
+        if (scenario.compute_threads > 0) {
+            gpu_core->dispatch_compute(compute_program, scenario.compute_threads);
+            gpu_core->wait_for_completion();
+        }
+    };
+
+    for (uint32_t i = 0; i < options.warmup; ++i) {
+        run_frame();
+    }
+    texture_cache->reset_metrics();
+
+    BenchResult result;
+    result.scenario = scenario;
+    result.texture_samples = 0;
+    result.fragments_processed = 0;
+    for (uint32_t i = 0; i < options.repeat; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        run_frame();
+        auto end = std::chrono::steady_clock::now();
+        result.frame_ns.push_back(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+
+        auto stats = pipeline->get_statistics();
+        result.texture_samples = stats.texture_samples;
+        result.fragments_processed = stats.fragments_processed;
+    }
+
+    std::sort(result.frame_ns.begin(), result.frame_ns.end());
+    double total_ns = 0.0;
+    for (uint64_t ns : result.frame_ns) {
+        total_ns += static_cast<double>(ns);
+    }
+    result.mean_ns = result.frame_ns.empty() ? 0.0 : total_ns / result.frame_ns.size();
+    result.texture_hit_rate = texture_cache->get_metrics().hit_rate;
+
+    for (uint64_t id : texture_ids) {
+        texture_cache->invalidate_texture(id);
+    }
+    return result;
+}
+
+// Nearest-rank percentile of sorted samples
+uint64_t percentile(const std::vector<uint64_t>& sorted, double q) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(q * sorted.size() + 0.999999);
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+void write_json(std::ostream& out, const std::vector<BenchResult>& results, const BenchOptions& options) {
+    out << "{\n  \"benchmark\": \"gpu_bench\",\n  \"warmup\": " << options.warmup
+        << ",\n  \"repeat\": " << options.repeat << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& result = results[i];
+        const Scenario& s = result.scenario;
+        out << (i ? ",\n" : "\n")
+            << "    {\"scenario\": \"" << s.name << "\", \"triangles\": " << s.triangles
+            << ", \"triangle_size\": " << s.triangle_size
+            << ", \"viewport_width\": " << s.viewport_width << ", \"viewport_height\": " << s.viewport_height
+            << ", \"textures\": " << s.textures << ", \"texture_size\": " << s.texture_size
+            << ", \"compute_threads\": " << s.compute_threads
+            << ", \"texture_cache_mb\": " << s.texture_cache_mb
+            << ", \"l1_kb\": " << s.l1_kb << ", \"l2_kb\": " << s.l2_kb
+            << ", \"cache_policy\": \"" << policy_name(s.cache_policy) << "\""
+            << ", \"frames\": " << result.frame_ns.size()
+            << ", \"min_ns\": " << (result.frame_ns.empty() ? 0 : result.frame_ns.front())
+            << ", \"median_ns\": " << percentile(result.frame_ns, 0.5)
+            << ", \"mean_ns\": " << static_cast<uint64_t>(result.mean_ns)
+            << ", \"p95_ns\": " << percentile(result.frame_ns, 0.95)
+            << ", \"max_ns\": " << (result.frame_ns.empty() ? 0 : result.frame_ns.back())
+            << ", \"texture_samples_per_frame\": " << result.texture_samples
+            << ", \"fragments_per_frame\": " << result.fragments_processed
+            << ", \"texture_hit_rate\": " << result.texture_hit_rate << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void write_csv(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "scenario,triangles,triangle_size,viewport_width,viewport_height,textures,texture_size,"
+           "compute_threads,texture_cache_mb,l1_kb,l2_kb,cache_policy,frames,min_ns,median_ns,mean_ns,"
+           "p95_ns,max_ns,texture_samples_per_frame,fragments_per_frame,texture_hit_rate\n";
+    for (const BenchResult& result : results) {
+        const Scenario& s = result.scenario;
+        out << s.name << ',' << s.triangles << ',' << s.triangle_size << ','
+            << s.viewport_width << ',' << s.viewport_height << ',' << s.textures << ',' << s.texture_size << ','
+            << s.compute_threads << ',' << s.texture_cache_mb << ',' << s.l1_kb << ',' << s.l2_kb << ','
+            << policy_name(s.cache_policy) << ',' << result.frame_ns.size() << ','
+            << (result.frame_ns.empty() ? 0 : result.frame_ns.front()) << ','
+            << percentile(result.frame_ns, 0.5) << ',' << static_cast<uint64_t>(result.mean_ns) << ','
+            << percentile(result.frame_ns, 0.95) << ','
+            << (result.frame_ns.empty() ? 0 : result.frame_ns.back()) << ','
+            << result.texture_samples << ',' << result.fragments_processed << ','
+            << result.texture_hit_rate << '\n';
+    }
+}
+
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --scenario=NAME        Run one built-in scenario (default: all)\n"
+              << "  --list                 List built-in scenarios\n"
+              << "  --warmup=N             Untimed frames before measuring (default: 3)\n"
+              << "  --repeat=N             Timed frames per scenario (default: 10)\n"
+              << "  --format=json|csv      Output format (default: json)\n"
+              << "  --output=PATH          Write results to PATH instead of stdout\n"
+              << "Scenario overrides, applied to every selected scenario:\n"
+              << "  --triangles=N --triangle-size=PX --viewport=WxH\n"
+              << "  --textures=N --texture-size=PX --compute-threads=N\n"
+              << "  --texture-cache-mb=N --l1-kb=N --l2-kb=N --policy=lru|plru|srrip|brrip|random\n";
+}
+
+// Parses "--key=value" arguments; overrides are applied to the scenarios
+// once all options are known
+bool parse_arguments(int argc, char** argv, BenchOptions& options,
+                     std::vector<std::pair<std::string, std::string>>& overrides) {
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--list") {
+            options.list = true;
+            continue;
+        }
+        size_t equals = argument.find('=');
+        if (argument.compare(0, 2, "--") != 0 || equals == std::string::npos) {
+            return false;
+        }
+        std::string key = argument.substr(2, equals - 2);
+        std::string value = argument.substr(equals + 1);
+
+        if (key == "scenario") {
+            options.scenario = value;
+        } else if (key == "warmup") {
+            options.warmup = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (key == "repeat") {
+            options.repeat = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (key == "format") {
+            if (value != "json" && value != "csv") return false;
+            options.format = value;
+        } else if (key == "output") {
+            options.output = value;
+        } else {
+            overrides.emplace_back(key, value);
+        }
+    }
+    return options.repeat > 0;
+}
+
+bool apply_override(Scenario& scenario, const std::string& key, const std::string& value) {
+    auto number = [&value]() { return std::strtoul(value.c_str(), nullptr, 10); };
+    if (key == "triangles") {
+        scenario.triangles = static_cast<uint32_t>(number());
+    } else if (key == "triangle-size") {
+        scenario.triangle_size = std::strtof(value.c_str(), nullptr);
+    } else if (key == "viewport") {
+        size_t x = value.find('x');
+        if (x == std::string::npos) return false;
+        scenario.viewport_width = static_cast<uint32_t>(std::strtoul(value.substr(0, x).c_str(), nullptr, 10));
+        scenario.viewport_height = static_cast<uint32_t>(std::strtoul(value.substr(x + 1).c_str(), nullptr, 10));
+        if (scenario.viewport_width == 0 || scenario.viewport_height == 0) return false;
+    } else if (key == "textures") {
+        scenario.textures = static_cast<uint32_t>(number());
+    } else if (key == "texture-size") {
+        scenario.texture_size = static_cast<uint32_t>(number());
+    } else if (key == "compute-threads") {
+        scenario.compute_threads = static_cast<uint32_t>(number());
+    } else if (key == "texture-cache-mb") {
+        scenario.texture_cache_mb = number();
+    } else if (key == "l1-kb") {
+        scenario.l1_kb = number();
+    } else if (key == "l2-kb") {
+        scenario.l2_kb = number();
+    } else if (key == "policy") {
+        return parse_policy(value, scenario.cache_policy);
+    } else {
+        return false;
+    }
+    // Textured scenes need a texture to sample
+    return scenario.textures == 0 || scenario.texture_size > 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    std::vector<std::pair<std::string, std::string>> overrides;
+    if (!parse_arguments(argc, argv, options, overrides)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<Scenario> scenarios;
+    for (const Scenario& scenario : builtin_scenarios()) {
+        if (options.list) {
+            std::cout << scenario.name << std::endl;
+        } else if (options.scenario == "all" || options.scenario == scenario.name) {
+            scenarios.push_back(scenario);
+        }
+    }
+    if (options.list) {
+        return 0;
+    }
+    if (scenarios.empty()) {
+        std::cerr << "Unknown scenario: " << options.scenario << std::endl;
+        return 1;
+    }
+    for (Scenario& scenario : scenarios) {
+        for (const auto& [key, value] : overrides) {
+            if (!apply_override(scenario, key, value)) {
+                std::cerr << "Invalid option: --" << key << "=" << value << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+
+    std::vector<BenchResult> results;
+    for (const Scenario& scenario : scenarios) {
+        std::cerr << "Running " << scenario.name << "..." << std::endl;
+        results.push_back(run_scenario(scenario, options));
+    }
+
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (!file) {
+            std::cerr << "Cannot open " << options.output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.output.empty() ? std::cout : file;
+    if (options.format == "csv") {
+        write_csv(out, results);
+    } else {
+        write_json(out, results, options);
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <fstream>
+#include <initializer_list>
+#include <cstdint>
+#include "graphics_pipeline.h"
+#include "texture_cache.h"
+
+namespace gpu_sim {
+
+// Forward declarations
+class GPUCore;
+
+/**
+ * Command stream file layout. A 16-byte file header is followed by
+ * commands, each a 16-byte CommandHeader and a payload of fixed parameters
+ * and arrays (vertices, indices, texels, program words). Every part starts
+ * on a 16-byte boundary, so a mapped stream hands out aligned pointers.
+ * Vertices and parameters are stored in host layout; the header records
+ * sizeof(Vertex) and the reader rejects streams from other layouts.
+ */
+enum class CommandType : uint32_t {
+    SET_PIPELINE_STATE = 1,
+    UPLOAD_TEXTURE,
+    INVALIDATE_TEXTURE,
+    BIND_TEXTURE,
+    DRAW_TRIANGLES,
+    DRAW_INDEXED,
+    BEGIN_FRAME,
+    END_FRAME,
+    PRESENT,
+    DISPATCH_COMPUTE,
+    WAIT_FOR_COMPLETION
+};
+
+struct CommandHeader {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t payload_bytes;  // Including alignment padding
+};
+
+/**
+ * Records calls into a command stream file. Attach one writer to the
+ * pipeline, GPU core and texture cache with set_command_capture; each
+ * forwards its calls here as they are made. Textures are captured when
+ * uploaded, so capture must be attached before the textures a stream
+ * draws with are uploaded or registered. Recording is thread-safe and
+ * buffered; close() (or destruction) completes the file.
+ */
+class CommandStreamWriter {
+public:
+    CommandStreamWriter();
+    ~CommandStreamWriter();
+
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const;
+    // False once any write has failed
+    bool good() const;
+    uint64_t get_command_count() const;
+
+    void record_set_pipeline_state(const PipelineState& state);
+    void record_upload_texture(uint64_t texture_id, const TextureView& texture);
+    void record_invalidate_texture(uint64_t texture_id);
+    void record_bind_texture(uint32_t unit, uint64_t texture_id);
+    void record_draw_triangles(const Vertex* vertices, size_t vertex_count);
+    void record_draw_indexed(const Vertex* vertices, size_t vertex_count,
+                             const uint32_t* indices, size_t index_count);
+    void record_begin_frame();
+    void record_end_frame();
+    void record_present();
+    void record_dispatch_compute(const std::vector<uint32_t>& program, uint32_t num_threads);
+    void record_wait_for_completion();
+
+    static constexpr size_t ALIGNMENT = 16;
+
+private:
+    struct Section {
+        const void* data;
+        size_t size;
+    };
+
+    // Writes the header, the parameter block and each array, padding every
+    // part to ALIGNMENT
+    void write_command(CommandType type, const void* params, size_t params_size,
+                       std::initializer_list<Section> arrays = {});
+    void write_padded(const void* data, size_t size);
+
+    mutable std::mutex mutex_;
+    std::ofstream file_;
+    uint64_t command_count_;
+    bool failed_;
+};
+
+/**
+ * Replays a command stream into a pipeline, GPU core and texture cache.
+ * The file is memory-mapped where the platform allows it and vertex,
+ * index and texel arrays are passed to the components straight from the
+ * mapping, so replay does no per-command allocation or copy. The texture
+ * cache must be the one the pipeline was initialized with; textures keep
+ * their captured ids. A null component skips the commands aimed at it.
+ */
+class CommandStreamReplayer {
+public:
+    CommandStreamReplayer();
+    ~CommandStreamReplayer();
+
+    // Maps the file and validates its header
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const { return data_ != nullptr; }
+    size_t get_stream_bytes() const { return size_; }
+
+    struct ReplayStats {
+        uint64_t commands;
+        uint64_t draws;
+        uint64_t dispatches;
+        uint64_t frames;
+        uint64_t texture_uploads;
+    };
+
+    // Runs the whole stream in order and waits for outstanding compute
+    // work. Returns false if a command is malformed or truncated; commands
+    // before it have been executed.
+    bool replay(const std::shared_ptr<GraphicsPipeline>& pipeline,
+                const std::shared_ptr<GPUCore>& gpu_core,
+                const std::shared_ptr<TextureCache>& texture_cache);
+    ReplayStats get_last_replay_stats() const { return stats_; }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    void* mapping_;                 // Non-null when data_ is a memory mapping
+    std::vector<uint8_t> buffer_;   // Fallback when the file cannot be mapped
+    ReplayStats stats_;
+};
+
+} // namespace gpu_sim
@@ -2,55 +2,144 @@
 
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <mutex>
 #include <cstdint>
+#include "memory_hierarchy.h"
 
 namespace gpu_sim {
 
 // Forward declarations
-class MemoryHierarchy;
 class PerformanceMonitor;
+class ThreadPool;
+class CommandStreamWriter;
 
 /**
- * Represents a single GPU shader core that can execute shader programs
+ * Interpreter operations. Programs are decoded once per dispatch into a
+ * compact array and operands are validated there, so execution indexes the
+ * register file directly. Malformed LOAD/STORE become a STALL carrying the
+ * penalty they cost when issued without a memory model.
+ */
+enum class DecodedOp : uint8_t {
+    NOP,
+    ADD,
+    MUL,
+    LOAD,
+    STORE,
+    TID,
+    STALL,
+    END
+};
+
+struct DecodedInstruction {
+    DecodedOp op;
+    uint8_t dst;            // ADD/MUL/LOAD/TID destination
+    uint8_t src0;           // First source; LOAD/STORE address register
+    uint8_t src1;           // Second source; STORE value register
+    uint32_t stall_cycles;  // STALL only
+};
+
+struct DecodedProgram {
+    std::vector<DecodedInstruction> code;  // Always terminated by END
+    uint32_t instruction_count = 0;        // Instructions excluding END
+};
+
+// Encoded programs are 4 words per instruction: opcode and up to 3 operands
+DecodedInstruction decode_instruction(const uint32_t* words, size_t count);
+DecodedProgram decode_program(const std::vector<uint32_t>& program);
+
+/**
+ * Represents a single GPU shader core that can execute shader programs.
+ * Threads run in SIMT warps of WARP_SIZE lanes: every lane has its own
+ * registers, one warp instruction is issued for all active lanes, and a
+ * warp's LOAD/STORE lanes are coalesced into one batched memory access.
  */
 class ShaderCore {
 public:
     explicit ShaderCore(uint32_t core_id);
     ~ShaderCore() = default;
 
-    // Core operations
+    // Core operations. LOAD/STORE go through the attached memory hierarchy
+    // and charge its access latency to the core's cycle count.
+    void set_memory(std::shared_ptr<MemoryHierarchy> memory) { memory_ = memory; }
+    
+    // Issues one instruction to a full warp on the core's current registers
     void execute_instruction(const std::vector<uint32_t>& instruction);
+    
+    // Runs `program` for threads first_thread .. first_thread + num_threads - 1,
+    // packed into warps with fresh registers. Calls on the same core are
+    // serialized, so chunks of one core's threads may be issued from any host thread.
+    void execute_threads(const DecodedProgram& program, uint32_t num_threads,
+                         uint32_t first_thread = 0);
     bool is_busy() const { return busy_; }
     uint32_t get_core_id() const { return core_id_; }
     
-    // Performance metrics
+    static constexpr uint32_t NUM_REGISTERS = 32;
+    static constexpr uint32_t WARP_SIZE = 32;
+    static constexpr uint32_t FULL_WARP_MASK = 0xFFFFFFFFu;
+    
+    // Performance metrics, stable once GPUCore::wait_for_completion returns.
+    // Instruction count is per thread (active lane); warp counts are per issue.
     uint64_t get_instruction_count() const { return instruction_count_; }
+    uint64_t get_warp_instruction_count() const { return warp_instruction_count_; }
+    uint64_t get_warp_count() const { return warp_count_; }
     uint64_t get_cycle_count() const { return cycle_count_; }
 
 private:
+    // SoA register file: the lanes of one register are contiguous and
+    // aligned so ALU ops run as SIMD across the warp
+    struct WarpRegisters {
+        alignas(32) float lanes[NUM_REGISTERS][WARP_SIZE];
+    };
+    
     uint32_t core_id_;
-    bool busy_;
+    std::atomic<bool> busy_;
+    std::mutex execution_mutex_;
     uint64_t instruction_count_;
+    uint64_t warp_instruction_count_;
+    uint64_t warp_count_;
     uint64_t cycle_count_;
-    std::vector<float> registers_;
+    WarpRegisters registers_;
+    uint32_t active_mask_;
+    uint32_t warp_base_thread_;
+    std::shared_ptr<MemoryHierarchy> memory_;
+    
+    // Per-lane requests for the current warp memory instruction, reused
+    std::vector<MemoryReadRequest> lane_reads_;
+    std::vector<MemoryWriteRequest> lane_writes_;
+    
+    uint64_t register_address(uint32_t reg, uint32_t lane) const;
+    void run(const DecodedInstruction* code);
 };
 
 /**
- * Main GPU core that manages multiple shader cores and coordinates execution
+ * Main GPU core that manages multiple shader cores and coordinates execution.
+ * Dispatches are split into workgroup-sized chunks and run asynchronously on
+ * a host work-stealing thread pool; wait_for_completion is the barrier.
  */
 class GPUCore {
 public:
-    explicit GPUCore(uint32_t num_shader_cores = 32);
-    ~GPUCore() = default;
+    // 0 worker threads selects the host's hardware concurrency
+    explicit GPUCore(uint32_t num_shader_cores = 32, uint32_t num_worker_threads = 0);
+    ~GPUCore();
 
     // Core management
     void initialize(std::shared_ptr<MemoryHierarchy> memory, 
                    std::shared_ptr<PerformanceMonitor> perf_monitor);
     
-    // Execution control
+    // Execution control. dispatch_compute returns once the work is queued;
+    // wait_for_completion blocks until every outstanding dispatch has retired.
     void dispatch_compute(const std::vector<uint32_t>& program, 
                          uint32_t num_threads);
     void wait_for_completion();
+    uint32_t get_worker_thread_count() const;
+    
+    // Records dispatches and completion waits into a command stream; null stops
+    void set_command_capture(std::shared_ptr<CommandStreamWriter> capture);
+    
+    static constexpr uint32_t WORKGROUP_SIZE = 64;  // Two warps per queued chunk
+    static_assert(WORKGROUP_SIZE % ShaderCore::WARP_SIZE == 0,
+                  "Chunks must hold whole warps");
     
     // Status and metrics
     bool is_idle() const;
@@ -65,8 +154,16 @@ private:
     std::vector<std::unique_ptr<ShaderCore>> shader_cores_;
     std::shared_ptr<MemoryHierarchy> memory_;
     std::shared_ptr<PerformanceMonitor> perf_monitor_;
+    std::shared_ptr<CommandStreamWriter> capture_;
     uint32_t num_cores_;
     bool initialized_;
+    
+    std::atomic<uint32_t> outstanding_chunks_;
+    bool dispatch_in_flight_;
+    uint32_t chunk_trace_id_;  // PerformanceMonitor::TimerId of per-core chunk spans
+    
+    // Declared last so workers are joined before the cores they run on go away
+    std::unique_ptr<ThreadPool> thread_pool_;
 };
 
 } // namespace gpu_sim
\ No newline at end of file
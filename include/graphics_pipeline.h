@@ -3,7 +3,10 @@
 #include <vector>
 #include <memory>
 #include <functional>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include "performance_monitor.h"
 
 namespace gpu_sim {
 
@@ -11,7 +14,8 @@ namespace gpu_sim {
 class GPUCore;
 class MemoryHierarchy;
 class TextureCache;
-class PerformanceMonitor;
+class ThreadPool;
+class CommandStreamWriter;
 
 /**
  * Vertex data structure
@@ -44,6 +48,18 @@ struct Texture {
     uint32_t mip_levels;
 };
 
+/**
+ * Depth buffer storage format. UNORM formats store depth in [0, 1] as
+ * fixed point: UNORM24 in a 32-bit word with 8 unused bits, UNORM16 in
+ * half the bytes of FLOAT32. Fragment depth is quantized to the format
+ * before it is tested, so all depth tests agree with what is stored.
+ */
+enum class DepthFormat : uint8_t {
+    FLOAT32,
+    UNORM24,
+    UNORM16
+};
+
 /**
  * Pipeline state configuration
  */
@@ -53,15 +69,94 @@ struct PipelineState {
     bool culling_enabled;
     uint32_t viewport_width;
     uint32_t viewport_height;
+    uint32_t vertex_cache_size = 32;  // Post-transform cache entries; 0 disables it
+    
+    // Early depth rejection: with depth testing on, fragments are tested
+    // before shading and 8x8 blocks are skipped against a coarse max-depth
+    // (Hi-Z) buffer. Disabled automatically when the shader writes depth.
+    bool early_z_enabled = true;
+    bool fragment_shader_writes_depth = false;
+    
+    DepthFormat depth_format = DepthFormat::FLOAT32;
+};
+
+/**
+ * Post-transform vertex cache for indexed draws. Shaded vertices are keyed
+ * by index and replaced FIFO, like the small tag-matched caches in hardware.
+ */
+class PostTransformVertexCache {
+public:
+    void resize(size_t entries);
+    void clear();
+    
+    const Vertex* find(uint32_t index) const;
+    void insert(uint32_t index, const Vertex& vertex);
+    size_t capacity() const { return tags_.size(); }
+
+private:
+    std::vector<uint32_t> tags_;
+    std::vector<Vertex> vertices_;
+    size_t valid_entries_ = 0;
+    size_t next_slot_ = 0;
+};
+
+/**
+ * Deferred recording of state changes, texture binds and draws for
+ * GraphicsPipeline::submit. Geometry is copied into the buffer when
+ * recorded, so callers may reuse their vectors at once. Textures are bound
+ * by TextureCache id; a texture bound to the pipeline by value stays bound
+ * only until the buffer rebinds its unit. A buffer can be submitted any
+ * number of times and reset() keeps its capacity for the next recording.
+ */
+class CommandBuffer {
+public:
+    void set_pipeline_state(const PipelineState& state);
+    void bind_texture(uint32_t unit, uint64_t texture_id);
+    void draw_triangles(const std::vector<Vertex>& vertices);
+    void draw_triangles(const Vertex* vertices, size_t vertex_count);
+    void draw_indexed(const std::vector<Vertex>& vertices,
+                     const std::vector<uint32_t>& indices);
+    void draw_indexed(const Vertex* vertices, size_t vertex_count,
+                     const uint32_t* indices, size_t index_count);
+    
+    void reset();
+    bool empty() const { return commands_.empty(); }
+    size_t get_draw_count() const { return draw_count_; }
+
+private:
+    friend class GraphicsPipeline;
+    
+    enum class CommandKind : uint8_t { SET_STATE, BIND_TEXTURE, DRAW, DRAW_INDEXED };
+    struct Command {
+        CommandKind kind;
+        uint32_t index;       // State index for SET_STATE, unit for BIND_TEXTURE
+        uint64_t texture_id;
+        size_t first_vertex, vertex_count;
+        size_t first_index, index_count;
+    };
+    
+    std::vector<Command> commands_;
+    std::vector<PipelineState> states_;
+    std::vector<Vertex> vertices_;
+    std::vector<uint32_t> indices_;
+    size_t draw_count_ = 0;
 };
 
 /**
- * Graphics pipeline implementation with stages
+ * Graphics pipeline implementation with stages.
+ *
+ * Rasterization is sort-middle: draws run the vertex stage and bin each
+ * post-cull triangle to the BIN_TILE_SIZE screen tiles it touches. Bins are
+ * rendered in parallel, each tile into its own local color/depth storage,
+ * and resolved to the frame buffer at end_frame (or at the end of a draw
+ * issued outside a frame). State changes render pending bins first, so
+ * output matches immediate-mode rendering.
  */
 class GraphicsPipeline {
 public:
-    GraphicsPipeline();
-    ~GraphicsPipeline() = default;
+    // 0 worker threads selects the host's hardware concurrency
+    explicit GraphicsPipeline(uint32_t num_worker_threads = 0);
+    ~GraphicsPipeline();
 
     // Initialization
     void initialize(std::shared_ptr<GPUCore> gpu_core,
@@ -71,21 +166,85 @@ public:
 
     // Pipeline configuration
     void set_pipeline_state(const PipelineState& state);
+    // Binding a Texture uploads it to the texture cache under a new id,
+    // released on re-bind or destruction. Binding by id uses a texture
+    // registered with TextureCache::register_texture and owned by the caller.
     void bind_texture(uint32_t unit, const Texture& texture);
+    void bind_texture(uint32_t unit, uint64_t texture_id);
 
-    // Shader program management
+    // Shader program management. Fragment shaders run on tile worker
+    // threads and may be invoked concurrently.
+    //
+    // Batch shaders are called once per batch of vertices or fragments
+    // (fragments are shaded in place). The inline setters take any functor
+    // by type and wrap it in a batch loop the compiler can inline and
+    // vectorize. The per-element std::function setters remain as the
+    // generic fallback; each setter replaces the previous shader.
+    using VertexBatchShader = std::function<void(const Vertex* input, Vertex* output, size_t count)>;
+    using FragmentBatchShader = std::function<void(Fragment* fragments, size_t count)>;
+    
     void set_vertex_shader(std::function<Vertex(const Vertex&)> shader);
     void set_fragment_shader(std::function<Fragment(const Fragment&)> shader);
+    void set_vertex_batch_shader(VertexBatchShader shader);
+    void set_fragment_batch_shader(FragmentBatchShader shader);
+    
+    template <typename Shader>
+    void set_vertex_shader_inline(Shader shader) {
+        set_vertex_batch_shader([shader](const Vertex* input, Vertex* output, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                output[i] = shader(input[i]);
+            }
+        });
+    }
+    
+    template <typename Shader>
+    void set_fragment_shader_inline(Shader shader) {
+        set_fragment_batch_shader([shader](Fragment* fragments, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                fragments[i] = shader(fragments[i]);
+            }
+        });
+    }
 
-    // Rendering operations
+    // Rendering operations. The pointer forms draw from caller memory, such
+    // as a mapped command stream, without copying it into a vector.
     void draw_triangles(const std::vector<Vertex>& vertices);
+    void draw_triangles(const Vertex* vertices, size_t vertex_count);
     void draw_indexed(const std::vector<Vertex>& vertices, 
                      const std::vector<uint32_t>& indices);
+    void draw_indexed(const Vertex* vertices, size_t vertex_count,
+                     const uint32_t* indices, size_t index_count);
+
+    /**
+     * Batched execution of a recorded command buffer. Draws are grouped
+     * into batches of identical state and texture bindings; bins are
+     * rendered only between batches and, outside a frame, once at the end.
+     * Batches start from the state and textures bound at submit time.
+     *
+     * merge_draws runs adjacent non-indexed draws of a batch as one draw.
+     * sort_by_texture reorders batches by texture and state, merging equal
+     * ones; it changes draw order, so use it only for order-independent
+     * draws such as depth-tested opaque geometry. overlap_vertex_processing
+     * shades the next batch's vertices on a raster worker while the
+     * previous batch's bins render, so vertex shaders may then run
+     * concurrently with fragment shaders.
+     */
+    struct SubmitOptions {
+        bool merge_draws = true;
+        bool sort_by_texture = false;
+        bool overlap_vertex_processing = true;
+    };
+    void submit(const CommandBuffer& buffer);
+    void submit(const CommandBuffer& buffer, const SubmitOptions& options);
 
     // Frame management
     void begin_frame();
     void end_frame();
     void present();
+    
+    // Records state changes, binds, draws and frame boundaries into a
+    // command stream; null stops. Shaders are host code and not captured.
+    void set_command_capture(std::shared_ptr<CommandStreamWriter> capture);
 
     // Performance metrics
     struct PipelineStats {
@@ -93,44 +252,228 @@ public:
         uint64_t fragments_processed;
         uint64_t triangles_drawn;
         uint64_t texture_samples;
+        uint64_t vertex_cache_hits;
+        uint64_t vertex_cache_misses;
+        uint64_t early_z_rejected_fragments;  // Failed the depth test before shading
+        uint64_t hiz_culled_blocks;           // 8x8 triangle blocks skipped by Hi-Z
         double frame_time_ms;
     };
 
     PipelineStats get_statistics() const;
+    
+    // Resolved frame buffer, row-major RGBA8 (R in the high byte). Tiles
+    // still fast-cleared are written out first.
+    const std::vector<uint32_t>& get_color_buffer() const;
+    // Stored depth of one pixel, decoded from the depth format
+    float get_depth(uint32_t x, uint32_t y) const;
+    
+    static constexpr int BIN_TILE_SIZE = 32;
 
 private:
-    // Pipeline stages
-    std::vector<Vertex> vertex_stage(const std::vector<Vertex>& input_vertices);
-    std::vector<Fragment> rasterization_stage(const std::vector<Vertex>& vertices);
-    std::vector<Fragment> fragment_stage(const std::vector<Fragment>& fragments);
-    void output_merger_stage(const std::vector<Fragment>& fragments);
+    /**
+     * Half-space edge function E(x, y) = a*x + b*y + c, positive on the
+     * interior side of a counter-clockwise triangle. Samples exactly on an
+     * edge belong to the triangle only for top-left edges.
+     */
+    struct EdgeFunction {
+        float a, b, c;
+        bool top_left;
+        
+        float evaluate(float x, float y) const { return a * x + b * y + c; }
+        
+        static EdgeFunction through(float ax, float ay, float bx, float by) {
+            EdgeFunction edge;
+            edge.a = ay - by;
+            edge.b = bx - ax;
+            edge.c = ax * by - ay * bx;
+            edge.top_left = edge.a > 0.0f || (edge.a == 0.0f && edge.b < 0.0f);
+            return edge;
+        }
+    };
+    
+    // Screen-space setup done once per triangle at binning time
+    struct TriangleSetup {
+        Vertex vertices[3];              // Counter-clockwise in screen space
+        EdgeFunction edges[3];           // Edge i is opposite vertex i
+        float inv_area;
+        float min_depth;                 // Conservative lower bound on fragment depth
+        int min_x, max_x, min_y, max_y;  // Pixel bounds clipped to the viewport
+    };
+    
+    // Fragments between rasterization and output merge
+    static constexpr size_t FRAGMENT_BATCH_SIZE = 256;
+    
+    // Vertices shaded per batch by draw_triangles; whole triangles only
+    static constexpr size_t VERTEX_BATCH_SIZE = 96;
+    static_assert(VERTEX_BATCH_SIZE % 3 == 0, "vertex batches must hold whole triangles");
+    
+    // Hi-Z granularity: one max depth per raster block of a bin tile
+    static constexpr int HIZ_BLOCK_SIZE = 8;
+    static constexpr int HIZ_BLOCKS_PER_ROW = BIN_TILE_SIZE / HIZ_BLOCK_SIZE;
+    
+    /**
+     * Structure-of-arrays fragment batch used between the pipeline's
+     * internal stages, so interpolation, sampling and merge loops walk
+     * unit-stride arrays. Fragments are packed as they are rasterized;
+     * only shaders see the AoS Fragment form.
+     */
+    struct FragmentStream {
+        uint16_t pixel[FRAGMENT_BATCH_SIZE];           // Tile-local pixel index
+        uint8_t valid[FRAGMENT_BATCH_SIZE];
+        float depth[FRAGMENT_BATCH_SIZE];
+        float inv_w[FRAGMENT_BATCH_SIZE];
+        float barycentric[3][FRAGMENT_BATCH_SIZE];     // Screen-space weights
+        float color[4][FRAGMENT_BATCH_SIZE];
+        float texcoord[2][FRAGMENT_BATCH_SIZE];
+    };
+    
+    /**
+     * Worker-owned render target for the bin tile being drawn. Color and
+     * depth stay cache-resident while every triangle in the bin is drawn.
+     */
+    struct TileContext {
+        int x0 = 0, y0 = 0, width = 0, height = 0;
+        uint32_t color[BIN_TILE_SIZE * BIN_TILE_SIZE];
+        float depth[BIN_TILE_SIZE * BIN_TILE_SIZE];
+        
+        // Max depth per Hi-Z block; depth writes mark a block stale and it
+        // is recomputed on its next lookup
+        float hiz_max[HIZ_BLOCKS_PER_ROW * HIZ_BLOCKS_PER_ROW];
+        uint32_t hiz_stale = 0;
+        
+        FragmentStream fragments;
+        size_t fragment_count = 0;
+        size_t interpolated_count = 0;  // Leading fragments with attributes filled in
+        
+        // AoS staging for fragment shaders
+        std::vector<Fragment> shader_batch = std::vector<Fragment>(FRAGMENT_BATCH_SIZE);
+        
+        // Folded into stats_ after each render
+        uint64_t fragments_processed = 0;
+        uint64_t texture_samples = 0;
+        uint64_t early_z_rejected_fragments = 0;
+        uint64_t hiz_culled_blocks = 0;
+    };
+    
+    // Pipeline stages. Stages stream: the rasterizer fills a fixed-size
+    // fragment batch, and each full batch is shaded in place and merged
+    // before rasterization continues, so no stage allocates per draw.
+    void vertex_stage(const Vertex* input_vertices, size_t count, Vertex* output_vertices);
+    void rasterization_stage(const TriangleSetup& setup, TileContext& tile);
+    void fragment_stage(TileContext& tile);
+    void output_merger_stage(TileContext& tile);
+    void merge_fragment(TileContext& tile, size_t index);
+    void flush_fragment_batch(TileContext& tile);
+    void draw_triangle(const Vertex& v0, const Vertex& v1, const Vertex& v2);
+    
+    // Binning and tile rendering
+    bool setup_triangle(const Vertex& v0, const Vertex& v1, const Vertex& v2,
+                        TriangleSetup& setup) const;
+    // Trivial reject/accept of a square block of pixel centres at (x, y)
+    static void classify_block(const EdgeFunction* edges, int x, int y, int size,
+                               bool& rejected, bool& accepted);
+    void resize_bins();
+    // Writes fast-cleared tiles' clear values out to the frame buffer
+    void resolve_fast_clears() const;
+    void convert_depth_buffer(DepthFormat from, DepthFormat to);
+    void release_texture_unit(uint32_t unit);
+    void render_bins();
+    void render_tile(TileContext& tile, uint32_t bin_index);
+    bool early_depth_enabled() const;
+    float hiz_block_max(TileContext& tile, int block) const;
+
+    // Command buffer submission
+    struct SubmitBatch {
+        int32_t state;                  // Index into the buffer's states, -1 for the submit-time state
+        uint32_t state_class;           // Equal for equal states
+        std::vector<uint64_t> textures; // Texture id per unit
+        std::vector<uint32_t> draws;    // Command indices, in execution order
+    };
+    std::vector<SubmitBatch> plan_submission(const CommandBuffer& buffer, const SubmitOptions& options) const;
+    void shade_batch(const CommandBuffer& buffer, const SubmitBatch& batch, std::vector<Vertex>& shaded);
+    void apply_batch_state(const CommandBuffer& buffer, const SubmitBatch& batch,
+                           const PipelineState& initial_state);
+    void execute_batch(const CommandBuffer& buffer, const SubmitBatch& batch,
+                       const std::vector<Vertex>& shaded, bool merge_draws);
 
     // Helper functions
     bool is_triangle_culled(const Vertex& v0, const Vertex& v1, const Vertex& v2);
-    Fragment interpolate_fragment(const Vertex& v0, const Vertex& v1, const Vertex& v2,
-                                 float u, float v, float w);
+    // Fills in attributes for the batch's fragments from one triangle.
+    // Barycentrics are in screen space; perspective correction happens inside.
+    void interpolate_attributes(TileContext& tile, const TriangleSetup& setup);
 
     // Components
     std::shared_ptr<GPUCore> gpu_core_;
     std::shared_ptr<MemoryHierarchy> memory_;
     std::shared_ptr<TextureCache> texture_cache_;
     std::shared_ptr<PerformanceMonitor> perf_monitor_;
+    std::shared_ptr<CommandStreamWriter> capture_;
+    
+    // Handles registered with perf_monitor_ by initialize
+    struct PerfIds {
+        PerformanceMonitor::TimerId draw_triangles = 0;
+        PerformanceMonitor::TimerId draw_indexed = 0;
+        PerformanceMonitor::TimerId frame_time = 0;
+        PerformanceMonitor::TimerId render_bins = 0;   // Profiling scopes
+        PerformanceMonitor::TimerId render_tile = 0;
+        PerformanceMonitor::TimerId vertex_stage = 0;
+        PerformanceMonitor::TimerId rasterization_stage = 0;
+        PerformanceMonitor::TimerId fragment_stage = 0;
+        PerformanceMonitor::TimerId output_merger_stage = 0;
+        PerformanceMonitor::TimerId submit = 0;
+        PerformanceMonitor::CounterId triangles_drawn = 0;
+        PerformanceMonitor::CounterId vertices_processed = 0;
+        PerformanceMonitor::CounterId early_z_rejected_fragments = 0;
+        PerformanceMonitor::CounterId hiz_culled_blocks = 0;
+        PerformanceMonitor::CounterId frames_presented = 0;
+        PerformanceMonitor::CounterId submitted_draws = 0;
+        PerformanceMonitor::CounterId submitted_batches = 0;
+    };
+    PerfIds perf_ids_;
 
     // State
     PipelineState pipeline_state_;
-    std::vector<Texture> bound_textures_;
+    struct BoundTexture {
+        uint64_t texture_id = 0;  // 0 when the unit is empty
+        uint32_t width = 0;
+        uint32_t height = 0;
+        bool owned = false;       // Uploaded by bind_texture, released with the unit
+    };
+    std::vector<BoundTexture> bound_textures_;
     
-    // Shaders
-    std::function<Vertex(const Vertex&)> vertex_shader_;
-    std::function<Fragment(const Fragment&)> fragment_shader_;
+    // Shaders, always held in batch form; empty means pass-through
+    VertexBatchShader vertex_shader_;
+    FragmentBatchShader fragment_shader_;
+    std::vector<Vertex> vertex_batch_;
+    std::vector<Vertex> submit_vertices_;  // Shaded vertices of the submit batch being drawn
 
-    // Frame buffer
-    std::vector<uint32_t> color_buffer_;
-    std::vector<float> depth_buffer_;
+    // Frame buffer. begin_frame only flags every bin tile as cleared; a
+    // flagged tile starts from the clear values when rendered, and its
+    // frame buffer region is written when the tile resolves or the buffer
+    // is read, so clearing touches one byte per tile.
+    static constexpr uint32_t CLEAR_COLOR = 0x000000FF;  // Black with full alpha
+    static constexpr float CLEAR_DEPTH = 1.0f;
+    mutable std::vector<uint32_t> color_buffer_;
+    mutable std::vector<uint8_t> depth_buffer_;   // Encoded in pipeline_state_.depth_format
+    mutable std::vector<uint8_t> tile_cleared_;   // Per bin tile
+    
+    // Binned triangles awaiting rendering; capacity is kept across frames
+    std::vector<TriangleSetup> binned_triangles_;
+    std::vector<std::vector<uint32_t>> bins_;  // Triangle indices per tile, in draw order
+    std::vector<uint32_t> active_bins_;
+    uint32_t bins_x_, bins_y_;
+    bool frame_active_;
+    
+    // Tile workers
+    std::unique_ptr<ThreadPool> raster_pool_;
+    std::vector<std::unique_ptr<TileContext>> tile_contexts_;
+    std::atomic<size_t> next_bin_;
+    
+    PostTransformVertexCache vertex_cache_;
     
     // Statistics
     mutable PipelineStats stats_;
-    uint64_t frame_start_time_;
+    std::chrono::steady_clock::time_point frame_start_time_;
 };
 
 } // namespace gpu_sim
\ No newline at end of file
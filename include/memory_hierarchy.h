@@ -2,28 +2,35 @@
 
 #include <unordered_map>
 #include <vector>
+#include <set>
+#include <array>
 #include <memory>
+#include <variant>
+#include <mutex>
 #include <cstdint>
+#include "replacement_policy.h"
 
 namespace gpu_sim {
 
 /**
- * Cache line structure for GPU memory
+ * Dirty victim reported by GPUCache::install_line. The victim's data is still
+ * in the returned line storage until the caller fills it.
  */
-struct CacheLine {
-    uint64_t address;
-    std::vector<uint8_t> data;
-    bool valid;
-    bool dirty;
-    uint64_t access_time;
-    
-    CacheLine(uint64_t addr, size_t size) 
-        : address(addr), data(size), valid(false), dirty(false), access_time(0) {}
+struct LineEviction {
+    bool dirty = false;
+    uint64_t address = 0;
 };
 
 /**
- * GPU cache implementation with configurable associativity
+ * GPU cache implementation with configurable associativity.
+ *
+ * Line metadata (tags, valid/dirty bits) is kept in packed structure-of-arrays
+ * form, indexed by set * associativity + way, so the ways of a set are
+ * contiguous. Line data lives in a single preallocated slab; a miss never
+ * allocates. Replacement is delegated to the Policy template parameter (see
+ * replacement_policy.h), which is called statically on the hot path.
  */
+template <typename Policy = LRUPolicy>
 class GPUCache {
 public:
     GPUCache(size_t cache_size, size_t line_size, size_t associativity);
@@ -35,27 +42,239 @@ public:
     void invalidate(uint64_t address);
     void flush();
 
+    // Line-level access used by the memory hierarchy for fills. lookup_line
+    // counts a hit or miss and returns the line data on a hit; install_line
+    // claims a way for the line and returns its storage for the caller to fill,
+    // reporting a dirty victim that must be written back first.
+    uint8_t* lookup_line(uint64_t address, bool mark_dirty = false);
+    uint8_t* install_line(uint64_t address, bool mark_dirty = false,
+                          LineEviction* eviction = nullptr);
+    
+    // Hands every dirty line to write_back(address, data, size) and cleans it
+    template <typename WriteBack>
+    void write_back_dirty_lines(WriteBack&& write_back) {
+        for (size_t slot = 0; slot < valid_.size(); ++slot) {
+            if (valid_[slot] && dirty_[slot]) {
+                write_back(line_address(slot), line_data(slot), line_size_);
+                dirty_[slot] = 0;
+                writeback_count_++;
+            }
+        }
+    }
+
+    // Configuration
+    size_t get_line_size() const { return line_size_; }
+
     // Statistics
     uint64_t get_hit_count() const { return hit_count_; }
     uint64_t get_miss_count() const { return miss_count_; }
+    uint64_t get_writeback_count() const { return writeback_count_; }
     double get_hit_rate() const;
 
 private:
+    static constexpr size_t INVALID_SLOT = static_cast<size_t>(-1);
+
     size_t cache_size_;
     size_t line_size_;
     size_t associativity_;
     size_t num_sets_;
     
-    std::vector<std::vector<std::unique_ptr<CacheLine>>> cache_sets_;
+    // Per-way metadata, indexed by slot = set * associativity_ + way
+    std::vector<uint64_t> tags_;
+    std::vector<uint8_t> valid_;
+    std::vector<uint8_t> dirty_;
+    
+    // Line data slab, line_size_ bytes per slot
+    std::vector<uint8_t> data_;
+    
+    Policy policy_;
     
     uint64_t hit_count_;
     uint64_t miss_count_;
     uint64_t access_count_;
+    uint64_t writeback_count_;
 
     size_t get_set_index(uint64_t address) const;
     uint64_t get_tag(uint64_t address) const;
-    CacheLine* find_line(uint64_t address);
-    CacheLine* allocate_line(uint64_t address);
+    uint64_t line_address(size_t slot) const;
+    uint8_t* line_data(size_t slot) { return data_.data() + slot * line_size_; }
+    size_t find_line(uint64_t address);
+    size_t access_line(uint64_t address);
+    size_t allocate_line(uint64_t address, LineEviction* eviction = nullptr);
+};
+
+// Instantiated in memory_hierarchy.cpp for the policies in replacement_policy.h
+extern template class GPUCache<LRUPolicy>;
+extern template class GPUCache<TreePLRUPolicy>;
+extern template class GPUCache<SRRIPPolicy>;
+extern template class GPUCache<BRRIPPolicy>;
+extern template class GPUCache<RandomPolicy>;
+
+/**
+ * A cache level whose replacement policy is chosen at configuration time
+ */
+using CacheLevel = std::variant<GPUCache<LRUPolicy>,
+                                GPUCache<TreePLRUPolicy>,
+                                GPUCache<SRRIPPolicy>,
+                                GPUCache<BRRIPPolicy>,
+                                GPUCache<RandomPolicy>>;
+
+/**
+ * Sparse, paged VRAM backing store. Pages are materialized on first write;
+ * reads of pages that were never written return zeros. Page sizes are
+ * powers of two: a zero page size selects DEFAULT_PAGE_SIZE and any other
+ * size is rounded up.
+ */
+class VRAMStore {
+public:
+    VRAMStore(uint64_t capacity, size_t page_size);
+    ~VRAMStore() = default;
+
+    bool read(uint64_t address, void* data, size_t size) const;
+    bool write(uint64_t address, const void* data, size_t size);
+    bool in_bounds(uint64_t address, size_t size) const;
+
+    uint64_t get_capacity() const { return capacity_; }
+    size_t get_page_size() const { return page_size_; }
+    uint64_t get_resident_pages() const { return resident_pages_; }
+    
+    static constexpr size_t DEFAULT_PAGE_SIZE = 64 * 1024;
+
+private:
+    uint64_t capacity_;
+    size_t page_size_;
+    uint32_t page_shift_;  // log2(page_size_)
+    std::vector<std::unique_ptr<uint8_t[]>> pages_;
+    uint64_t resident_pages_;
+};
+
+/**
+ * Binary buddy allocator over a VRAM address range. Blocks are powers of two
+ * aligned to their size; freed blocks coalesce with their buddy. Allocate and
+ * free are O(log n) per order.
+ */
+class BuddyAllocator {
+public:
+    BuddyAllocator(uint64_t base, uint64_t limit);
+    ~BuddyAllocator() = default;
+
+    // Returns 0 when no block is large enough
+    uint64_t allocate(size_t size);
+    // Returns the size of the freed block, or 0 if address was not allocated
+    uint64_t free(uint64_t address);
+    
+    struct AllocatorStats {
+        uint64_t live_allocations;
+        uint64_t bytes_requested;       // Sum of live request sizes
+        uint64_t bytes_allocated;       // Sum of live block sizes
+        uint64_t peak_bytes_allocated;  // High-water mark of bytes_allocated
+        uint64_t free_bytes;
+        uint64_t largest_free_block;
+        double external_fragmentation;  // 1 - largest_free_block / free_bytes
+        double internal_fragmentation;  // 1 - bytes_requested / bytes_allocated
+    };
+    
+    AllocatorStats get_statistics() const;
+
+private:
+    static constexpr uint32_t MIN_ORDER = 4;   // 16-byte minimum block
+    static constexpr uint32_t MAX_ORDER = 63;
+    
+    struct Allocation {
+        uint32_t order;
+        uint64_t requested;
+    };
+    
+    std::vector<std::set<uint64_t>> free_lists_;  // Free block addresses per order
+    std::unordered_map<uint64_t, Allocation> allocations_;
+    
+    uint64_t bytes_requested_;
+    uint64_t bytes_allocated_;
+    uint64_t peak_bytes_allocated_;
+    uint64_t free_bytes_;
+    
+    static uint32_t order_for_size(uint64_t size);
+};
+
+/**
+ * Cache write policies. Write-through forwards every store to the next level;
+ * write-back keeps dirty lines in the cache until they are evicted or flushed.
+ */
+enum class WritePolicy {
+    WRITE_THROUGH,
+    WRITE_BACK
+};
+
+/**
+ * Memory hierarchy configuration
+ */
+struct MemoryConfig {
+    // L1 cache: 32KB, 64-byte lines, 4-way associative
+    size_t l1_size = 32 * 1024;
+    size_t l1_line_size = 64;
+    size_t l1_associativity = 4;
+    ReplacementPolicy l1_policy = ReplacementPolicy::LRU;
+    
+    // L2 cache: 512KB, 128-byte lines, 8-way associative
+    size_t l2_size = 512 * 1024;
+    size_t l2_line_size = 128;
+    size_t l2_associativity = 8;
+    ReplacementPolicy l2_policy = ReplacementPolicy::LRU;
+    
+    // Store handling for both cache levels. Without write-allocate a store
+    // that misses bypasses the level instead of filling the line.
+    WritePolicy write_policy = WritePolicy::WRITE_THROUGH;
+    bool write_allocate = true;
+    
+    uint64_t vram_size = 4ULL * 1024 * 1024 * 1024;  // 4GB
+    size_t vram_page_size = 64 * 1024;               // 64KB pages; rounded up to a power of two, 0 for the default
+    
+    // Timing, in cycles. VRAM transfers occupy a single channel for
+    // size / vram_bytes_per_cycle cycles, so back-to-back misses queue.
+    uint32_t l1_latency = 1;
+    uint32_t l2_latency = 10;
+    uint32_t vram_latency = 100;
+    uint32_t vram_bytes_per_cycle = 32;
+};
+
+/**
+ * Per-access timing. The request is issued at issue_cycle and its data is
+ * available latency_cycles later.
+ */
+struct MemoryTiming {
+    uint64_t issue_cycle = 0;
+    uint64_t latency_cycles = 0;
+};
+
+/**
+ * Log2-bucketed latency histogram: bucket i counts latencies in
+ * [2^i, 2^(i+1)) cycles, with bucket 0 also holding zero-cycle accesses.
+ */
+struct LatencyHistogram {
+    static constexpr size_t NUM_BUCKETS = 20;
+    
+    std::array<uint64_t, NUM_BUCKETS> buckets{};
+    uint64_t samples = 0;
+    uint64_t total_cycles = 0;
+    uint64_t max_cycles = 0;
+    
+    void record(uint64_t cycles);
+    double mean() const { return samples ? static_cast<double>(total_cycles) / samples : 0.0; }
+};
+
+/**
+ * Batched memory requests. Each request covers [address, address + size).
+ */
+struct MemoryReadRequest {
+    uint64_t address;
+    size_t size;
+    void* data;
+};
+
+struct MemoryWriteRequest {
+    uint64_t address;
+    size_t size;
+    const void* data;
 };
 
 /**
@@ -63,42 +282,110 @@ private:
  */
 class MemoryHierarchy {
 public:
-    MemoryHierarchy();
+    explicit MemoryHierarchy(const MemoryConfig& config = MemoryConfig{});
     ~MemoryHierarchy() = default;
 
-    // Memory operations
-    bool read(uint64_t address, void* data, size_t size);
-    bool write(uint64_t address, const void* data, size_t size);
+    // Memory operations. With timing, the access is issued at
+    // timing->issue_cycle and its cost is returned in timing->latency_cycles;
+    // without, it is issued at the hierarchy's own clock, which then advances
+    // past the access as for a single blocking requester.
+    bool read(uint64_t address, void* data, size_t size, MemoryTiming* timing = nullptr);
+    bool write(uint64_t address, const void* data, size_t size, MemoryTiming* timing = nullptr);
+    
+    // Batched operations: requests are coalesced by L1 line so each unique
+    // line walks the hierarchy once. Returns false if any request is out of bounds.
+    bool read_batch(const std::vector<MemoryReadRequest>& requests, MemoryTiming* timing = nullptr);
+    bool write_batch(const std::vector<MemoryWriteRequest>& requests, MemoryTiming* timing = nullptr);
     
-    // Memory allocation
+    // Memory allocation. Freed memory is reused; deallocate also invalidates
+    // the allocation's lines in every cache level.
     uint64_t allocate(size_t size);
     void deallocate(uint64_t address);
+    BuddyAllocator::AllocatorStats get_allocator_statistics() const;
     
-    // Cache management
+    // Cache management. Dirty lines are written back before the caches are emptied.
     void flush_all_caches();
     
     // Statistics
     struct MemoryStats {
         uint64_t l1_hits, l1_misses;
         uint64_t l2_hits, l2_misses;
+        uint64_t l1_writebacks, l2_writebacks;
         uint64_t vram_accesses;
-        double avg_access_latency;
+        uint64_t vram_reads, vram_writes;
+        uint64_t vram_bytes_read, vram_bytes_written;
+        uint64_t vram_resident_pages;
+        uint64_t vram_queue_cycles;      // Cycles VRAM requests spent waiting for the channel
+        double avg_access_latency;       // Mean cycles per L1 line access
+        
+        // Latency of each line access from that level down
+        LatencyHistogram l1_latency;
+        LatencyHistogram l2_latency;
+        LatencyHistogram vram_latency;
     };
     
     MemoryStats get_statistics() const;
+    uint64_t get_vram_size() const { return vram_.get_capacity(); }
+    uint64_t get_current_cycle() const;
 
 private:
-    std::unique_ptr<GPUCache> l1_cache_;
-    std::unique_ptr<GPUCache> l2_cache_;
-    std::vector<uint8_t> vram_;
+    // Cache levels, index 0 is L1
+    std::vector<CacheLevel> cache_levels_;
+    VRAMStore vram_;
+    
+    WritePolicy write_policy_;
+    bool write_allocate_;
+    
+    // Timing model
+    std::vector<uint32_t> level_latencies_;
+    uint32_t vram_latency_;
+    uint32_t vram_bytes_per_cycle_;
+    uint64_t current_cycle_;
+    uint64_t vram_busy_until_;
+    uint64_t vram_queue_cycles_;
+    std::vector<LatencyHistogram> level_histograms_;
+    LatencyHistogram vram_histogram_;
+    
+    // VRAM traffic
+    uint64_t vram_reads_;
+    uint64_t vram_writes_;
+    uint64_t vram_bytes_read_;
+    uint64_t vram_bytes_written_;
+    
+    BuddyAllocator allocator_;
+    
+    // A contiguous piece of a batched request that falls within one L1 line
+    struct LineSegment {
+        uint64_t line_address;
+        size_t line_offset;
+        size_t size;
+        size_t request_offset;
+        size_t request_index;
+    };
+    std::vector<LineSegment> batch_segments_;
+    
+    // Serializes public entry points; shader cores issue LOAD/STORE from
+    // dispatch worker threads
+    mutable std::mutex mutex_;
     
-    uint64_t next_allocation_address_;
-    std::unordered_map<uint64_t, size_t> allocations_;
+    // Level-by-level access; level 0 is L1, past the last cache is VRAM
+    size_t get_line_size(size_t level) const;
+    uint8_t* lookup_line(size_t level, uint64_t line_address, bool mark_dirty);
     
-    // Timing constants
-    static constexpr uint32_t L1_LATENCY = 1;
-    static constexpr uint32_t L2_LATENCY = 10;
-    static constexpr uint32_t VRAM_LATENCY = 100;
+    // Timed helpers take the cycle a request is issued at and return (or
+    // update `cycle` to) the cycle its data is available
+    uint8_t* fill_line(size_t level, uint64_t line_address, bool fetch, bool mark_dirty,
+                       uint64_t& cycle);
+    uint8_t* acquire_line(size_t level, uint64_t line_address, uint64_t& cycle);
+    uint64_t read_through(size_t level, uint64_t address, uint8_t* data, size_t size,
+                          uint64_t cycle);
+    uint64_t write_level(size_t level, uint64_t address, const uint8_t* data, size_t size,
+                         uint64_t cycle);
+    uint64_t schedule_vram(uint64_t cycle, size_t size);
+    uint64_t begin_access(const MemoryTiming* timing) const;
+    void end_access(MemoryTiming* timing, uint64_t issue_cycle, uint64_t completion_cycle);
+    template <typename Request>
+    bool build_line_segments(const std::vector<Request>& requests);
 };
 
 } // namespace gpu_sim
\ No newline at end of file
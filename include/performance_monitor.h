@@ -5,36 +5,213 @@
 #include <unordered_map>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <atomic>
+#include <thread>
 #include <cstdint>
 
 namespace gpu_sim {
 
 /**
- * Performance monitoring and profiling system
+ * Fixed-capacity sample history. Pushing is O(1) and overwrites the oldest
+ * sample once the ring is full.
+ */
+template <typename T>
+class HistoryRing {
+public:
+    explicit HistoryRing(size_t capacity) : samples_(capacity > 0 ? capacity : 1), next_(0), size_(0) {}
+    
+    void push(const T& sample) {
+        samples_[next_] = sample;
+        next_ = (next_ + 1) % samples_.size();
+        size_ = size_ < samples_.size() ? size_ + 1 : size_;
+    }
+    void clear() { next_ = 0; size_ = 0; }
+    
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const T& newest() const { return samples_[(next_ + samples_.size() - 1) % samples_.size()]; }
+    
+    // Visits the samples oldest first
+    template <typename Visitor>
+    void for_each(Visitor visit) const {
+        size_t index = (next_ + samples_.size() - size_) % samples_.size();
+        for (size_t i = 0; i < size_; ++i) {
+            visit(samples_[index]);
+            index = (index + 1) % samples_.size();
+        }
+    }
+
+private:
+    std::vector<T> samples_;
+    size_t next_;
+    size_t size_;
+};
+
+/**
+ * Streaming quantile sketch for latencies, in the style of an HDR histogram:
+ * buckets grow geometrically by BUCKET_GROWTH, so any quantile is within
+ * about 1% of the true sample value at constant memory and O(1) insert.
+ */
+class QuantileSketch {
+public:
+    QuantileSketch();
+    
+    void record(double value_ms);
+    void clear();
+    
+    // Value at quantile q in [0, 1]; 0 when nothing was recorded
+    double quantile(double q) const;
+    uint64_t count() const { return count_; }
+
+private:
+    static constexpr double MIN_VALUE_MS = 1e-3;  // Smaller samples share the first bucket
+    static constexpr double BUCKET_GROWTH = 1.02;
+    static const double LOG_BUCKET_GROWTH;        // log(BUCKET_GROWTH)
+    static constexpr size_t BUCKET_COUNT = 1024;  // Tops out around 10 minutes
+    
+    std::vector<uint64_t> buckets_;
+    uint64_t count_;
+    double min_ms_;
+    double max_ms_;
+};
+
+/**
+ * Performance monitoring and profiling system. All public methods are safe to
+ * call concurrently from dispatch worker threads.
+ *
+ * Hot paths register their counters, caches and timers once and pass the
+ * returned handles; the string overloads look the name up on every call.
+ * Counters live in per-thread slots, so incrementing one takes no lock and
+ * shares no cache line with another thread.
  */
 class PerformanceMonitor {
 public:
+    using CounterId = uint32_t;
+    using TimerId = uint32_t;
+    struct CacheId {
+        CounterId hits;
+        CounterId misses;
+    };
+    
     PerformanceMonitor();
-    ~PerformanceMonitor() = default;
+    ~PerformanceMonitor();
 
-    // Timing measurements
+    // Registration returns the existing handle for a known name. Handles
+    // stay valid for the monitor's lifetime, across reset_all_metrics.
+    CounterId register_counter(const std::string& counter);
+    CacheId register_cache(const std::string& cache);
+    TimerId register_timer(const std::string& event);
+
+    // Timing measurements. Starts and ends pair up like brackets, so a timer
+    // may be started again before it ends.
+    void start_timer(TimerId event);
+    void end_timer(TimerId event);
     void start_timer(const std::string& event);
     void end_timer(const std::string& event);
     double get_elapsed_time_ms(const std::string& event) const;
     
+    // Hierarchical profiling: ScopedTimer scopes nest per thread into a call
+    // tree, merged across threads by call path. Scopes are live while
+    // profiling or tracing is enabled; otherwise a scope costs two flag tests.
+    void enable_profiling(bool enable) { profiling_enabled_.store(enable, std::memory_order_relaxed); }
+    bool is_profiling_enabled() const { return profiling_enabled_.load(std::memory_order_relaxed); }
+    
+    // Timeline tracing to a Chrome trace JSON file that loads in Perfetto or
+    // chrome://tracing. Scopes become spans; trace_span and trace_instant add
+    // events directly. Each thread records into its own lock-free ring that
+    // a background writer drains to disk. Events past max_events, or past a
+    // full ring, are dropped and counted.
+    bool start_trace(const std::string& path, size_t max_events = DEFAULT_TRACE_EVENT_LIMIT);
+    void stop_trace();
+    bool is_tracing() const { return tracing_.load(std::memory_order_relaxed); }
+    
+    // gpu_core places the span on that shader core's track instead of the
+    // calling thread's
+    void trace_span(TimerId event, std::chrono::high_resolution_clock::time_point start,
+                    std::chrono::high_resolution_clock::time_point end, int32_t gpu_core = -1);
+    void trace_instant(TimerId event, uint64_t value = 0);
+    
+    struct TraceStats {
+        uint64_t events_written;
+        uint64_t events_dropped;
+    };
+    TraceStats get_trace_stats() const;
+    
+    static constexpr size_t DEFAULT_TRACE_EVENT_LIMIT = 1000000;
+    
+    // A recording scope also adds its duration to the timer's history, as a
+    // start_timer/end_timer pair would, and is live whenever there is a
+    // monitor; the span is measured once for both.
+    class ScopedTimer {
+    public:
+        ScopedTimer(PerformanceMonitor* monitor, TimerId timer, bool record_timer = false)
+            : monitor_(monitor && (record_timer || monitor->is_profiling_enabled() || monitor->is_tracing())
+                           ? monitor : nullptr),
+              timer_(timer), node_(NO_PARENT), record_timer_(record_timer) {
+            if (!monitor_) return;
+            if (monitor_->is_profiling_enabled() || monitor_->is_tracing()) {
+                node_ = monitor_->enter_scope(timer, start_time_);
+            } else {
+                start_time_ = std::chrono::high_resolution_clock::now();
+            }
+        }
+        ~ScopedTimer() {
+            if (!monitor_) return;
+            auto end_time = std::chrono::high_resolution_clock::now();
+            if (node_ != NO_PARENT) {
+                monitor_->exit_scope(node_, start_time_, end_time);
+            }
+            if (record_timer_) {
+                monitor_->record_timer(timer_, std::chrono::duration<double, std::milli>(end_time - start_time_).count());
+            }
+        }
+        
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+        
+    private:
+        PerformanceMonitor* monitor_;
+        TimerId timer_;
+        uint32_t node_;  // NO_PARENT when the scope is not in the call tree
+        bool record_timer_;
+        std::chrono::high_resolution_clock::time_point start_time_;
+    };
+    
     // Counter management
+    void increment_counter(CounterId counter, uint64_t value = 1);
+    void set_counter(CounterId counter, uint64_t value);
+    uint64_t get_counter(CounterId counter) const;
     void increment_counter(const std::string& counter, uint64_t value = 1);
     void set_counter(const std::string& counter, uint64_t value);
     uint64_t get_counter(const std::string& counter) const;
     
     // Performance metrics
     void record_bandwidth_usage(const std::string& component, uint64_t bytes);
+    void record_cache_access(CacheId cache, bool hit);
     void record_cache_access(const std::string& cache, bool hit);
     void record_frame_metrics(double frame_time_ms, uint32_t triangles, uint32_t fragments);
     
     // Reporting
+    struct LatencyPercentiles {
+        double p50_ms;
+        double p95_ms;
+        double p99_ms;
+    };
+    
+    struct ProfileEntry {
+        std::string path;   // Scope names from the root, joined by '/'
+        uint32_t depth;     // 0 for root scopes
+        uint64_t calls;
+        double total_ms;    // Summed over threads, so parallel scopes can exceed wall time
+        double self_ms;     // total_ms minus time spent in child scopes
+    };
+    
     struct PerformanceReport {
-        std::unordered_map<std::string, double> timing_data;
+        std::unordered_map<std::string, double> timing_data;  // Average over the recent history
+        std::unordered_map<std::string, LatencyPercentiles> timing_percentiles;  // Since the last reset
         std::unordered_map<std::string, uint64_t> counter_data;
         std::unordered_map<std::string, double> bandwidth_data;
         std::unordered_map<std::string, double> cache_hit_rates;
@@ -42,9 +219,12 @@ public:
         double avg_frame_time_ms;
         double min_frame_time_ms;
         double max_frame_time_ms;
+        LatencyPercentiles frame_time_percentiles;  // Since the last reset
         uint64_t total_triangles;
         uint64_t total_fragments;
         
+        std::vector<ProfileEntry> call_tree;  // Depth-first, since the last reset
+        
         // Efficiency metrics
         double memory_efficiency;
         double cache_efficiency;
@@ -64,36 +244,143 @@ public:
     std::vector<std::string> check_performance_alerts() const;
 
 private:
-    // Timing data
-    std::unordered_map<std::string, std::chrono::high_resolution_clock::time_point> start_times_;
-    std::unordered_map<std::string, std::vector<double>> timing_history_;
+    static constexpr size_t COUNTER_SLOTS = 256;  // Per-thread slots; later counters take the locked path
+    static constexpr size_t CACHE_LINE_BYTES = 64;
+    static constexpr size_t DEFAULT_HISTORY_SIZE = 1000;
+    
+    // One thread's counter values, written only by that thread
+    struct alignas(CACHE_LINE_BYTES) ThreadCounters {
+        std::atomic<uint64_t> values[COUNTER_SLOTS];
+        
+        ThreadCounters() {
+            for (auto& value : values) {
+                value.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
     
-    // Counters
-    std::unordered_map<std::string, uint64_t> counters_;
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
+    
+    // One thread's call tree; nodes are created before their children
+    struct ProfileNode {
+        TimerId timer;
+        uint32_t parent;
+        uint64_t calls = 0;
+        double total_ms = 0.0;
+        double child_ms = 0.0;
+    };
+    struct ThreadProfile {
+        std::mutex mutex;  // Taken by the owning thread and by report readers
+        std::vector<ProfileNode> nodes;
+        std::unordered_map<uint64_t, uint32_t> node_index;  // (parent, timer) -> node
+        std::vector<uint32_t> open_scopes;
+    };
+    
+    static constexpr size_t TRACE_BUFFER_EVENTS = 4096;  // Per thread
+    static constexpr uint32_t TRACE_FLUSH_INTERVAL_MS = 10;
+    
+    struct TraceEvent {
+        uint64_t timestamp_ns;  // Since the trace started
+        uint64_t duration_ns;   // Spans only
+        uint64_t value;         // Instants only
+        TimerId name;
+        int32_t gpu_core;       // -1 for the recording thread's track
+        char phase;             // 'X' for spans, 'i' for instants
+    };
+    
+    // Single-producer ring: the owning thread advances head, the trace
+    // writer advances tail
+    struct TraceBuffer {
+        std::unique_ptr<TraceEvent[]> events;  // Allocated once tracing is first started
+        std::atomic<size_t> head{0};
+        std::atomic<size_t> tail{0};
+    };
+    
+    struct ThreadState {
+        ThreadCounters counters;
+        ThreadProfile profile;
+        TraceBuffer trace;
+        uint32_t thread_index = 0;  // Trace track of this thread
+    };
+    
+    // Timing data, indexed by TimerId
+    std::unordered_map<std::string, TimerId> timer_ids_;
+    std::vector<std::string> timer_names_;
+    struct TimerState {
+        std::vector<std::chrono::high_resolution_clock::time_point> start_times;  // Innermost last
+        HistoryRing<double> history;
+        QuantileSketch latency;
+        
+        explicit TimerState(size_t history_size) : history(history_size) {}
+    };
+    std::vector<TimerState> timers_;
+    
+    // Counters, indexed by CounterId. A counter's value is its base plus the
+    // sum of every thread's slot; set and reset rewrite only the base.
+    std::unordered_map<std::string, CounterId> counter_ids_;
+    std::vector<std::string> counter_names_;  // Empty for cache hit/miss slots
+    std::vector<uint64_t> counter_bases_;
+    std::unordered_map<std::thread::id, std::unique_ptr<ThreadState>> thread_states_;
+    const uint64_t instance_id_;  // Never reused, unlike the monitor's address
     
     // Bandwidth tracking
     std::unordered_map<std::string, uint64_t> bandwidth_bytes_;
     std::unordered_map<std::string, std::chrono::high_resolution_clock::time_point> bandwidth_start_times_;
     
     // Cache statistics
-    std::unordered_map<std::string, uint64_t> cache_hits_;
-    std::unordered_map<std::string, uint64_t> cache_misses_;
+    std::unordered_map<std::string, CacheId> cache_ids_;
     
     // Frame metrics
-    std::vector<double> frame_times_;
-    std::vector<uint32_t> triangle_counts_;
-    std::vector<uint32_t> fragment_counts_;
+    struct FrameSample {
+        double frame_time_ms = 0.0;
+        uint32_t triangles = 0;
+        uint32_t fragments = 0;
+    };
+    HistoryRing<FrameSample> frame_history_;
+    QuantileSketch frame_latency_;
     
     // Performance thresholds
     std::unordered_map<std::string, double> performance_thresholds_;
     
+    // Tracing. The writer thread and trace_file_ are controlled under
+    // trace_mutex_; event recording takes no lock.
+    std::atomic<bool> tracing_;
+    std::chrono::high_resolution_clock::time_point trace_start_;
+    size_t trace_event_limit_;
+    std::atomic<uint64_t> trace_events_accepted_;
+    std::atomic<uint64_t> trace_events_written_;
+    std::atomic<uint64_t> trace_events_dropped_;
+    std::mutex trace_mutex_;
+    std::condition_variable trace_wake_;
+    bool trace_stopping_;
+    std::ofstream trace_file_;
+    std::thread trace_writer_;
+    
     // Configuration
+    std::atomic<bool> profiling_enabled_;
     bool real_time_monitoring_;
     size_t max_history_size_;
     
+    // Guards every container above
+    mutable std::mutex mutex_;
+    
     // Helper functions
-    double calculate_average(const std::vector<double>& values) const;
-    double calculate_variance(const std::vector<double>& values) const;
+    ThreadState& local_state();
+    void record_trace_event(const TraceEvent& event);
+    void trace_writer_loop();
+    void drain_trace_buffers(std::vector<std::string>& names);
+    uint32_t enter_scope(TimerId timer, std::chrono::high_resolution_clock::time_point& start_time);
+    void exit_scope(uint32_t node, std::chrono::high_resolution_clock::time_point start_time,
+                    std::chrono::high_resolution_clock::time_point end_time);
+    // Adds one measured duration to a timer's history and percentiles
+    void record_timer(TimerId event, double duration_ms);
+    CounterId allocate_counter(const std::string& name);
+    uint64_t counter_value(CounterId counter) const;  // Caller holds mutex_
+    uint64_t cache_hits(const CacheId& cache) const { return counter_value(cache.hits); }
+    uint64_t cache_misses(const CacheId& cache) const { return counter_value(cache.misses); }
+    double calculate_average(const HistoryRing<double>& values) const;
+    double calculate_variance(const HistoryRing<double>& values) const;
+    static LatencyPercentiles percentiles(const QuantileSketch& histogram);
     double calculate_bandwidth_mbps(const std::string& component) const;
 };
 
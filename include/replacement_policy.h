@@ -0,0 +1,191 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace gpu_sim {
+
+/**
+ * Cache replacement policies for GPUCache<Policy>.
+ *
+ * Each policy keeps its own per-set state and is called statically by the
+ * cache: on_hit() when a resident way is accessed, on_fill() when a way is
+ * (re)filled, and select_victim() when every way of a set is valid. Invalid
+ * ways are always filled first by the cache itself.
+ */
+
+// Small deterministic PRNG so policy sweeps are reproducible run to run
+inline uint32_t xorshift32(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/**
+ * True LRU using per-way access stamps
+ */
+class LRUPolicy {
+public:
+    void initialize(size_t num_sets, size_t associativity) {
+        associativity_ = associativity;
+        stamps_.assign(num_sets * associativity, 0);
+        clock_ = 0;
+    }
+
+    void on_hit(size_t set, size_t way) { stamps_[set * associativity_ + way] = ++clock_; }
+    void on_fill(size_t set, size_t way) { on_hit(set, way); }
+
+    size_t select_victim(size_t set) const {
+        size_t base = set * associativity_;
+        size_t victim = 0;
+        for (size_t way = 1; way < associativity_; ++way) {
+            if (stamps_[base + way] < stamps_[base + victim]) {
+                victim = way;
+            }
+        }
+        return victim;
+    }
+
+private:
+    size_t associativity_ = 0;
+    std::vector<uint64_t> stamps_;
+    uint64_t clock_ = 0;
+};
+
+/**
+ * Tree pseudo-LRU: one bit per internal node of a binary tree over the ways,
+ * each pointing toward the less recently used half. Associativity should be
+ * a power of two no greater than 64.
+ */
+class TreePLRUPolicy {
+public:
+    void initialize(size_t num_sets, size_t associativity) {
+        associativity_ = associativity;
+        levels_ = 0;
+        while ((static_cast<size_t>(1) << levels_) < associativity) {
+            levels_++;
+        }
+        tree_bits_.assign(num_sets, 0);
+    }
+
+    void on_hit(size_t set, size_t way) {
+        uint64_t& bits = tree_bits_[set];
+        size_t node = 1;
+        for (size_t level = 0; level < levels_; ++level) {
+            size_t branch = (way >> (levels_ - 1 - level)) & 1;
+            // Point the node away from the branch just used
+            if (branch) {
+                bits &= ~(1ULL << node);
+            } else {
+                bits |= (1ULL << node);
+            }
+            node = 2 * node + branch;
+        }
+    }
+
+    void on_fill(size_t set, size_t way) { on_hit(set, way); }
+
+    size_t select_victim(size_t set) const {
+        uint64_t bits = tree_bits_[set];
+        size_t node = 1;
+        for (size_t level = 0; level < levels_; ++level) {
+            node = 2 * node + ((bits >> node) & 1);
+        }
+        return (node - (static_cast<size_t>(1) << levels_)) % associativity_;
+    }
+
+private:
+    size_t associativity_ = 0;
+    size_t levels_ = 0;
+    std::vector<uint64_t> tree_bits_;
+};
+
+/**
+ * Re-reference interval prediction (Jaleel et al.) with 2-bit RRPVs.
+ * Static RRIP inserts lines with a long re-reference interval; bimodal RRIP
+ * inserts at the distant interval except for an occasional long insertion,
+ * which makes it resistant to thrashing.
+ */
+template <bool Bimodal>
+class RRIPPolicy {
+public:
+    void initialize(size_t num_sets, size_t associativity) {
+        associativity_ = associativity;
+        rrpv_.assign(num_sets * associativity, MAX_RRPV);
+        rng_state_ = RNG_SEED;
+    }
+
+    void on_hit(size_t set, size_t way) { rrpv_[set * associativity_ + way] = 0; }
+
+    void on_fill(size_t set, size_t way) {
+        uint8_t insertion = MAX_RRPV - 1;
+        if (Bimodal && (xorshift32(rng_state_) % BIMODAL_THROTTLE) != 0) {
+            insertion = MAX_RRPV;
+        }
+        rrpv_[set * associativity_ + way] = insertion;
+    }
+
+    size_t select_victim(size_t set) {
+        uint8_t* rrpv = rrpv_.data() + set * associativity_;
+        for (;;) {
+            for (size_t way = 0; way < associativity_; ++way) {
+                if (rrpv[way] == MAX_RRPV) {
+                    return way;
+                }
+            }
+            // No distant line: age the whole set and retry
+            for (size_t way = 0; way < associativity_; ++way) {
+                rrpv[way]++;
+            }
+        }
+    }
+
+private:
+    static constexpr uint8_t MAX_RRPV = 3;
+    static constexpr uint32_t BIMODAL_THROTTLE = 32;
+    static constexpr uint32_t RNG_SEED = 0x9E3779B9u;
+
+    size_t associativity_ = 0;
+    std::vector<uint8_t> rrpv_;
+    uint32_t rng_state_ = RNG_SEED;
+};
+
+using SRRIPPolicy = RRIPPolicy<false>;
+using BRRIPPolicy = RRIPPolicy<true>;
+
+/**
+ * Uniform random replacement
+ */
+class RandomPolicy {
+public:
+    void initialize(size_t /*num_sets*/, size_t associativity) {
+        associativity_ = associativity;
+        rng_state_ = RNG_SEED;
+    }
+
+    void on_hit(size_t /*set*/, size_t /*way*/) {}
+    void on_fill(size_t /*set*/, size_t /*way*/) {}
+
+    size_t select_victim(size_t /*set*/) { return xorshift32(rng_state_) % associativity_; }
+
+private:
+    static constexpr uint32_t RNG_SEED = 0x2545F491u;
+
+    size_t associativity_ = 0;
+    uint32_t rng_state_ = RNG_SEED;
+};
+
+/**
+ * Runtime selector used by MemoryConfig to pick a policy per cache level
+ */
+enum class ReplacementPolicy {
+    LRU,
+    TREE_PLRU,
+    SRRIP,
+    BRRIP,
+    RANDOM
+};
+
+} // namespace gpu_sim
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace gpu_sim {
+
+/**
+ * Minimal 4-wide float vector used by the pipeline's per-pixel loops.
+ * Maps to SSE2 or NEON where available and to plain arrays otherwise.
+ * Comparisons return a 4-bit lane mask (bit i set for lane i).
+ */
+struct Float4 {
+#if defined(__SSE2__)
+    __m128 v;
+
+    static Float4 splat(float x) { return {_mm_set1_ps(x)}; }
+    static Float4 set(float a, float b, float c, float d) { return {_mm_setr_ps(a, b, c, d)}; }
+    static Float4 load(const float* p) { return {_mm_loadu_ps(p)}; }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+    // Truncates toward zero; lanes must be in int32 range
+    void store_int(int32_t* p) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_cvttps_epi32(v)); }
+
+    friend Float4 operator+(Float4 a, Float4 b) { return {_mm_add_ps(a.v, b.v)}; }
+    friend Float4 operator-(Float4 a, Float4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+    friend Float4 operator*(Float4 a, Float4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+
+    static Float4 min(Float4 a, Float4 b) { return {_mm_min_ps(a.v, b.v)}; }
+    static Float4 max(Float4 a, Float4 b) { return {_mm_max_ps(a.v, b.v)}; }
+
+    static uint32_t greater(Float4 a, Float4 b) {
+        return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpgt_ps(a.v, b.v)));
+    }
+    static uint32_t greater_equal(Float4 a, Float4 b) {
+        return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpge_ps(a.v, b.v)));
+    }
+#elif defined(__ARM_NEON)
+    float32x4_t v;
+
+    static Float4 splat(float x) { return {vdupq_n_f32(x)}; }
+    static Float4 set(float a, float b, float c, float d) {
+        const float lanes[4] = {a, b, c, d};
+        return {vld1q_f32(lanes)};
+    }
+    static Float4 load(const float* p) { return {vld1q_f32(p)}; }
+    void store(float* p) const { vst1q_f32(p, v); }
+    void store_int(int32_t* p) const { vst1q_s32(p, vcvtq_s32_f32(v)); }
+
+    friend Float4 operator+(Float4 a, Float4 b) { return {vaddq_f32(a.v, b.v)}; }
+    friend Float4 operator-(Float4 a, Float4 b) { return {vsubq_f32(a.v, b.v)}; }
+    friend Float4 operator*(Float4 a, Float4 b) { return {vmulq_f32(a.v, b.v)}; }
+
+    static Float4 min(Float4 a, Float4 b) { return {vminq_f32(a.v, b.v)}; }
+    static Float4 max(Float4 a, Float4 b) { return {vmaxq_f32(a.v, b.v)}; }
+
+    static uint32_t greater(Float4 a, Float4 b) { return lane_mask(vcgtq_f32(a.v, b.v)); }
+    static uint32_t greater_equal(Float4 a, Float4 b) { return lane_mask(vcgeq_f32(a.v, b.v)); }
+
+private:
+    static uint32_t lane_mask(uint32x4_t m) {
+        const uint32_t weights[4] = {1, 2, 4, 8};
+        return vaddvq_u32(vandq_u32(m, vld1q_u32(weights)));
+    }
+public:
+#else
+    float v[4];
+
+    static Float4 splat(float x) { return {{x, x, x, x}}; }
+    static Float4 set(float a, float b, float c, float d) { return {{a, b, c, d}}; }
+    static Float4 load(const float* p) { return {{p[0], p[1], p[2], p[3]}}; }
+    void store(float* p) const { for (int i = 0; i < 4; ++i) p[i] = v[i]; }
+    void store_int(int32_t* p) const { for (int i = 0; i < 4; ++i) p[i] = static_cast<int32_t>(v[i]); }
+
+    friend Float4 operator+(Float4 a, Float4 b) { return apply(a, b, [](float x, float y) { return x + y; }); }
+    friend Float4 operator-(Float4 a, Float4 b) { return apply(a, b, [](float x, float y) { return x - y; }); }
+    friend Float4 operator*(Float4 a, Float4 b) { return apply(a, b, [](float x, float y) { return x * y; }); }
+
+    static Float4 min(Float4 a, Float4 b) { return apply(a, b, [](float x, float y) { return y < x ? y : x; }); }
+    static Float4 max(Float4 a, Float4 b) { return apply(a, b, [](float x, float y) { return x < y ? y : x; }); }
+
+    static uint32_t greater(Float4 a, Float4 b) {
+        uint32_t mask = 0;
+        for (int i = 0; i < 4; ++i) mask |= (a.v[i] > b.v[i] ? 1u : 0u) << i;
+        return mask;
+    }
+    static uint32_t greater_equal(Float4 a, Float4 b) {
+        uint32_t mask = 0;
+        for (int i = 0; i < 4; ++i) mask |= (a.v[i] >= b.v[i] ? 1u : 0u) << i;
+        return mask;
+    }
+
+private:
+    template <typename Op>
+    static Float4 apply(Float4 a, Float4 b, Op op) {
+        return {{op(a.v[0], b.v[0]), op(a.v[1], b.v[1]), op(a.v[2], b.v[2]), op(a.v[3], b.v[3])}};
+    }
+public:
+#endif
+};
+
+} // namespace gpu_sim
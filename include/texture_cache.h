@@ -1,61 +1,151 @@
 #pragma once
 
 #include <unordered_map>
-#include <queue>
+#include <unordered_set>
+#include <deque>
 #include <vector>
 #include <memory>
 #include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <cstdint>
+#include "performance_monitor.h"
 
 namespace gpu_sim {
 
 // Forward declarations
 class MemoryHierarchy;
-class PerformanceMonitor;
+class CommandStreamWriter;
+struct Texture;
 
 /**
- * Texture cache entry with metadata for advanced caching strategies
+ * Non-owning view of RGBA8 texture data, laid out as Texture::data. Lets
+ * callers upload texels that live outside a Texture, such as a mapped file.
+ */
+struct TextureView {
+    uint32_t width = 0, height = 0;
+    uint32_t format = 0;
+    uint32_t mip_levels = 1;
+    const uint8_t* data = nullptr;
+    size_t size = 0;  // Bytes at data
+
+    static TextureView of(const Texture& texture);
+};
+
+/**
+ * Tiled RGBA8 texel layout. Each mip level is stored as 4x4 texel blocks in
+ * row-major block order, with texels Morton-ordered inside a block, so a
+ * block is one contiguous 64-byte fetch covering a 2D neighbourhood.
+ */
+struct TextureLayout {
+    static constexpr uint32_t BLOCK_DIM = 4;
+    static constexpr uint32_t TEXEL_BYTES = 4;
+    static constexpr uint32_t BLOCK_BYTES = BLOCK_DIM * BLOCK_DIM * TEXEL_BYTES;
+    
+    static uint32_t mip_dimension(uint32_t base, uint32_t level) {
+        uint32_t dimension = level < 32 ? base >> level : 0;
+        return dimension > 0 ? dimension : 1;
+    }
+    static uint32_t blocks_across(uint32_t dimension) {
+        return (dimension + BLOCK_DIM - 1) / BLOCK_DIM;
+    }
+    static uint64_t mip_size_bytes(uint32_t width, uint32_t height) {
+        return static_cast<uint64_t>(blocks_across(width)) * blocks_across(height) * BLOCK_BYTES;
+    }
+    // Interleaves the low 2 bits of x and y: x0 y0 x1 y1
+    static uint32_t morton_index(uint32_t x, uint32_t y) {
+        return (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+    }
+    // Byte offset of texel (x, y) within a mip level of the given width
+    static uint64_t texel_offset(uint32_t x, uint32_t y, uint32_t width) {
+        uint64_t block = static_cast<uint64_t>(y / BLOCK_DIM) * blocks_across(width) + x / BLOCK_DIM;
+        return block * BLOCK_BYTES + morton_index(x % BLOCK_DIM, y % BLOCK_DIM) * TEXEL_BYTES;
+    }
+};
+
+/**
+ * Texture cache entry: one texel block of one mip level, with metadata for
+ * advanced caching strategies
  */
 struct TextureCacheEntry {
     uint64_t texture_id;
     uint32_t mip_level;
-    uint64_t address;
-    std::vector<uint8_t> data;
-    uint64_t last_access_time;
+    uint64_t block_index;
+    uint64_t address;  // Block's address in the memory hierarchy
+    uint8_t data[TextureLayout::BLOCK_BYTES];
+    uint64_t last_access_time;  // Logical clock of the cache, not wall time
     uint32_t access_count;
-    float priority_score;
     bool is_prefetched;
     
-    TextureCacheEntry(uint64_t id, uint32_t mip, uint64_t addr, size_t size)
-        : texture_id(id), mip_level(mip), address(addr), data(size),
-          last_access_time(0), access_count(0), priority_score(0.0f),
-          is_prefetched(false) {}
+    // Segmented-LRU links, owned by TextureCache
+    TextureCacheEntry* prev;
+    TextureCacheEntry* next;
+    bool is_protected;
+    
+    TextureCacheEntry(uint64_t id, uint32_t mip, uint64_t block, uint64_t addr)
+        : texture_id(id), mip_level(mip), block_index(block), address(addr), data{},
+          last_access_time(0), access_count(0), is_prefetched(false),
+          prev(nullptr), next(nullptr), is_protected(false) {}
 };
 
 /**
  * Advanced texture cache with intelligent prefetching and performance optimization
  * This is the NEW FEATURE that improves graphics pipeline performance
+ *
+ * Public methods may be called from concurrent tile workers.
  */
 class TextureCache {
 public:
     explicit TextureCache(size_t cache_size_mb = 256);
-    ~TextureCache() = default;
+    ~TextureCache();
 
     // Initialization
     void initialize(std::shared_ptr<MemoryHierarchy> memory,
                    std::shared_ptr<PerformanceMonitor> perf_monitor);
 
-    // Texture operations
+    // Texture storage. Uploading copies texture's RGBA8 texels into the
+    // memory hierarchy in TextureLayout order, building the mip chain from
+    // level 0 when texture.data holds only that level. Textures that were
+    // never uploaded are backed by an untyped linear surface on first use.
+    bool upload_texture(uint64_t texture_id, const Texture& texture);
+    bool upload_texture(uint64_t texture_id, const TextureView& texture);
+    
+    // Texture registry: uploads texture under a fresh id that is never
+    // reused, so a changed texture can never hit another's cached blocks.
+    // Registered ids start at FIRST_REGISTERED_TEXTURE_ID, leaving smaller
+    // ids to callers that pick their own. Returns 0 on failure; release
+    // with invalidate_texture.
+    uint64_t register_texture(const Texture& texture);
+    uint64_t register_texture(const TextureView& texture);
+    bool get_texture_size(uint64_t texture_id, uint32_t& width, uint32_t& height) const;
+    
+    static constexpr uint64_t FIRST_REGISTERED_TEXTURE_ID = 1ull << 40;
+    
+    // Texture operations. Reads fetch only the texel blocks they touch.
+    // read_texture offsets address a mip level as a linear row-major RGBA8
+    // image (or raw bytes for untyped surfaces); read_texel needs an
+    // uploaded texture and returns one RGBA8 texel.
     bool read_texture(uint64_t texture_id, uint32_t mip_level, 
                      uint64_t offset, void* data, size_t size);
+    bool read_texel(uint64_t texture_id, uint32_t mip_level,
+                    uint32_t x, uint32_t y, void* texel);
     
+    // Queues a prefetch of the level's leading blocks and returns at once; a
+    // background worker fetches them while the caller keeps shading.
+    // Requests already pending are dropped, as are requests beyond the
+    // bounded queue depth.
     void prefetch_texture(uint64_t texture_id, uint32_t mip_level);
+    void wait_for_prefetches();
     void invalidate_texture(uint64_t texture_id);
     
     // Advanced features
     void enable_smart_prefetching(bool enable) { smart_prefetching_enabled_ = enable; }
     void enable_adaptive_caching(bool enable) { adaptive_caching_enabled_ = enable; }
-    void set_prefetch_distance(uint32_t distance) { prefetch_distance_ = distance; }
+    void set_prefetch_distance(uint32_t distance) { prefetch_distance_ = distance; }  // In blocks
+    
+    // Records uploads and invalidations into a command stream; null stops
+    void set_command_capture(std::shared_ptr<CommandStreamWriter> capture);
 
     // Cache management
     void flush();
@@ -65,11 +155,12 @@ public:
     struct CacheMetrics {
         uint64_t cache_hits;
         uint64_t cache_misses;
-        uint64_t prefetch_hits;
-        uint64_t prefetch_misses;
+        uint64_t prefetch_hits;    // Prefetched blocks later used on demand
+        uint64_t prefetch_misses;  // Prefetched blocks dropped before any use
         double hit_rate;
         double prefetch_efficiency;
         uint64_t bytes_transferred;
+        uint64_t evictions;
         double avg_access_latency_ms;
         uint32_t cache_utilization_percent;
     };
@@ -81,21 +172,84 @@ public:
     void tune_performance_parameters();
 
 private:
+    // Backing storage of one mip level in the memory hierarchy
+    struct TextureSurface {
+        uint64_t address = 0;   // 0 if the level does not exist yet
+        uint64_t size_bytes = 0;
+        uint32_t width = 0;     // Texel dimensions; 0 for untyped surfaces
+        uint32_t height = 0;
+        uint64_t generation = 0;  // Distinguishes re-created surfaces at reused addresses
+        
+        bool tiled() const { return width != 0; }
+    };
+    
+    struct BlockKey {
+        uint64_t texture_id;
+        uint32_t mip_level;
+        uint64_t block_index;
+        
+        bool operator==(const BlockKey& other) const {
+            return texture_id == other.texture_id && mip_level == other.mip_level &&
+                   block_index == other.block_index;
+        }
+    };
+    
+    struct BlockKeyHash {
+        size_t operator()(const BlockKey& key) const {
+            uint64_t h = key.texture_id * 0x9E3779B97F4A7C15ull;
+            h ^= (key.block_index + (static_cast<uint64_t>(key.mip_level) << 56)) + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2);
+            return static_cast<size_t>(h ^ (h >> 31));
+        }
+    };
+    
+    // Access pattern analysis: one ring-buffer record per sampled block
+    struct AccessPattern {
+        uint64_t texture_id;
+        uint32_t mip_level;
+        uint64_t block_index;
+        uint64_t timestamp;       // Logical clock of the cache
+        float spatial_locality;   // Share of recent block steps that moved to a neighbouring block
+        float temporal_locality;  // Share of recent samples that stayed in the previous block
+    };
+    
+    // Per-texture walk over block coordinates; untyped surfaces use row 0
+    struct AccessStream {
+        uint32_t mip_level = 0;
+        uint64_t block_index = 0;
+        int64_t block_x = 0;
+        int64_t block_y = 0;
+        int64_t stride_x = 0;     // Last block step
+        int64_t stride_y = 0;
+        uint32_t stride_repeats = 0;  // Consecutive steps equal to the stride
+        float spatial_locality = 0.0f;
+        float temporal_locality = 0.0f;
+    };
+    
     // Core cache functionality
-    TextureCacheEntry* find_entry(uint64_t texture_id, uint32_t mip_level);
-    TextureCacheEntry* allocate_entry(uint64_t texture_id, uint32_t mip_level, 
-                                     uint64_t address, size_t size);
+    const TextureSurface* find_surface(uint64_t texture_id, uint32_t mip_level, bool create);
+    TextureCacheEntry* fetch_block(uint64_t texture_id, uint32_t mip_level,
+                                   const TextureSurface& surface, uint64_t block_index);
+    bool read_surface_bytes(uint64_t texture_id, uint32_t mip_level, const TextureSurface& surface,
+                            uint64_t offset, uint8_t* data, size_t size);
+    TextureCacheEntry* find_entry(uint64_t texture_id, uint32_t mip_level, uint64_t block_index);
+    TextureCacheEntry* allocate_entry(uint64_t texture_id, uint32_t mip_level,
+                                      uint64_t block_index, uint64_t address);
     void evict_least_valuable_entry();
+    void remove_entry(TextureCacheEntry* entry);
+    void touch_entry(TextureCacheEntry* entry);
+    void release_surfaces(uint64_t texture_id);
     
     // Smart prefetching algorithms
-    void analyze_access_patterns();
+    bool enqueue_prefetch(uint64_t texture_id, uint32_t mip_level,
+                          uint64_t first_block, uint32_t block_count);
+    void prefetch_worker_loop();
+    void record_access(uint64_t texture_id, uint32_t mip_level,
+                       const TextureSurface& surface, uint64_t block_index);
+    void analyze_access_patterns(AccessStream& stream, const TextureSurface& surface, uint64_t block_index);
     void predict_future_accesses();
-    void schedule_prefetch_operations();
-    
-    // Cache optimization
-    void update_priority_scores();
-    void reorder_cache_entries();
-    float calculate_priority_score(const TextureCacheEntry& entry) const;
+    void schedule_prefetch_operations(uint64_t texture_id, const AccessStream& stream,
+                                      const TextureSurface& surface);
+    const AccessPattern& recent_access(size_t age) const;  // 0 is the newest record
     
     // Adaptive algorithms
     void adapt_cache_parameters();
@@ -104,10 +258,64 @@ private:
     // Memory and performance
     std::shared_ptr<MemoryHierarchy> memory_;
     std::shared_ptr<PerformanceMonitor> perf_monitor_;
+    std::shared_ptr<CommandStreamWriter> capture_;
+    
+    // Handles registered with perf_monitor_ by initialize
+    struct PerfIds {
+        PerformanceMonitor::CacheId cache_access{};
+        PerformanceMonitor::TimerId load_from_memory = 0;
+        PerformanceMonitor::CounterId bytes_read = 0;
+        PerformanceMonitor::CounterId prefetch_dropped = 0;
+        PerformanceMonitor::CounterId prefetch_operations = 0;
+        PerformanceMonitor::CounterId prefetched_blocks = 0;
+        PerformanceMonitor::CounterId predicted_prefetches = 0;
+        PerformanceMonitor::TimerId miss_event = 0;  // Trace events
+        PerformanceMonitor::TimerId prefetch_event = 0;
+        PerformanceMonitor::TimerId eviction_event = 0;
+    };
+    PerfIds perf_ids_;
+    
+    // Texture storage, per texture id indexed by mip level
+    std::unordered_map<uint64_t, std::vector<TextureSurface>> surfaces_;
+    uint64_t next_texture_id_;
+    uint64_t surface_generation_;
     
     // Cache storage
-    std::unordered_map<uint64_t, std::unique_ptr<TextureCacheEntry>> cache_entries_;
-    std::queue<uint64_t> prefetch_queue_;
+    std::unordered_map<BlockKey, std::unique_ptr<TextureCacheEntry>, BlockKeyHash> cache_entries_;
+    
+    /**
+     * Intrusive LRU list, head is most recent. Eviction is segmented LRU:
+     * blocks enter the probation segment and move to the protected segment
+     * on a repeat demand access, so one-touch scans cannot flush reused
+     * blocks. Prefetched blocks need one extra demand access to be
+     * protected. The protected segment holds up to eviction_threshold_ of
+     * the cache; its overflow is demoted back to probation.
+     */
+    struct EntryList {
+        TextureCacheEntry* head = nullptr;
+        TextureCacheEntry* tail = nullptr;
+        size_t size = 0;
+        
+        void push_front(TextureCacheEntry* entry);
+        void unlink(TextureCacheEntry* entry);
+    };
+    EntryList probation_;
+    EntryList protected_;
+    uint64_t access_clock_;
+    
+    // Prefetch engine: requests are deduplicated by their first block
+    struct PrefetchRequest {
+        uint64_t texture_id;
+        uint32_t mip_level;
+        uint64_t first_block;
+        uint32_t block_count;
+    };
+    std::deque<PrefetchRequest> prefetch_queue_;
+    std::unordered_set<BlockKey, BlockKeyHash> pending_prefetches_;
+    size_t prefetches_in_flight_;
+    bool prefetch_worker_stopping_;
+    std::condition_variable_any prefetch_work_;
+    std::condition_variable_any prefetch_idle_;
     
     // Configuration
     size_t max_cache_size_bytes_;
@@ -117,16 +325,11 @@ private:
     bool adaptive_caching_enabled_;
     
     // Access pattern analysis
-    struct AccessPattern {
-        uint64_t texture_id;
-        uint32_t mip_level;
-        uint64_t timestamp;
-        float spatial_locality;
-        float temporal_locality;
-    };
-    
-    std::vector<AccessPattern> recent_accesses_;
+    std::vector<AccessPattern> recent_accesses_;  // Ring buffer of max_pattern_history_ records
     size_t max_pattern_history_;
+    size_t history_next_;
+    size_t history_count_;
+    std::unordered_map<uint64_t, AccessStream> access_streams_;
     
     // Performance tracking
     mutable CacheMetrics metrics_;
@@ -137,11 +340,25 @@ private:
     float eviction_threshold_;
     uint32_t optimization_interval_ms_;
     
+    // Recursive: prefetching and tuning re-enter public entry points
+    mutable std::recursive_mutex mutex_;
+    
+    // Started last, once every member it reads is constructed
+    std::thread prefetch_worker_;
+    
     // Performance constants
     static constexpr float DEFAULT_PREFETCH_AGGRESSIVENESS = 0.7f;
     static constexpr float DEFAULT_EVICTION_THRESHOLD = 0.8f;
     static constexpr uint32_t DEFAULT_OPTIMIZATION_INTERVAL = 100;
     static constexpr size_t DEFAULT_PATTERN_HISTORY_SIZE = 1000;
+    static constexpr uint64_t UNTYPED_SURFACE_BYTES = 1024 * 1024;  // Backing for never-uploaded textures
+    static constexpr uint32_t MAX_MIP_LEVELS = 16;
+    static constexpr uint32_t DEFAULT_PREFETCH_DISTANCE = 16;  // Blocks per prefetch request
+    static constexpr size_t MAX_PREFETCH_QUEUE_DEPTH = 32;
+    static constexpr float LOCALITY_WEIGHT = 0.125f;          // Moving-average weight of one sample
+    static constexpr uint32_t STRIDE_CONFIRMATIONS = 2;       // Repeats before a stride is trusted
+    static constexpr uint32_t STRIDE_LOOKAHEAD_BLOCKS = 4;    // At full aggressiveness
+    static constexpr float NEIGHBOUR_LOCALITY_THRESHOLD = 0.5f;
 };
 
 } // namespace gpu_sim
\ No newline at end of file
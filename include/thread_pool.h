@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+namespace gpu_sim {
+
+/**
+ * Host thread pool with per-worker work-stealing deques. Workers pop their
+ * own deque from the back and steal from the front of other workers' deques.
+ * Deques keep their storage when drained, so steady-state submission does
+ * not allocate.
+ */
+class ThreadPool {
+public:
+    // 0 threads selects the host's hardware concurrency
+    explicit ThreadPool(size_t num_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Task submission; tasks are spread round-robin across worker deques
+    void submit(std::function<void()> task);
+
+    // Barrier: blocks until every submitted task has finished. Must not be
+    // called from a worker thread.
+    void wait_idle();
+
+    size_t get_thread_count() const { return workers_.size(); }
+
+private:
+    // Live tasks are tasks[head, size); both reset once the deque drains
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::vector<std::function<void()>> tasks;
+        size_t head = 0;
+        
+        bool empty() const { return head == tasks.size(); }
+        void reset_if_drained() {
+            if (empty()) {
+                tasks.clear();
+                head = 0;
+            }
+        }
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex state_mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable all_idle_;
+    size_t queued_tasks_;   // Submitted, not yet claimed by a worker (guarded by state_mutex_)
+    size_t pending_tasks_;  // Submitted, not yet finished (guarded by state_mutex_)
+    bool stopping_;
+
+    std::atomic<size_t> next_queue_;
+
+    void worker_loop(size_t index);
+    bool try_pop(size_t index, std::function<void()>& task);
+    bool try_steal(size_t thief, std::function<void()>& task);
+};
+
+} // namespace gpu_sim
@@ -0,0 +1,485 @@
+#include "command_stream.h"
+#include "gpu_core.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define GPU_SIM_HAS_MMAP 1
+#endif
+
+namespace gpu_sim {
+
+namespace {
+
+constexpr char STREAM_MAGIC[8] = {'G', 'P', 'U', 'C', 'M', 'D', 'S', '\0'};
+constexpr uint32_t STREAM_VERSION = 1;
+
+struct StreamHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vertex_bytes;  // sizeof(Vertex) of the capturing build
+};
+
+// Fixed parameters of each command, followed in the payload by its arrays
+struct PipelineStateParams {
+    uint32_t viewport_width;
+    uint32_t viewport_height;
+    uint32_t vertex_cache_size;
+    uint8_t depth_test_enabled;
+    uint8_t blending_enabled;
+    uint8_t culling_enabled;
+    uint8_t early_z_enabled;
+    uint8_t fragment_shader_writes_depth;
+    uint8_t depth_format;
+    uint8_t reserved[2];
+};
+
+struct TextureParams {  // Followed by data_bytes of texels
+    uint64_t texture_id;
+    uint32_t width, height;
+    uint32_t format;
+    uint32_t mip_levels;
+    uint64_t data_bytes;
+};
+
+struct TextureIdParams {
+    uint64_t texture_id;
+};
+
+struct BindTextureParams {
+    uint64_t texture_id;
+    uint32_t unit;
+    uint32_t reserved;
+};
+
+struct DrawParams {  // Followed by the vertices, then for indexed draws the indices
+    uint64_t vertex_count;
+    uint64_t index_count;
+};
+
+struct DispatchParams {  // Followed by the program words
+    uint32_t num_threads;
+    uint32_t program_words;
+};
+
+static_assert(sizeof(StreamHeader) % CommandStreamWriter::ALIGNMENT == 0, "header must keep commands aligned");
+static_assert(sizeof(CommandHeader) % CommandStreamWriter::ALIGNMENT == 0, "header must keep payloads aligned");
+
+size_t padded_size(size_t size) {
+    return (size + CommandStreamWriter::ALIGNMENT - 1) & ~(CommandStreamWriter::ALIGNMENT - 1);
+}
+
+/**
+ * Bounds-checked cursor over one command's payload. Arrays are returned
+ * as pointers into the stream itself.
+ */
+class PayloadCursor {
+public:
+    PayloadCursor(const uint8_t* data, size_t size) : data_(data), size_(size), offset_(0) {}
+
+    template <typename Params>
+    bool read_params(Params& params) {
+        if (sizeof(Params) > size_) return false;
+        memcpy(&params, data_, sizeof(Params));
+        offset_ = std::min(size_, padded_size(sizeof(Params)));
+        return true;
+    }
+
+    // Null if the payload holds fewer than count elements of Element
+    template <typename Element>
+    const Element* read_array(uint64_t count) {
+        if (count > (size_ - offset_) / sizeof(Element)) return nullptr;
+        const uint8_t* array = data_ + offset_;
+        offset_ = std::min(size_, offset_ + padded_size(static_cast<size_t>(count) * sizeof(Element)));
+        return reinterpret_cast<const Element*>(array);
+    }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t offset_;
+};
+
+} // namespace
+
+// CommandStreamWriter
+
+CommandStreamWriter::CommandStreamWriter() : command_count_(0), failed_(false) {}
+
+CommandStreamWriter::~CommandStreamWriter() {
+    close();
+}
+
+bool CommandStreamWriter::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_.is_open()) {
+        file_.close();
+    }
+
+    file_.clear();
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    command_count_ = 0;
+    failed_ = !file_.is_open();
+    if (failed_) {
+        return false;
+    }
+
+    StreamHeader header{};
+    memcpy(header.magic, STREAM_MAGIC, sizeof(STREAM_MAGIC));
+    header.version = STREAM_VERSION;
+    header.vertex_bytes = sizeof(Vertex);
+    file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    failed_ = !file_;
+    return !failed_;
+}
+
+void CommandStreamWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_.is_open()) {
+        file_.flush();
+        failed_ = failed_ || !file_;
+        file_.close();
+    }
+}
+
+bool CommandStreamWriter::is_open() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return file_.is_open();
+}
+
+bool CommandStreamWriter::good() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !failed_;
+}
+
+uint64_t CommandStreamWriter::get_command_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return command_count_;
+}
+
+void CommandStreamWriter::write_command(CommandType type, const void* params, size_t params_size,
+                                        std::initializer_list<Section> arrays) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_.is_open() || failed_) {
+        return;
+    }
+
+    CommandHeader header{};
+    header.type = static_cast<uint32_t>(type);
+    header.payload_bytes = padded_size(params_size);
+    for (const Section& array : arrays) {
+        header.payload_bytes += padded_size(array.size);
+    }
+
+    file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_padded(params, params_size);
+    for (const Section& array : arrays) {
+        write_padded(array.data, array.size);
+    }
+
+    command_count_++;
+    failed_ = !file_;
+}
+
+void CommandStreamWriter::write_padded(const void* data, size_t size) {
+    static const char zeros[ALIGNMENT] = {};
+    if (size > 0) {
+        file_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    }
+    file_.write(zeros, static_cast<std::streamsize>(padded_size(size) - size));
+}
+
+void CommandStreamWriter::record_set_pipeline_state(const PipelineState& state) {
+    PipelineStateParams params{};
+    params.viewport_width = state.viewport_width;
+    params.viewport_height = state.viewport_height;
+    params.vertex_cache_size = state.vertex_cache_size;
+    params.depth_test_enabled = state.depth_test_enabled;
+    params.blending_enabled = state.blending_enabled;
+    params.culling_enabled = state.culling_enabled;
+    params.early_z_enabled = state.early_z_enabled;
+    params.fragment_shader_writes_depth = state.fragment_shader_writes_depth;
+    params.depth_format = static_cast<uint8_t>(state.depth_format);
+    write_command(CommandType::SET_PIPELINE_STATE, &params, sizeof(params));
+}
+
+void CommandStreamWriter::record_upload_texture(uint64_t texture_id, const TextureView& texture) {
+    TextureParams params{};
+    params.texture_id = texture_id;
+    params.width = texture.width;
+    params.height = texture.height;
+    params.format = texture.format;
+    params.mip_levels = texture.mip_levels;
+    params.data_bytes = texture.size;
+    write_command(CommandType::UPLOAD_TEXTURE, &params, sizeof(params), {{texture.data, texture.size}});
+}
+
+void CommandStreamWriter::record_invalidate_texture(uint64_t texture_id) {
+    TextureIdParams params{texture_id};
+    write_command(CommandType::INVALIDATE_TEXTURE, &params, sizeof(params));
+}
+
+void CommandStreamWriter::record_bind_texture(uint32_t unit, uint64_t texture_id) {
+    BindTextureParams params{};
+    params.texture_id = texture_id;
+    params.unit = unit;
+    write_command(CommandType::BIND_TEXTURE, &params, sizeof(params));
+}
+
+void CommandStreamWriter::record_draw_triangles(const Vertex* vertices, size_t vertex_count) {
+    DrawParams params{vertex_count, 0};
+    write_command(CommandType::DRAW_TRIANGLES, &params, sizeof(params),
+                  {{vertices, vertex_count * sizeof(Vertex)}});
+}
+
+void CommandStreamWriter::record_draw_indexed(const Vertex* vertices, size_t vertex_count,
+                                              const uint32_t* indices, size_t index_count) {
+    DrawParams params{vertex_count, index_count};
+    write_command(CommandType::DRAW_INDEXED, &params, sizeof(params),
+                  {{vertices, vertex_count * sizeof(Vertex)}, {indices, index_count * sizeof(uint32_t)}});
+}
+
+void CommandStreamWriter::record_begin_frame() {
+    write_command(CommandType::BEGIN_FRAME, nullptr, 0);
+}
+
+void CommandStreamWriter::record_end_frame() {
+    write_command(CommandType::END_FRAME, nullptr, 0);
+}
+
+void CommandStreamWriter::record_present() {
+    write_command(CommandType::PRESENT, nullptr, 0);
+}
+
+void CommandStreamWriter::record_dispatch_compute(const std::vector<uint32_t>& program, uint32_t num_threads) {
+    DispatchParams params{num_threads, static_cast<uint32_t>(program.size())};
+    write_command(CommandType::DISPATCH_COMPUTE, &params, sizeof(params),
+                  {{program.data(), program.size() * sizeof(uint32_t)}});
+}
+
+void CommandStreamWriter::record_wait_for_completion() {
+    write_command(CommandType::WAIT_FOR_COMPLETION, nullptr, 0);
+}
+
+// CommandStreamReplayer
+
+CommandStreamReplayer::CommandStreamReplayer()
+    : data_(nullptr), size_(0), mapping_(nullptr), stats_{} {}
+
+CommandStreamReplayer::~CommandStreamReplayer() {
+    close();
+}
+
+bool CommandStreamReplayer::open(const std::string& path) {
+    close();
+
+#if defined(GPU_SIM_HAS_MMAP)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                mapping_ = mapping;
+                data_ = static_cast<const uint8_t*>(mapping);
+                size_ = static_cast<size_t>(info.st_size);
+            }
+        }
+        ::close(fd);
+    }
+#endif
+
+    // Read the stream into memory where it cannot be mapped
+    if (!data_) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            return false;
+        }
+        buffer_.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        if (buffer_.empty() || !file.read(reinterpret_cast<char*>(buffer_.data()),
+                                          static_cast<std::streamsize>(buffer_.size()))) {
+            buffer_.clear();
+            return false;
+        }
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+    }
+
+    StreamHeader header;
+    if (size_ < sizeof(header)) {
+        close();
+        return false;
+    }
+    memcpy(&header, data_, sizeof(header));
+    if (memcmp(header.magic, STREAM_MAGIC, sizeof(STREAM_MAGIC)) != 0 ||
+        header.version != STREAM_VERSION || header.vertex_bytes != sizeof(Vertex)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void CommandStreamReplayer::close() {
+#if defined(GPU_SIM_HAS_MMAP)
+    if (mapping_) {
+        munmap(mapping_, size_);
+    }
+#endif
+    mapping_ = nullptr;
+    buffer_.clear();
+    buffer_.shrink_to_fit();
+    data_ = nullptr;
+    size_ = 0;
+}
+
+bool CommandStreamReplayer::replay(const std::shared_ptr<GraphicsPipeline>& pipeline,
+                                   const std::shared_ptr<GPUCore>& gpu_core,
+                                   const std::shared_ptr<TextureCache>& texture_cache) {
+    stats_ = ReplayStats{};
+    if (!data_) {
+        return false;
+    }
+
+    bool ok = true;
+    size_t offset = sizeof(StreamHeader);
+    while (offset < size_) {
+        CommandHeader header;
+        if (size_ - offset < sizeof(header)) {
+            ok = false;
+            break;
+        }
+        memcpy(&header, data_ + offset, sizeof(header));
+        offset += sizeof(header);
+        if (header.payload_bytes > size_ - offset) {
+            ok = false;
+            break;
+        }
+
+        PayloadCursor payload(data_ + offset, static_cast<size_t>(header.payload_bytes));
+        offset += static_cast<size_t>(header.payload_bytes);
+        stats_.commands++;
+
+        switch (static_cast<CommandType>(header.type)) {
+            case CommandType::SET_PIPELINE_STATE: {
+                PipelineStateParams params;
+                if (!payload.read_params(params)) { ok = false; break; }
+                PipelineState state;
+                state.viewport_width = params.viewport_width;
+                state.viewport_height = params.viewport_height;
+                state.vertex_cache_size = params.vertex_cache_size;
+                state.depth_test_enabled = params.depth_test_enabled != 0;
+                state.blending_enabled = params.blending_enabled != 0;
+                state.culling_enabled = params.culling_enabled != 0;
+                state.early_z_enabled = params.early_z_enabled != 0;
+                state.fragment_shader_writes_depth = params.fragment_shader_writes_depth != 0;
+                if (params.depth_format <= static_cast<uint8_t>(DepthFormat::UNORM16)) {
+                    state.depth_format = static_cast<DepthFormat>(params.depth_format);
+                }
+                if (pipeline) pipeline->set_pipeline_state(state);
+                break;
+            }
+            case CommandType::UPLOAD_TEXTURE: {
+                TextureParams params;
+                const uint8_t* texels = nullptr;
+                if (!payload.read_params(params) || !(texels = payload.read_array<uint8_t>(params.data_bytes))) {
+                    ok = false;
+                    break;
+                }
+                TextureView view;
+                view.width = params.width;
+                view.height = params.height;
+                view.format = params.format;
+                view.mip_levels = params.mip_levels;
+                view.data = texels;
+                view.size = static_cast<size_t>(params.data_bytes);
+                if (texture_cache) {
+                    texture_cache->upload_texture(params.texture_id, view);
+                    stats_.texture_uploads++;
+                }
+                break;
+            }
+            case CommandType::INVALIDATE_TEXTURE: {
+                TextureIdParams params;
+                if (!payload.read_params(params)) { ok = false; break; }
+                if (texture_cache) texture_cache->invalidate_texture(params.texture_id);
+                break;
+            }
+            case CommandType::BIND_TEXTURE: {
+                BindTextureParams params;
+                if (!payload.read_params(params)) { ok = false; break; }
+                if (pipeline) pipeline->bind_texture(params.unit, params.texture_id);
+                break;
+            }
+            case CommandType::DRAW_TRIANGLES:
+            case CommandType::DRAW_INDEXED: {
+                bool indexed = static_cast<CommandType>(header.type) == CommandType::DRAW_INDEXED;
+                DrawParams params;
+                const Vertex* vertices = nullptr;
+                const uint32_t* indices = nullptr;
+                if (!payload.read_params(params) || !(vertices = payload.read_array<Vertex>(params.vertex_count)) ||
+                    (indexed && !(indices = payload.read_array<uint32_t>(params.index_count)))) {
+                    ok = false;
+                    break;
+                }
+                if (pipeline) {
+                    if (indexed) {
+                        pipeline->draw_indexed(vertices, static_cast<size_t>(params.vertex_count),
+                                               indices, static_cast<size_t>(params.index_count));
+                    } else {
+                        pipeline->draw_triangles(vertices, static_cast<size_t>(params.vertex_count));
+                    }
+                    stats_.draws++;
+                }
+                break;
+            }
+            case CommandType::BEGIN_FRAME:
+                if (pipeline) pipeline->begin_frame();
+                break;
+            case CommandType::END_FRAME:
+                if (pipeline) {
+                    pipeline->end_frame();
+                    stats_.frames++;
+                }
+                break;
+            case CommandType::PRESENT:
+                if (pipeline) pipeline->present();
+                break;
+            case CommandType::DISPATCH_COMPUTE: {
+                DispatchParams params;
+                const uint32_t* words = nullptr;
+                if (!payload.read_params(params) || !(words = payload.read_array<uint32_t>(params.program_words))) {
+                    ok = false;
+                    break;
+                }
+                if (gpu_core) {
+                    // Programs are decoded at dispatch, so the copy is per dispatch, not per thread
+                    gpu_core->dispatch_compute(std::vector<uint32_t>(words, words + params.program_words),
+                                               params.num_threads);
+                    stats_.dispatches++;
+                }
+                break;
+            }
+            case CommandType::WAIT_FOR_COMPLETION:
+                if (gpu_core) gpu_core->wait_for_completion();
+                break;
+            default:
+                // Unknown commands are skipped by their payload size
+                break;
+        }
+        if (!ok) {
+            break;
+        }
+    }
+
+    if (gpu_core) {
+        gpu_core->wait_for_completion();
+    }
+    return ok;
+}
+
+} // namespace gpu_sim
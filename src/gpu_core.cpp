@@ -1,57 +1,71 @@
 #include "gpu_core.h"
 #include "memory_hierarchy.h"
 #include "performance_monitor.h"
+#include "thread_pool.h"
+#include "command_stream.h"
 #include <algorithm>
-#include <thread>
+#include <bitset>
+#include <cstring>
 #include <iostream>
 
-namespace gpu_sim {
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
-// ShaderCore implementation
-ShaderCore::ShaderCore(uint32_t core_id)
-    : core_id_(core_id), busy_(false), instruction_count_(0), 
-      cycle_count_(0), registers_(32, 0.0f) {
-}
+namespace gpu_sim {
 
-void ShaderCore::execute_instruction(const std::vector<uint32_t>& instruction) {
-    if (instruction.empty()) return;
-    
-    busy_ = true;
+// Instruction decoding
+DecodedInstruction decode_instruction(const uint32_t* words, size_t count) {
+    DecodedInstruction decoded{DecodedOp::NOP, 0, 0, 0, 0};
+    if (count == 0) {
+        return decoded;
+    }
     
-    // Simulate instruction execution
-    uint32_t opcode = instruction[0];
+    auto valid_register = [](uint32_t reg) { return reg < ShaderCore::NUM_REGISTERS; };
     
-    switch (opcode) {
+    switch (words[0]) {
         case 0x01: // ADD
-            if (instruction.size() >= 4) {
-                uint32_t dst = instruction[1];
-                uint32_t src1 = instruction[2];
-                uint32_t src2 = instruction[3];
-                if (dst < registers_.size() && src1 < registers_.size() && src2 < registers_.size()) {
-                    registers_[dst] = registers_[src1] + registers_[src2];
-                }
+        case 0x02: // MUL
+            if (count >= 4 && valid_register(words[1]) && valid_register(words[2]) &&
+                valid_register(words[3])) {
+                decoded.op = (words[0] == 0x01) ? DecodedOp::ADD : DecodedOp::MUL;
+                decoded.dst = static_cast<uint8_t>(words[1]);
+                decoded.src0 = static_cast<uint8_t>(words[2]);
+                decoded.src1 = static_cast<uint8_t>(words[3]);
             }
             break;
             
-        case 0x02: // MUL
-            if (instruction.size() >= 4) {
-                uint32_t dst = instruction[1];
-                uint32_t src1 = instruction[2];
-                uint32_t src2 = instruction[3];
-                if (dst < registers_.size() && src1 < registers_.size() && src2 < registers_.size()) {
-                    registers_[dst] = registers_[src1] * registers_[src2];
-                }
+        case 0x03: // LOAD rd, [rs]
+            if (count >= 3 && valid_register(words[1]) && valid_register(words[2])) {
+                decoded.op = DecodedOp::LOAD;
+                decoded.dst = static_cast<uint8_t>(words[1]);
+                decoded.src0 = static_cast<uint8_t>(words[2]);
+            } else {
+                decoded.op = DecodedOp::STALL;
+                decoded.stall_cycles = 10;
             }
             break;
             
-        case 0x03: // LOAD
-            // Simulate memory load (would interact with memory hierarchy)
-            cycle_count_ += 10; // Memory access penalty
+        case 0x04: // STORE [rd], rs
+            if (count >= 3 && valid_register(words[1]) && valid_register(words[2])) {
+                decoded.op = DecodedOp::STORE;
+                decoded.src0 = static_cast<uint8_t>(words[1]);
+                decoded.src1 = static_cast<uint8_t>(words[2]);
+            } else {
+                decoded.op = DecodedOp::STALL;
+                decoded.stall_cycles = 5;
+            }
             break;
             
-        case 0x04: // STORE
-            // Simulate memory store
-            cycle_count_ += 5;
+        case 0x05: // TID rd
+            if (count >= 2 && valid_register(words[1])) {
+                decoded.op = DecodedOp::TID;
+                decoded.dst = static_cast<uint8_t>(words[1]);
+            }
             break;
             
         default:
@@ -59,14 +73,220 @@ void ShaderCore::execute_instruction(const std::vector<uint32_t>& instruction) {
             break;
     }
     
-    instruction_count_++;
-    cycle_count_++;
+    return decoded;
+}
+
+DecodedProgram decode_program(const std::vector<uint32_t>& program) {
+    DecodedProgram decoded;
+    decoded.code.reserve(program.size() / 4 + 2);
+    
+    for (size_t i = 0; i < program.size(); i += 4) {
+        decoded.code.push_back(decode_instruction(program.data() + i,
+                                                  std::min<size_t>(4, program.size() - i)));
+    }
+    decoded.instruction_count = static_cast<uint32_t>(decoded.code.size());
+    decoded.code.push_back({DecodedOp::END, 0, 0, 0, 0});
+    return decoded;
+}
+
+// Warp ALU helpers. Full warps take the SIMD path; partially active warps
+// fall back to a masked scalar loop.
+namespace {
+
+template <bool Multiply>
+void warp_alu(float* dst, const float* a, const float* b, uint32_t active_mask) {
+    constexpr uint32_t lanes = ShaderCore::WARP_SIZE;
+    
+    if (active_mask == ShaderCore::FULL_WARP_MASK) {
+#if defined(__AVX__)
+        for (uint32_t lane = 0; lane < lanes; lane += 8) {
+            __m256 x = _mm256_load_ps(a + lane);
+            __m256 y = _mm256_load_ps(b + lane);
+            _mm256_store_ps(dst + lane, Multiply ? _mm256_mul_ps(x, y) : _mm256_add_ps(x, y));
+        }
+#elif defined(__SSE2__)
+        for (uint32_t lane = 0; lane < lanes; lane += 4) {
+            __m128 x = _mm_load_ps(a + lane);
+            __m128 y = _mm_load_ps(b + lane);
+            _mm_store_ps(dst + lane, Multiply ? _mm_mul_ps(x, y) : _mm_add_ps(x, y));
+        }
+#elif defined(__ARM_NEON)
+        for (uint32_t lane = 0; lane < lanes; lane += 4) {
+            float32x4_t x = vld1q_f32(a + lane);
+            float32x4_t y = vld1q_f32(b + lane);
+            vst1q_f32(dst + lane, Multiply ? vmulq_f32(x, y) : vaddq_f32(x, y));
+        }
+#else
+        for (uint32_t lane = 0; lane < lanes; ++lane) {
+            dst[lane] = Multiply ? a[lane] * b[lane] : a[lane] + b[lane];
+        }
+#endif
+        return;
+    }
+    
+    for (uint32_t lane = 0; lane < lanes; ++lane) {
+        if (active_mask & (1u << lane)) {
+            dst[lane] = Multiply ? a[lane] * b[lane] : a[lane] + b[lane];
+        }
+    }
+}
+
+} // namespace
+
+// ShaderCore implementation
+ShaderCore::ShaderCore(uint32_t core_id)
+    : core_id_(core_id), busy_(false), instruction_count_(0), warp_instruction_count_(0),
+      warp_count_(0), cycle_count_(0), active_mask_(FULL_WARP_MASK), warp_base_thread_(0) {
+    std::memset(&registers_, 0, sizeof(registers_));
+    lane_reads_.reserve(WARP_SIZE);
+    lane_writes_.reserve(WARP_SIZE);
+}
+
+void ShaderCore::execute_instruction(const std::vector<uint32_t>& instruction) {
+    if (instruction.empty()) return;
+    
+    const DecodedInstruction code[2] = {
+        decode_instruction(instruction.data(), std::min<size_t>(4, instruction.size())),
+        {DecodedOp::END, 0, 0, 0, 0}
+    };
+    
+    std::lock_guard<std::mutex> lock(execution_mutex_);
+    busy_ = true;
+    active_mask_ = FULL_WARP_MASK;
+    run(code);
     busy_ = false;
 }
 
+void ShaderCore::execute_threads(const DecodedProgram& program, uint32_t num_threads,
+                                 uint32_t first_thread) {
+    std::lock_guard<std::mutex> lock(execution_mutex_);
+    busy_ = true;
+    
+    for (uint32_t warp_start = 0; warp_start < num_threads; warp_start += WARP_SIZE) {
+        uint32_t lanes = std::min(WARP_SIZE, num_threads - warp_start);
+        active_mask_ = (lanes == WARP_SIZE) ? FULL_WARP_MASK : ((1u << lanes) - 1);
+        warp_base_thread_ = first_thread + warp_start;
+        std::memset(&registers_, 0, sizeof(registers_));
+        
+        run(program.code.data());
+        warp_count_++;
+    }
+    
+    busy_ = false;
+}
+
+#if defined(__GNUC__)
+#define GPU_SIM_COMPUTED_GOTO 1
+#endif
+
+void ShaderCore::run(const DecodedInstruction* code) {
+    // Operands were validated by decode, and every warp instruction costs one
+    // issue cycle on top of any memory latency
+    auto& regs = registers_.lanes;
+    const uint32_t mask = active_mask_;
+    uint64_t cycles = cycle_count_;
+    uint64_t retired = 0;
+    const DecodedInstruction* ip = code;
+    MemoryTiming timing;
+    
+#if GPU_SIM_COMPUTED_GOTO
+    static const void* const dispatch_table[] = {
+        &&op_nop, &&op_add, &&op_mul, &&op_load, &&op_store, &&op_tid, &&op_stall, &&op_end
+    };
+#define GPU_SIM_DISPATCH() goto *dispatch_table[static_cast<size_t>(ip->op)]
+#define GPU_SIM_OP(name) op_##name:
+#define GPU_SIM_NEXT() do { ++retired; ++cycles; ++ip; GPU_SIM_DISPATCH(); } while (0)
+    GPU_SIM_DISPATCH();
+#else
+#define GPU_SIM_OP(name) case op_##name:
+#define GPU_SIM_NEXT() do { ++retired; ++cycles; ++ip; continue; } while (0)
+    enum { op_nop, op_add, op_mul, op_load, op_store, op_tid, op_stall, op_end };
+    for (;;) switch (static_cast<int>(ip->op)) {
+#endif
+    
+    GPU_SIM_OP(nop)
+        GPU_SIM_NEXT();
+    
+    GPU_SIM_OP(add)
+        warp_alu<false>(regs[ip->dst], regs[ip->src0], regs[ip->src1], mask);
+        GPU_SIM_NEXT();
+    
+    GPU_SIM_OP(mul)
+        warp_alu<true>(regs[ip->dst], regs[ip->src0], regs[ip->src1], mask);
+        GPU_SIM_NEXT();
+    
+    GPU_SIM_OP(load)
+        if (memory_) {
+            // Gather every lane's address before any destination is written
+            lane_reads_.clear();
+            for (uint32_t lane = 0; lane < WARP_SIZE; ++lane) {
+                if (mask & (1u << lane)) {
+                    lane_reads_.push_back({register_address(ip->src0, lane), sizeof(float),
+                                           &regs[ip->dst][lane]});
+                }
+            }
+            timing.issue_cycle = cycles;
+            memory_->read_batch(lane_reads_, &timing);
+            cycles += timing.latency_cycles;
+        } else {
+            cycles += 10; // Memory access penalty without a memory model
+        }
+        GPU_SIM_NEXT();
+    
+    GPU_SIM_OP(store)
+        if (memory_) {
+            lane_writes_.clear();
+            for (uint32_t lane = 0; lane < WARP_SIZE; ++lane) {
+                if (mask & (1u << lane)) {
+                    lane_writes_.push_back({register_address(ip->src0, lane), sizeof(float),
+                                            &regs[ip->src1][lane]});
+                }
+            }
+            timing.issue_cycle = cycles;
+            memory_->write_batch(lane_writes_, &timing);
+            cycles += timing.latency_cycles;
+        } else {
+            cycles += 5;
+        }
+        GPU_SIM_NEXT();
+    
+    GPU_SIM_OP(tid)
+        for (uint32_t lane = 0; lane < WARP_SIZE; ++lane) {
+            if (mask & (1u << lane)) {
+                regs[ip->dst][lane] = static_cast<float>(warp_base_thread_ + lane);
+            }
+        }
+        GPU_SIM_NEXT();
+    
+    GPU_SIM_OP(stall)
+        cycles += ip->stall_cycles;
+        GPU_SIM_NEXT();
+    
+    GPU_SIM_OP(end)
+        warp_instruction_count_ += retired;
+        instruction_count_ += retired * std::bitset<WARP_SIZE>(mask).count();
+        cycle_count_ = cycles;
+        return;
+    
+#if !GPU_SIM_COMPUTED_GOTO
+    }
+#endif
+#undef GPU_SIM_DISPATCH
+#undef GPU_SIM_OP
+#undef GPU_SIM_NEXT
+}
+
+uint64_t ShaderCore::register_address(uint32_t reg, uint32_t lane) const {
+    // Registers hold float element indices into VRAM
+    float index = std::max(0.0f, registers_.lanes[reg][lane]);
+    return static_cast<uint64_t>(index) * sizeof(float);
+}
+
 // GPUCore implementation
-GPUCore::GPUCore(uint32_t num_shader_cores)
-    : num_cores_(num_shader_cores), initialized_(false) {
+GPUCore::GPUCore(uint32_t num_shader_cores, uint32_t num_worker_threads)
+    : num_cores_(num_shader_cores), initialized_(false), outstanding_chunks_(0),
+      dispatch_in_flight_(false), chunk_trace_id_(0),
+      thread_pool_(std::make_unique<ThreadPool>(num_worker_threads)) {
     
     shader_cores_.reserve(num_cores_);
     for (uint32_t i = 0; i < num_cores_; ++i) {
@@ -74,14 +294,23 @@ GPUCore::GPUCore(uint32_t num_shader_cores)
     }
 }
 
+GPUCore::~GPUCore() {
+    thread_pool_->wait_idle();
+}
+
 void GPUCore::initialize(std::shared_ptr<MemoryHierarchy> memory,
                         std::shared_ptr<PerformanceMonitor> perf_monitor) {
     memory_ = memory;
     perf_monitor_ = perf_monitor;
     initialized_ = true;
     
+    for (auto& core : shader_cores_) {
+        core->set_memory(memory_);
+    }
+    
     if (perf_monitor_) {
         perf_monitor_->set_counter("gpu_cores_total", num_cores_);
+        chunk_trace_id_ = perf_monitor_->register_timer("compute_chunk");
     }
 }
 
@@ -91,53 +320,88 @@ void GPUCore::dispatch_compute(const std::vector<uint32_t>& program, uint32_t nu
         return;
     }
     
+    if (capture_) {
+        capture_->record_dispatch_compute(program, num_threads);
+    }
     if (perf_monitor_) {
-        perf_monitor_->start_timer("compute_dispatch");
         perf_monitor_->increment_counter("dispatched_threads", num_threads);
     }
     
+    if (num_threads == 0 || program.empty()) {
+        return;
+    }
+    
+    if (!dispatch_in_flight_) {
+        dispatch_in_flight_ = true;
+        if (perf_monitor_) {
+            perf_monitor_->start_timer("compute_dispatch");
+        }
+    }
+    
+    // Decode once for every thread; workers may outlive the caller's vector
+    auto shared_program = std::make_shared<const DecodedProgram>(decode_program(program));
+    
     // Distribute threads across available cores
     uint32_t threads_per_core = (num_threads + num_cores_ - 1) / num_cores_;
+    uint32_t chunks_per_core = (threads_per_core + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
     
-    for (uint32_t core_idx = 0; core_idx < num_cores_; ++core_idx) {
-        uint32_t start_thread = core_idx * threads_per_core;
-        uint32_t end_thread = std::min(start_thread + threads_per_core, num_threads);
-        
-        if (start_thread >= num_threads) break;
-        
-        auto& core = shader_cores_[core_idx];
-        
-        // Execute program on this core for assigned threads
-        for (uint32_t thread = start_thread; thread < end_thread; ++thread) {
-            // Simple instruction execution simulation
-            for (size_t i = 0; i < program.size(); i += 4) {
-                std::vector<uint32_t> instruction;
-                for (size_t j = 0; j < 4 && (i + j) < program.size(); ++j) {
-                    instruction.push_back(program[i + j]);
+    // Queue chunk 0 of every core before chunk 1 of any, so consecutive
+    // deques hold different cores and idle workers steal runnable work
+    for (uint32_t chunk = 0; chunk < chunks_per_core; ++chunk) {
+        for (uint32_t core_idx = 0; core_idx < num_cores_; ++core_idx) {
+            uint32_t core_start = core_idx * threads_per_core;
+            uint32_t core_end = std::min(core_start + threads_per_core, num_threads);
+            uint32_t start_thread = core_start + chunk * WORKGROUP_SIZE;
+            
+            if (core_start >= num_threads) break;
+            if (start_thread >= core_end) continue;
+            
+            uint32_t chunk_threads = std::min(WORKGROUP_SIZE, core_end - start_thread);
+            ShaderCore* core = shader_cores_[core_idx].get();
+            
+            outstanding_chunks_++;
+            thread_pool_->submit([this, core, core_idx, shared_program, chunk_threads, start_thread] {
+                bool traced = perf_monitor_ && perf_monitor_->is_tracing();
+                auto start_time = traced ? std::chrono::high_resolution_clock::now()
+                                         : std::chrono::high_resolution_clock::time_point();
+                core->execute_threads(*shared_program, chunk_threads, start_thread);
+                if (traced) {
+                    perf_monitor_->trace_span(chunk_trace_id_, start_time, std::chrono::high_resolution_clock::now(),
+                                              static_cast<int32_t>(core_idx));
                 }
-                core->execute_instruction(instruction);
-            }
+                outstanding_chunks_--;
+            });
         }
     }
-    
-    if (perf_monitor_) {
-        perf_monitor_->end_timer("compute_dispatch");
-    }
 }
 
 void GPUCore::wait_for_completion() {
-    // In a real implementation, this would wait for all cores to finish
-    // For simulation, we assume synchronous execution
+    if (capture_) {
+        capture_->record_wait_for_completion();
+    }
+    thread_pool_->wait_idle();
     
     if (perf_monitor_) {
         perf_monitor_->increment_counter("wait_for_completion_calls");
+        if (dispatch_in_flight_) {
+            perf_monitor_->end_timer("compute_dispatch");
+        }
     }
-    
-    // Simulate some wait time
-    std::this_thread::sleep_for(std::chrono::microseconds(100));
+    dispatch_in_flight_ = false;
+}
+
+uint32_t GPUCore::get_worker_thread_count() const {
+    return static_cast<uint32_t>(thread_pool_->get_thread_count());
+}
+
+void GPUCore::set_command_capture(std::shared_ptr<CommandStreamWriter> capture) {
+    capture_ = std::move(capture);
 }
 
 bool GPUCore::is_idle() const {
+    if (outstanding_chunks_ > 0) {
+        return false;
+    }
     return std::all_of(shader_cores_.begin(), shader_cores_.end(),
                       [](const auto& core) { return !core->is_busy(); });
 }
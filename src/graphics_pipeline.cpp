@@ -3,29 +3,244 @@
 #include "memory_hierarchy.h"
 #include "texture_cache.h"
 #include "performance_monitor.h"
+#include "thread_pool.h"
+#include "command_stream.h"
+#include "simd.h"
 #include <cmath>
+#include <cstring>
 #include <algorithm>
 #include <chrono>
 
 namespace gpu_sim {
 
-GraphicsPipeline::GraphicsPipeline() : frame_start_time_(0) {
+namespace {
+
+constexpr int RASTER_TILE_SIZE = 8;
+
+static_assert(GraphicsPipeline::BIN_TILE_SIZE % RASTER_TILE_SIZE == 0,
+              "bin tiles must hold whole raster tiles");
+
+// Screen-space-linear depth; shared by early and late depth tests so both
+// see bit-identical values
+inline float interpolate_depth(const Vertex& v0, const Vertex& v1, const Vertex& v2,
+                               float u, float v, float w) {
+    return u * v0.position[2] * (1.0f / v0.position[3]) +
+           v * v1.position[2] * (1.0f / v1.position[3]) +
+           w * v2.position[2] * (1.0f / v2.position[3]);
+}
+
+// Depth buffer encoding. UNORM values are rounded in double precision so a
+// decoded value re-encodes to the same integer, keeping the stored depth
+// stable across tile loads and resolves.
+constexpr double UNORM24_MAX = 16777215.0;
+constexpr double UNORM16_MAX = 65535.0;
+
+size_t depth_bytes(DepthFormat format) {
+    return format == DepthFormat::UNORM16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+inline uint32_t encode_unorm(float depth, double max_value) {
+    double clamped = std::min(std::max(static_cast<double>(depth), 0.0), 1.0);
+    return static_cast<uint32_t>(clamped * max_value + 0.5);
+}
+
+// Depth as the format stores it
+inline float quantize_depth(float depth, DepthFormat format) {
+    switch (format) {
+        case DepthFormat::UNORM24: return static_cast<float>(encode_unorm(depth, UNORM24_MAX) / UNORM24_MAX);
+        case DepthFormat::UNORM16: return static_cast<float>(encode_unorm(depth, UNORM16_MAX) / UNORM16_MAX);
+        case DepthFormat::FLOAT32:
+        default: return depth;
+    }
+}
+
+void decode_depth(const uint8_t* src, float* dst, size_t count, DepthFormat format) {
+    if (format == DepthFormat::FLOAT32) {
+        memcpy(dst, src, count * sizeof(float));
+    } else if (format == DepthFormat::UNORM24) {
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t value;
+            memcpy(&value, src + i * sizeof(value), sizeof(value));
+            dst[i] = static_cast<float>(value / UNORM24_MAX);
+        }
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            uint16_t value;
+            memcpy(&value, src + i * sizeof(value), sizeof(value));
+            dst[i] = static_cast<float>(value / UNORM16_MAX);
+        }
+    }
+}
+
+void encode_depth(const float* src, uint8_t* dst, size_t count, DepthFormat format) {
+    if (format == DepthFormat::FLOAT32) {
+        memcpy(dst, src, count * sizeof(float));
+    } else if (format == DepthFormat::UNORM24) {
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t value = encode_unorm(src[i], UNORM24_MAX);
+            memcpy(dst + i * sizeof(value), &value, sizeof(value));
+        }
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            uint16_t value = static_cast<uint16_t>(encode_unorm(src[i], UNORM16_MAX));
+            memcpy(dst + i * sizeof(value), &value, sizeof(value));
+        }
+    }
+}
+
+void fill_depth(uint8_t* dst, size_t count, float depth, DepthFormat format) {
+    uint8_t encoded[sizeof(uint32_t)];
+    encode_depth(&depth, encoded, 1, format);
+    const size_t bytes = depth_bytes(format);
+    for (size_t i = 0; i < count; ++i) {
+        memcpy(dst + i * bytes, encoded, bytes);
+    }
+}
+
+// Colour channel from a [0, 255] float; out-of-range values saturate
+inline uint32_t to_channel(float value) {
+    return static_cast<uint32_t>(std::min(std::max(value, 0.0f), 255.0f));
+}
+
+// States that render identically; a state change between them is redundant
+bool same_state(const PipelineState& a, const PipelineState& b) {
+    return a.depth_test_enabled == b.depth_test_enabled &&
+           a.blending_enabled == b.blending_enabled &&
+           a.culling_enabled == b.culling_enabled &&
+           a.viewport_width == b.viewport_width &&
+           a.viewport_height == b.viewport_height &&
+           a.vertex_cache_size == b.vertex_cache_size &&
+           a.early_z_enabled == b.early_z_enabled &&
+           a.fragment_shader_writes_depth == b.fragment_shader_writes_depth &&
+           a.depth_format == b.depth_format;
+}
+
+} // namespace
+
+// PostTransformVertexCache implementation
+void PostTransformVertexCache::resize(size_t entries) {
+    tags_.assign(entries, 0);
+    vertices_.resize(entries);
+    clear();
+}
+
+void PostTransformVertexCache::clear() {
+    valid_entries_ = 0;
+    next_slot_ = 0;
+}
+
+const Vertex* PostTransformVertexCache::find(uint32_t index) const {
+    for (size_t slot = 0; slot < valid_entries_; ++slot) {
+        if (tags_[slot] == index) {
+            return &vertices_[slot];
+        }
+    }
+    return nullptr;
+}
+
+void PostTransformVertexCache::insert(uint32_t index, const Vertex& vertex) {
+    if (tags_.empty()) return;
+    
+    tags_[next_slot_] = index;
+    vertices_[next_slot_] = vertex;
+    next_slot_ = (next_slot_ + 1) % tags_.size();
+    valid_entries_ = std::min(valid_entries_ + 1, tags_.size());
+}
+
+// CommandBuffer implementation
+void CommandBuffer::set_pipeline_state(const PipelineState& state) {
+    Command command{};
+    command.kind = CommandKind::SET_STATE;
+    command.index = static_cast<uint32_t>(states_.size());
+    states_.push_back(state);
+    commands_.push_back(command);
+}
+
+void CommandBuffer::bind_texture(uint32_t unit, uint64_t texture_id) {
+    Command command{};
+    command.kind = CommandKind::BIND_TEXTURE;
+    command.index = unit;
+    command.texture_id = texture_id;
+    commands_.push_back(command);
+}
+
+void CommandBuffer::draw_triangles(const std::vector<Vertex>& vertices) {
+    draw_triangles(vertices.data(), vertices.size());
+}
+
+void CommandBuffer::draw_triangles(const Vertex* vertices, size_t vertex_count) {
+    Command command{};
+    command.kind = CommandKind::DRAW;
+    command.first_vertex = vertices_.size();
+    command.vertex_count = vertex_count;
+    vertices_.insert(vertices_.end(), vertices, vertices + vertex_count);
+    commands_.push_back(command);
+    draw_count_++;
+}
+
+void CommandBuffer::draw_indexed(const std::vector<Vertex>& vertices,
+                                const std::vector<uint32_t>& indices) {
+    draw_indexed(vertices.data(), vertices.size(), indices.data(), indices.size());
+}
+
+void CommandBuffer::draw_indexed(const Vertex* vertices, size_t vertex_count,
+                                const uint32_t* indices, size_t index_count) {
+    Command command{};
+    command.kind = CommandKind::DRAW_INDEXED;
+    command.first_vertex = vertices_.size();
+    command.vertex_count = vertex_count;
+    command.first_index = indices_.size();
+    command.index_count = index_count;
+    vertices_.insert(vertices_.end(), vertices, vertices + vertex_count);
+    indices_.insert(indices_.end(), indices, indices + index_count);
+    commands_.push_back(command);
+    draw_count_++;
+}
+
+void CommandBuffer::reset() {
+    commands_.clear();
+    states_.clear();
+    vertices_.clear();
+    indices_.clear();
+    draw_count_ = 0;
+}
+
+// GraphicsPipeline implementation
+GraphicsPipeline::GraphicsPipeline(uint32_t num_worker_threads)
+    : vertex_batch_(VERTEX_BATCH_SIZE), bins_x_(0), bins_y_(0), frame_active_(false),
+      raster_pool_(std::make_unique<ThreadPool>(num_worker_threads)),
+      next_bin_(0), frame_start_time_() {
     // Initialize default pipeline state
     pipeline_state_.depth_test_enabled = true;
     pipeline_state_.blending_enabled = false;
     pipeline_state_.culling_enabled = true;
     pipeline_state_.viewport_width = 1920;
     pipeline_state_.viewport_height = 1080;
+    vertex_cache_.resize(pipeline_state_.vertex_cache_size);
     
     // Initialize frame buffers
     size_t buffer_size = pipeline_state_.viewport_width * pipeline_state_.viewport_height;
     color_buffer_.resize(buffer_size, 0);
-    depth_buffer_.resize(buffer_size, 1.0f);
+    depth_buffer_.resize(buffer_size * depth_bytes(pipeline_state_.depth_format));
+    fill_depth(depth_buffer_.data(), buffer_size, CLEAR_DEPTH, pipeline_state_.depth_format);
+    resize_bins();
+    
+    // One render target per tile worker
+    for (size_t i = 0; i < raster_pool_->get_thread_count(); ++i) {
+        tile_contexts_.emplace_back(std::make_unique<TileContext>());
+    }
     
     // Initialize statistics
     stats_ = PipelineStats{};
 }
 
+GraphicsPipeline::~GraphicsPipeline() {
+    raster_pool_.reset();
+    for (uint32_t unit = 0; unit < bound_textures_.size(); ++unit) {
+        release_texture_unit(unit);
+    }
+}
+
 void GraphicsPipeline::initialize(std::shared_ptr<GPUCore> gpu_core,
                                  std::shared_ptr<MemoryHierarchy> memory,
                                  std::shared_ptr<TextureCache> texture_cache,
@@ -39,259 +254,1119 @@ void GraphicsPipeline::initialize(std::shared_ptr<GPUCore> gpu_core,
     bound_textures_.resize(8); // Support 8 texture units
     
     if (perf_monitor_) {
+        perf_ids_.draw_triangles = perf_monitor_->register_timer("draw_triangles");
+        perf_ids_.draw_indexed = perf_monitor_->register_timer("draw_indexed");
+        perf_ids_.frame_time = perf_monitor_->register_timer("frame_time");
+        perf_ids_.render_bins = perf_monitor_->register_timer("render_bins");
+        perf_ids_.render_tile = perf_monitor_->register_timer("render_tile");
+        perf_ids_.vertex_stage = perf_monitor_->register_timer("vertex_stage");
+        perf_ids_.rasterization_stage = perf_monitor_->register_timer("rasterization_stage");
+        perf_ids_.fragment_stage = perf_monitor_->register_timer("fragment_stage");
+        perf_ids_.output_merger_stage = perf_monitor_->register_timer("output_merger_stage");
+        perf_ids_.submit = perf_monitor_->register_timer("submit");
+        perf_ids_.triangles_drawn = perf_monitor_->register_counter("triangles_drawn");
+        perf_ids_.vertices_processed = perf_monitor_->register_counter("vertices_processed");
+        perf_ids_.early_z_rejected_fragments = perf_monitor_->register_counter("early_z_rejected_fragments");
+        perf_ids_.hiz_culled_blocks = perf_monitor_->register_counter("hiz_culled_blocks");
+        perf_ids_.frames_presented = perf_monitor_->register_counter("frames_presented");
+        perf_ids_.submitted_draws = perf_monitor_->register_counter("submitted_draws");
+        perf_ids_.submitted_batches = perf_monitor_->register_counter("submitted_batches");
         perf_monitor_->set_counter("viewport_width", pipeline_state_.viewport_width);
         perf_monitor_->set_counter("viewport_height", pipeline_state_.viewport_height);
     }
 }
 
 void GraphicsPipeline::set_pipeline_state(const PipelineState& state) {
+    if (capture_) {
+        capture_->record_set_pipeline_state(state);
+    }
+    
+    // Binned triangles are rendered with the state they were drawn under
+    render_bins();
+    
+    // Pending clears are tracked per bin tile of the current viewport
+    if (state.viewport_width != pipeline_state_.viewport_width ||
+        state.viewport_height != pipeline_state_.viewport_height) {
+        resolve_fast_clears();
+    }
+    if (state.depth_format != pipeline_state_.depth_format) {
+        convert_depth_buffer(pipeline_state_.depth_format, state.depth_format);
+    }
     pipeline_state_ = state;
     
+    if (state.vertex_cache_size != vertex_cache_.capacity()) {
+        vertex_cache_.resize(state.vertex_cache_size);
+    }
+    
     // Resize frame buffers if viewport changed
     size_t new_buffer_size = state.viewport_width * state.viewport_height;
     if (new_buffer_size != color_buffer_.size()) {
+        const size_t bytes = depth_bytes(state.depth_format);
+        const size_t old_buffer_size = color_buffer_.size();
         color_buffer_.resize(new_buffer_size, 0);
-        depth_buffer_.resize(new_buffer_size, 1.0f);
+        depth_buffer_.resize(new_buffer_size * bytes);
+        if (new_buffer_size > old_buffer_size) {
+            fill_depth(&depth_buffer_[old_buffer_size * bytes], new_buffer_size - old_buffer_size,
+                       CLEAR_DEPTH, state.depth_format);
+        }
     }
+    resize_bins();
+}
+
+void GraphicsPipeline::convert_depth_buffer(DepthFormat from, DepthFormat to) {
+    const size_t pixels = depth_buffer_.size() / depth_bytes(from);
+    std::vector<float> depth(pixels);
+    decode_depth(depth_buffer_.data(), depth.data(), pixels, from);
+    depth_buffer_.resize(pixels * depth_bytes(to));
+    encode_depth(depth.data(), depth_buffer_.data(), pixels, to);
 }
 
 void GraphicsPipeline::bind_texture(uint32_t unit, const Texture& texture) {
-    if (unit < bound_textures_.size()) {
-        bound_textures_[unit] = texture;
+    if (unit >= bound_textures_.size()) return;
+    
+    render_bins();
+    release_texture_unit(unit);
+    
+    // Uploaded once here; a re-bind is a new texture with a new id
+    if (texture_cache_) {
+        uint64_t texture_id = texture_cache_->register_texture(texture);
+        if (texture_id != 0) {
+            bound_textures_[unit] = {texture_id, texture.width, texture.height, true};
+        }
+        // The upload itself is captured by the texture cache
+        if (capture_) {
+            capture_->record_bind_texture(unit, texture_id);
+        }
+    }
+}
+
+void GraphicsPipeline::bind_texture(uint32_t unit, uint64_t texture_id) {
+    if (unit >= bound_textures_.size()) return;
+    
+    render_bins();
+    release_texture_unit(unit);
+    
+    uint32_t width, height;
+    if (texture_cache_ && texture_cache_->get_texture_size(texture_id, width, height)) {
+        bound_textures_[unit] = {texture_id, width, height, false};
+    }
+    if (capture_) {
+        capture_->record_bind_texture(unit, texture_id);
+    }
+}
+
+void GraphicsPipeline::release_texture_unit(uint32_t unit) {
+    BoundTexture& bound = bound_textures_[unit];
+    if (bound.owned && texture_cache_) {
+        texture_cache_->invalidate_texture(bound.texture_id);
     }
+    bound = BoundTexture{};
 }
 
 void GraphicsPipeline::set_vertex_shader(std::function<Vertex(const Vertex&)> shader) {
-    vertex_shader_ = shader;
+    if (!shader) {
+        set_vertex_batch_shader(nullptr);
+        return;
+    }
+    set_vertex_batch_shader([shader](const Vertex* input, Vertex* output, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            output[i] = shader(input[i]);
+        }
+    });
 }
 
 void GraphicsPipeline::set_fragment_shader(std::function<Fragment(const Fragment&)> shader) {
-    fragment_shader_ = shader;
+    if (!shader) {
+        set_fragment_batch_shader(nullptr);
+        return;
+    }
+    set_fragment_batch_shader([shader](Fragment* fragments, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            fragments[i] = shader(fragments[i]);
+        }
+    });
+}
+
+void GraphicsPipeline::set_vertex_batch_shader(VertexBatchShader shader) {
+    vertex_shader_ = std::move(shader);
+}
+
+void GraphicsPipeline::set_fragment_batch_shader(FragmentBatchShader shader) {
+    render_bins();
+    fragment_shader_ = std::move(shader);
 }
 
 void GraphicsPipeline::draw_triangles(const std::vector<Vertex>& vertices) {
-    if (perf_monitor_) {
-        perf_monitor_->start_timer("draw_triangles");
+    draw_triangles(vertices.data(), vertices.size());
+}
+
+void GraphicsPipeline::draw_triangles(const Vertex* vertices, size_t vertex_count) {
+    PerformanceMonitor::ScopedTimer scope(perf_monitor_.get(), perf_ids_.draw_triangles, true);
+    
+    if (capture_) {
+        capture_->record_draw_triangles(vertices, vertex_count);
     }
     
-    // Process vertices in groups of 3 (triangles)
-    for (size_t i = 0; i + 2 < vertices.size(); i += 3) {
-        std::vector<Vertex> triangle = {vertices[i], vertices[i+1], vertices[i+2]};
+    // Process whole triangles, shading a batch of vertices at a time
+    const size_t triangle_vertices = vertex_count - vertex_count % 3;
+    for (size_t first = 0; first < triangle_vertices; first += VERTEX_BATCH_SIZE) {
+        size_t count = std::min(VERTEX_BATCH_SIZE, triangle_vertices - first);
+        vertex_stage(&vertices[first], count, vertex_batch_.data());
         
-        // Vertex stage
-        auto transformed_vertices = vertex_stage(triangle);
-        
-        // Culling
-        if (pipeline_state_.culling_enabled && 
-            is_triangle_culled(transformed_vertices[0], transformed_vertices[1], transformed_vertices[2])) {
-            continue;
+        for (size_t i = 0; i < count; i += 3) {
+            draw_triangle(vertex_batch_[i], vertex_batch_[i + 1], vertex_batch_[i + 2]);
         }
-        
-        // Rasterization
-        auto fragments = rasterization_stage(transformed_vertices);
-        
-        // Fragment stage
-        auto shaded_fragments = fragment_stage(fragments);
-        
-        // Output merger
-        output_merger_stage(shaded_fragments);
-        
-        stats_.triangles_drawn++;
     }
     
-    stats_.vertices_processed += vertices.size();
+    // Inside a frame, bins are rendered at end_frame
+    if (!frame_active_) {
+        render_bins();
+    }
+    
+    stats_.vertices_processed += vertex_count;
     
     if (perf_monitor_) {
-        perf_monitor_->end_timer("draw_triangles");
-        perf_monitor_->increment_counter("triangles_drawn", vertices.size() / 3);
-        perf_monitor_->increment_counter("vertices_processed", vertices.size());
+        perf_monitor_->increment_counter(perf_ids_.triangles_drawn, vertex_count / 3);
+        perf_monitor_->increment_counter(perf_ids_.vertices_processed, vertex_count);
     }
 }
 
 void GraphicsPipeline::draw_indexed(const std::vector<Vertex>& vertices,
                                    const std::vector<uint32_t>& indices) {
-    if (perf_monitor_) {
-        perf_monitor_->start_timer("draw_indexed");
+    draw_indexed(vertices.data(), vertices.size(), indices.data(), indices.size());
+}
+
+void GraphicsPipeline::draw_indexed(const Vertex* vertices, size_t vertex_count,
+                                   const uint32_t* indices, size_t index_count) {
+    PerformanceMonitor::ScopedTimer scope(perf_monitor_.get(), perf_ids_.draw_indexed, true);
+    
+    if (capture_) {
+        capture_->record_draw_indexed(vertices, vertex_count, indices, index_count);
     }
     
-    // Build triangle list from indices
-    std::vector<Vertex> triangle_vertices;
-    triangle_vertices.reserve(indices.size());
+    // Cached vertices belong to this vertex buffer only
+    vertex_cache_.clear();
+    uint64_t shaded_vertices = 0;
+    uint64_t triangles = 0;
     
-    for (uint32_t index : indices) {
-        if (index < vertices.size()) {
-            triangle_vertices.push_back(vertices[index]);
+    for (size_t i = 0; i + 2 < index_count; i += 3) {
+        const uint32_t triangle_indices[3] = {indices[i], indices[i + 1], indices[i + 2]};
+        if (triangle_indices[0] >= vertex_count || triangle_indices[1] >= vertex_count ||
+            triangle_indices[2] >= vertex_count) {
+            continue; // Out-of-range index: drop the whole triangle
         }
+        
+        // Vertex stage, shading each index only on a cache miss. Vertices are
+        // copied out since a small cache may evict them within the triangle.
+        Vertex transformed_vertices[3];
+        for (int corner = 0; corner < 3; ++corner) {
+            uint32_t index = triangle_indices[corner];
+            if (const Vertex* cached = vertex_cache_.find(index)) {
+                transformed_vertices[corner] = *cached;
+                stats_.vertex_cache_hits++;
+            } else {
+                vertex_stage(&vertices[index], 1, &transformed_vertices[corner]);
+                vertex_cache_.insert(index, transformed_vertices[corner]);
+                stats_.vertex_cache_misses++;
+                shaded_vertices++;
+            }
+        }
+        
+        draw_triangle(transformed_vertices[0], transformed_vertices[1], transformed_vertices[2]);
+        triangles++;
+    }
+    
+    if (!frame_active_) {
+        render_bins();
     }
     
-    // Draw the triangles
-    draw_triangles(triangle_vertices);
+    stats_.vertices_processed += shaded_vertices;
     
     if (perf_monitor_) {
-        perf_monitor_->end_timer("draw_indexed");
+        perf_monitor_->increment_counter(perf_ids_.triangles_drawn, triangles);
+        perf_monitor_->increment_counter(perf_ids_.vertices_processed, shaded_vertices);
     }
 }
 
-std::vector<Vertex> GraphicsPipeline::vertex_stage(const std::vector<Vertex>& input_vertices) {
-    std::vector<Vertex> output_vertices;
-    output_vertices.reserve(input_vertices.size());
+void GraphicsPipeline::submit(const CommandBuffer& buffer) {
+    submit(buffer, SubmitOptions());
+}
+
+void GraphicsPipeline::submit(const CommandBuffer& buffer, const SubmitOptions& options) {
+    PerformanceMonitor::ScopedTimer scope(perf_monitor_.get(), perf_ids_.submit);
     
-    // Apply vertex shader to each vertex
-    for (const auto& vertex : input_vertices) {
-        Vertex transformed_vertex = vertex;
-        
-        if (vertex_shader_) {
-            transformed_vertex = vertex_shader_(vertex);
+    const PipelineState initial_state = pipeline_state_;
+    std::vector<SubmitBatch> batches = plan_submission(buffer, options);
+    
+    // Textures bound by value are released when their unit is rebound, but
+    // batches that reordering moves after a rebind still draw with them.
+    // Hold them for the whole submit.
+    std::vector<uint64_t> held_textures;
+    for (BoundTexture& bound : bound_textures_) {
+        if (bound.owned) {
+            held_textures.push_back(bound.texture_id);
+            bound.owned = false;
+        }
+    }
+    
+    // Bins resolve between batches, and at the end outside a frame,
+    // rather than after each draw
+    const bool was_in_frame = frame_active_;
+    frame_active_ = true;
+    
+    for (size_t b = 0; b < batches.size(); ++b) {
+        // Vertex shading reads neither bins nor state, so it overlaps the
+        // previous batch's tile rendering
+        if (options.overlap_vertex_processing && !binned_triangles_.empty()) {
+            raster_pool_->submit([this, &buffer, &batch = batches[b]]() {
+                shade_batch(buffer, batch, submit_vertices_);
+            });
+            render_bins();
+            raster_pool_->wait_idle();
         } else {
-            // Default vertex transformation (identity)
-            transformed_vertex = vertex;
+            render_bins();
+            shade_batch(buffer, batches[b], submit_vertices_);
         }
         
-        output_vertices.push_back(transformed_vertex);
+        apply_batch_state(buffer, batches[b], initial_state);
+        execute_batch(buffer, batches[b], submit_vertices_, options.merge_draws);
+    }
+    
+    frame_active_ = was_in_frame;
+    if (!frame_active_) {
+        render_bins();
+    }
+    
+    // A held texture that is still bound goes back to its unit; the rest
+    // are released now that no batch can draw with them. Binned triangles
+    // that use them are rendered first.
+    for (uint64_t texture_id : held_textures) {
+        auto unit = std::find_if(bound_textures_.begin(), bound_textures_.end(),
+                                 [texture_id](const BoundTexture& bound) { return bound.texture_id == texture_id; });
+        if (unit != bound_textures_.end()) {
+            unit->owned = true;
+        } else if (texture_cache_) {
+            render_bins();
+            texture_cache_->invalidate_texture(texture_id);
+        }
     }
     
-    return output_vertices;
+    if (perf_monitor_) {
+        perf_monitor_->increment_counter(perf_ids_.submitted_draws, buffer.get_draw_count());
+        perf_monitor_->increment_counter(perf_ids_.submitted_batches, batches.size());
+    }
 }
 
-std::vector<Fragment> GraphicsPipeline::rasterization_stage(const std::vector<Vertex>& vertices) {
-    std::vector<Fragment> fragments;
-    
-    if (vertices.size() < 3) return fragments;
+std::vector<GraphicsPipeline::SubmitBatch> GraphicsPipeline::plan_submission(
+    const CommandBuffer& buffer, const SubmitOptions& options) const {
+    // Equal states share a class, so redundant state changes do not split batches
+    std::vector<uint32_t> state_classes(buffer.states_.size());
+    for (size_t i = 0; i < buffer.states_.size(); ++i) {
+        state_classes[i] = static_cast<uint32_t>(i + 1);
+        for (size_t j = 0; j < i; ++j) {
+            if (same_state(buffer.states_[i], buffer.states_[j])) {
+                state_classes[i] = state_classes[j];
+                break;
+            }
+        }
+    }
     
-    const Vertex& v0 = vertices[0];
-    const Vertex& v1 = vertices[1];
-    const Vertex& v2 = vertices[2];
+    SubmitBatch current;
+    current.state = -1;
+    current.state_class = 0;
+    for (const BoundTexture& bound : bound_textures_) {
+        current.textures.push_back(bound.texture_id);
+    }
     
-    // Transform to screen coordinates
-    auto screen_coord = [this](const Vertex& v) -> std::pair<int, int> {
-        // Simplified projection to screen space
-        float x = (v.position[0] + 1.0f) * 0.5f * pipeline_state_.viewport_width;
-        float y = (v.position[1] + 1.0f) * 0.5f * pipeline_state_.viewport_height;
-        return {static_cast<int>(x), static_cast<int>(y)};
+    std::vector<SubmitBatch> batches;
+    auto same_batch = [](const SubmitBatch& a, const SubmitBatch& b) {
+        return a.state_class == b.state_class && a.textures == b.textures;
     };
+    for (uint32_t i = 0; i < buffer.commands_.size(); ++i) {
+        const CommandBuffer::Command& command = buffer.commands_[i];
+        switch (command.kind) {
+            case CommandBuffer::CommandKind::SET_STATE:
+                current.state = static_cast<int32_t>(command.index);
+                current.state_class = state_classes[command.index];
+                break;
+            case CommandBuffer::CommandKind::BIND_TEXTURE:
+                if (command.index < current.textures.size()) {
+                    current.textures[command.index] = command.texture_id;
+                }
+                break;
+            case CommandBuffer::CommandKind::DRAW:
+            case CommandBuffer::CommandKind::DRAW_INDEXED:
+                if (batches.empty() || !same_batch(batches.back(), current)) {
+                    batches.push_back(current);
+                }
+                batches.back().draws.push_back(i);
+                break;
+        }
+    }
     
-    auto [x0, y0] = screen_coord(v0);
-    auto [x1, y1] = screen_coord(v1);
-    auto [x2, y2] = screen_coord(v2);
-    
-    // Simple bounding box rasterization
-    int min_x = std::max(0, std::min({x0, x1, x2}));
-    int max_x = std::min(static_cast<int>(pipeline_state_.viewport_width) - 1, std::max({x0, x1, x2}));
-    int min_y = std::max(0, std::min({y0, y1, y2}));
-    int max_y = std::min(static_cast<int>(pipeline_state_.viewport_height) - 1, std::max({y0, y1, y2}));
-    
-    // Generate fragments for pixels inside triangle
-    for (int y = min_y; y <= max_y; ++y) {
-        for (int x = min_x; x <= max_x; ++x) {
-            // Barycentric coordinate test (simplified)
-            float u = 0.33f, v = 0.33f, w = 0.34f; // Simplified - should compute properly
-            
-            if (u >= 0 && v >= 0 && w >= 0) {
-                Fragment fragment = interpolate_fragment(v0, v1, v2, u, v, w);
-                fragment.position[0] = static_cast<float>(x);
-                fragment.position[1] = static_cast<float>(y);
-                fragment.valid = true;
-                
-                fragments.push_back(fragment);
+    if (options.sort_by_texture && batches.size() > 1) {
+        std::stable_sort(batches.begin(), batches.end(), [](const SubmitBatch& a, const SubmitBatch& b) {
+            if (a.textures != b.textures) return a.textures < b.textures;
+            return a.state_class < b.state_class;
+        });
+        
+        std::vector<SubmitBatch> merged;
+        for (SubmitBatch& batch : batches) {
+            if (!merged.empty() && same_batch(merged.back(), batch)) {
+                merged.back().draws.insert(merged.back().draws.end(), batch.draws.begin(), batch.draws.end());
+            } else {
+                merged.push_back(std::move(batch));
             }
         }
+        batches = std::move(merged);
     }
-    
-    return fragments;
+    return batches;
 }
 
-std::vector<Fragment> GraphicsPipeline::fragment_stage(const std::vector<Fragment>& fragments) {
-    std::vector<Fragment> output_fragments;
-    output_fragments.reserve(fragments.size());
+void GraphicsPipeline::shade_batch(const CommandBuffer& buffer, const SubmitBatch& batch,
+                                   std::vector<Vertex>& shaded) {
+    // Whole triangles of each non-indexed draw, back to back; indexed draws
+    // shade through the vertex cache when they execute
+    size_t total = 0;
+    for (uint32_t draw : batch.draws) {
+        const CommandBuffer::Command& command = buffer.commands_[draw];
+        if (command.kind == CommandBuffer::CommandKind::DRAW) {
+            total += command.vertex_count - command.vertex_count % 3;
+        }
+    }
+    shaded.resize(total);
     
-    for (const auto& fragment : fragments) {
-        Fragment shaded_fragment = fragment;
+    size_t offset = 0;
+    for (uint32_t draw : batch.draws) {
+        const CommandBuffer::Command& command = buffer.commands_[draw];
+        if (command.kind != CommandBuffer::CommandKind::DRAW) continue;
+        size_t count = command.vertex_count - command.vertex_count % 3;
+        if (count > 0) {
+            vertex_stage(&buffer.vertices_[command.first_vertex], count, &shaded[offset]);
+        }
+        offset += count;
+    }
+}
+
+void GraphicsPipeline::apply_batch_state(const CommandBuffer& buffer, const SubmitBatch& batch,
+                                         const PipelineState& initial_state) {
+    const PipelineState& state = batch.state < 0 ? initial_state : buffer.states_[batch.state];
+    if (!same_state(state, pipeline_state_)) {
+        set_pipeline_state(state);
+    }
+    for (uint32_t unit = 0; unit < batch.textures.size() && unit < bound_textures_.size(); ++unit) {
+        if (batch.textures[unit] != bound_textures_[unit].texture_id) {
+            bind_texture(unit, batch.textures[unit]);
+        }
+    }
+}
+
+void GraphicsPipeline::execute_batch(const CommandBuffer& buffer, const SubmitBatch& batch,
+                                     const std::vector<Vertex>& shaded, bool merge_draws) {
+    size_t shaded_offset = 0;
+    size_t d = 0;
+    while (d < batch.draws.size()) {
+        const CommandBuffer::Command& first = buffer.commands_[batch.draws[d]];
+        if (first.kind == CommandBuffer::CommandKind::DRAW_INDEXED) {
+            draw_indexed(&buffer.vertices_[first.first_vertex], first.vertex_count,
+                         &buffer.indices_[first.first_index], first.index_count);
+            d++;
+            continue;
+        }
+        
+        // One draw of this and, when merging, the non-indexed draws after it
+        PerformanceMonitor::ScopedTimer scope(perf_monitor_.get(), perf_ids_.draw_triangles, true);
         
-        if (fragment_shader_) {
-            shaded_fragment = fragment_shader_(fragment);
+        size_t vertex_count = 0;
+        size_t triangle_vertices = 0;
+        do {
+            const CommandBuffer::Command& command = buffer.commands_[batch.draws[d]];
+            if (capture_) {
+                capture_->record_draw_triangles(&buffer.vertices_[command.first_vertex], command.vertex_count);
+            }
+            vertex_count += command.vertex_count;
+            triangle_vertices += command.vertex_count - command.vertex_count % 3;
+            d++;
+        } while (merge_draws && d < batch.draws.size() &&
+                 buffer.commands_[batch.draws[d]].kind == CommandBuffer::CommandKind::DRAW);
+        
+        for (size_t i = 0; i < triangle_vertices; i += 3) {
+            const Vertex* triangle = &shaded[shaded_offset + i];
+            draw_triangle(triangle[0], triangle[1], triangle[2]);
         }
+        shaded_offset += triangle_vertices;
+        stats_.vertices_processed += vertex_count;
         
-        // Texture sampling (if textures are bound)
-        if (!bound_textures_.empty() && texture_cache_) {
-            // Sample texture 0 at fragment texture coordinates
-            const auto& texture = bound_textures_[0];
-            if (!texture.data.empty()) {
-                float u = fragment.texcoord[0];
-                float v = fragment.texcoord[1];
+        if (perf_monitor_) {
+            perf_monitor_->increment_counter(perf_ids_.triangles_drawn, triangle_vertices / 3);
+            perf_monitor_->increment_counter(perf_ids_.vertices_processed, vertex_count);
+        }
+    }
+}
+
+void GraphicsPipeline::draw_triangle(const Vertex& v0, const Vertex& v1, const Vertex& v2) {
+    // Culling
+    if (pipeline_state_.culling_enabled && is_triangle_culled(v0, v1, v2)) {
+        return;
+    }
+    
+    stats_.triangles_drawn++;
+    
+    TriangleSetup setup;
+    if (!setup_triangle(v0, v1, v2, setup)) {
+        return;
+    }
+    
+    // Bin to every tile the triangle's edges do not exclude
+    const uint32_t triangle_index = static_cast<uint32_t>(binned_triangles_.size());
+    bool binned = false;
+    for (int tile_y = setup.min_y / BIN_TILE_SIZE; tile_y <= setup.max_y / BIN_TILE_SIZE; ++tile_y) {
+        for (int tile_x = setup.min_x / BIN_TILE_SIZE; tile_x <= setup.max_x / BIN_TILE_SIZE; ++tile_x) {
+            bool rejected, accepted;
+            classify_block(setup.edges, tile_x * BIN_TILE_SIZE, tile_y * BIN_TILE_SIZE,
+                           BIN_TILE_SIZE, rejected, accepted);
+            if (rejected) continue;
+            
+            bins_[tile_y * bins_x_ + tile_x].push_back(triangle_index);
+            binned = true;
+        }
+    }
+    
+    if (binned) {
+        binned_triangles_.push_back(setup);
+    }
+}
+
+void GraphicsPipeline::vertex_stage(const Vertex* input_vertices, size_t count,
+                                    Vertex* output_vertices) {
+    PerformanceMonitor::ScopedTimer scope(perf_monitor_.get(), perf_ids_.vertex_stage);
+    if (vertex_shader_) {
+        vertex_shader_(input_vertices, output_vertices, count);
+    } else {
+        // Default vertex transformation (identity)
+        std::copy_n(input_vertices, count, output_vertices);
+    }
+}
+
+bool GraphicsPipeline::setup_triangle(const Vertex& v0, const Vertex& v1, const Vertex& v2,
+                                      TriangleSetup& setup) const {
+    // There is no clipper, so triangles reaching behind the eye are dropped
+    if (v0.position[3] <= 0.0f || v1.position[3] <= 0.0f || v2.position[3] <= 0.0f) {
+        return false;
+    }
+    
+    // Perspective divide and viewport transform
+    const float width = static_cast<float>(pipeline_state_.viewport_width);
+    const float height = static_cast<float>(pipeline_state_.viewport_height);
+    auto screen_coord = [width, height](const Vertex& v, float& x, float& y) {
+        float inv_w = 1.0f / v.position[3];
+        x = (v.position[0] * inv_w + 1.0f) * 0.5f * width;
+        y = (v.position[1] * inv_w + 1.0f) * 0.5f * height;
+    };
+    
+    float x0, y0, x1, y1, x2, y2;
+    screen_coord(v0, x0, y0);
+    screen_coord(v1, x1, y1);
+    screen_coord(v2, x2, y2);
+    
+    setup.vertices[0] = v0;
+    setup.vertices[1] = v1;
+    setup.vertices[2] = v2;
+    
+    float area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+    if (area == 0.0f) return false;
+    if (area < 0.0f) {
+        // Clockwise (culling disabled): swap to keep the interior positive
+        std::swap(setup.vertices[1], setup.vertices[2]);
+        std::swap(x1, x2);
+        std::swap(y1, y2);
+        area = -area;
+    }
+    
+    // Edge i is opposite vertex i, so E_i / area is vertex i's barycentric
+    setup.edges[0] = EdgeFunction::through(x1, y1, x2, y2);
+    setup.edges[1] = EdgeFunction::through(x2, y2, x0, y0);
+    setup.edges[2] = EdgeFunction::through(x0, y0, x1, y1);
+    setup.inv_area = 1.0f / area;
+    
+    // Interpolated depth is a convex combination of the vertex depths; the
+    // margin covers rounding in interpolate_depth
+    float min_depth = std::min({setup.vertices[0].position[2] / setup.vertices[0].position[3],
+                                setup.vertices[1].position[2] / setup.vertices[1].position[3],
+                                setup.vertices[2].position[2] / setup.vertices[2].position[3]});
+    setup.min_depth = min_depth - 1e-5f * (1.0f + std::abs(min_depth));
+    
+    // Pixel bounding box clipped to the viewport; samples are at pixel centres
+    setup.min_x = std::max(0, static_cast<int>(std::floor(std::min({x0, x1, x2}))));
+    setup.max_x = std::min(static_cast<int>(pipeline_state_.viewport_width) - 1,
+                           static_cast<int>(std::ceil(std::max({x0, x1, x2}))));
+    setup.min_y = std::max(0, static_cast<int>(std::floor(std::min({y0, y1, y2}))));
+    setup.max_y = std::min(static_cast<int>(pipeline_state_.viewport_height) - 1,
+                           static_cast<int>(std::ceil(std::max({y0, y1, y2}))));
+    return setup.min_x <= setup.max_x && setup.min_y <= setup.max_y;
+}
+
+void GraphicsPipeline::classify_block(const EdgeFunction* edges, int x, int y, int size,
+                                      bool& rejected, bool& accepted) {
+    // Each edge's extreme values over the block are at opposite corners
+    float sx0 = x + 0.5f, sx1 = sx0 + (size - 1);
+    float sy0 = y + 0.5f, sy1 = sy0 + (size - 1);
+    rejected = false;
+    accepted = true;
+    for (int e = 0; e < 3; ++e) {
+        const EdgeFunction& edge = edges[e];
+        float max_value = edge.evaluate(edge.a > 0.0f ? sx1 : sx0, edge.b > 0.0f ? sy1 : sy0);
+        float min_value = edge.evaluate(edge.a > 0.0f ? sx0 : sx1, edge.b > 0.0f ? sy0 : sy1);
+        rejected = rejected || max_value < 0.0f;
+        accepted = accepted && min_value > 0.0f;
+    }
+}
+
+void GraphicsPipeline::resize_bins() {
+    bins_x_ = (pipeline_state_.viewport_width + BIN_TILE_SIZE - 1) / BIN_TILE_SIZE;
+    bins_y_ = (pipeline_state_.viewport_height + BIN_TILE_SIZE - 1) / BIN_TILE_SIZE;
+    bins_.resize(static_cast<size_t>(bins_x_) * bins_y_);
+    tile_cleared_.resize(bins_.size(), 0);
+}
+
+void GraphicsPipeline::resolve_fast_clears() const {
+    const int viewport_width = static_cast<int>(pipeline_state_.viewport_width);
+    const int viewport_height = static_cast<int>(pipeline_state_.viewport_height);
+    const DepthFormat format = pipeline_state_.depth_format;
+    const size_t bytes = depth_bytes(format);
+    
+    for (uint32_t bin = 0; bin < tile_cleared_.size(); ++bin) {
+        if (!tile_cleared_[bin]) continue;
+        int x0 = static_cast<int>(bin % bins_x_) * BIN_TILE_SIZE;
+        int y0 = static_cast<int>(bin / bins_x_) * BIN_TILE_SIZE;
+        int width = std::min(BIN_TILE_SIZE, viewport_width - x0);
+        int height = std::min(BIN_TILE_SIZE, viewport_height - y0);
+        for (int row = 0; row < height; ++row) {
+            size_t dst = static_cast<size_t>(y0 + row) * viewport_width + x0;
+            std::fill_n(&color_buffer_[dst], width, CLEAR_COLOR);
+            fill_depth(&depth_buffer_[dst * bytes], width, CLEAR_DEPTH, format);
+        }
+        tile_cleared_[bin] = 0;
+    }
+}
+
+void GraphicsPipeline::render_bins() {
+    if (binned_triangles_.empty()) return;
+    PerformanceMonitor::ScopedTimer scope(perf_monitor_.get(), perf_ids_.render_bins);
+    
+    active_bins_.clear();
+    for (uint32_t bin = 0; bin < bins_.size(); ++bin) {
+        if (!bins_[bin].empty()) {
+            active_bins_.push_back(bin);
+        }
+    }
+    
+    // Each task owns one tile context and pulls bins until none are left.
+    // Every pixel belongs to exactly one tile and each tile draws its
+    // triangles in submission order, so output matches serial rendering.
+    next_bin_.store(0, std::memory_order_relaxed);
+    size_t num_tasks = std::min(tile_contexts_.size(), active_bins_.size());
+    for (size_t task = 0; task < num_tasks; ++task) {
+        raster_pool_->submit([this, task]() {
+            TileContext& tile = *tile_contexts_[task];
+            for (;;) {
+                size_t next = next_bin_.fetch_add(1, std::memory_order_relaxed);
+                if (next >= active_bins_.size()) break;
+                render_tile(tile, active_bins_[next]);
+            }
+        });
+    }
+    raster_pool_->wait_idle();
+    
+    uint64_t early_z_rejected = 0;
+    uint64_t hiz_culled = 0;
+    for (size_t task = 0; task < num_tasks; ++task) {
+        TileContext& tile = *tile_contexts_[task];
+        stats_.fragments_processed += tile.fragments_processed;
+        stats_.texture_samples += tile.texture_samples;
+        stats_.early_z_rejected_fragments += tile.early_z_rejected_fragments;
+        stats_.hiz_culled_blocks += tile.hiz_culled_blocks;
+        early_z_rejected += tile.early_z_rejected_fragments;
+        hiz_culled += tile.hiz_culled_blocks;
+        tile.fragments_processed = 0;
+        tile.texture_samples = 0;
+        tile.early_z_rejected_fragments = 0;
+        tile.hiz_culled_blocks = 0;
+    }
+    
+    if (perf_monitor_ && early_depth_enabled()) {
+        perf_monitor_->increment_counter(perf_ids_.early_z_rejected_fragments, early_z_rejected);
+        perf_monitor_->increment_counter(perf_ids_.hiz_culled_blocks, hiz_culled);
+    }
+    
+    for (uint32_t bin : active_bins_) {
+        bins_[bin].clear();
+    }
+    binned_triangles_.clear();
+}
+
+void GraphicsPipeline::render_tile(TileContext& tile, uint32_t bin_index) {
+    PerformanceMonitor::ScopedTimer scope(perf_monitor_.get(), perf_ids_.render_tile);
+    const int viewport_width = static_cast<int>(pipeline_state_.viewport_width);
+    const int viewport_height = static_cast<int>(pipeline_state_.viewport_height);
+    tile.x0 = static_cast<int>(bin_index % bins_x_) * BIN_TILE_SIZE;
+    tile.y0 = static_cast<int>(bin_index / bins_x_) * BIN_TILE_SIZE;
+    tile.width = std::min(BIN_TILE_SIZE, viewport_width - tile.x0);
+    tile.height = std::min(BIN_TILE_SIZE, viewport_height - tile.y0);
+    
+    const DepthFormat depth_format = pipeline_state_.depth_format;
+    const size_t depth_stride = depth_bytes(depth_format);
+    
+    // Load the tile's region of the frame buffer, or the clear values for a
+    // fast-cleared tile, whose region has not been written since the clear
+    if (tile_cleared_[bin_index]) {
+        for (int row = 0; row < tile.height; ++row) {
+            std::fill_n(&tile.color[row * BIN_TILE_SIZE], tile.width, CLEAR_COLOR);
+            std::fill_n(&tile.depth[row * BIN_TILE_SIZE], tile.width, CLEAR_DEPTH);
+        }
+        std::fill(std::begin(tile.hiz_max), std::end(tile.hiz_max), CLEAR_DEPTH);
+        tile.hiz_stale = 0;
+    } else {
+        for (int row = 0; row < tile.height; ++row) {
+            size_t src = static_cast<size_t>(tile.y0 + row) * viewport_width + tile.x0;
+            std::copy_n(&color_buffer_[src], tile.width, &tile.color[row * BIN_TILE_SIZE]);
+            decode_depth(&depth_buffer_[src * depth_stride], &tile.depth[row * BIN_TILE_SIZE],
+                         tile.width, depth_format);
+        }
+        tile.hiz_stale = ~0u;
+    }
+    
+    for (uint32_t triangle_index : bins_[bin_index]) {
+        rasterization_stage(binned_triangles_[triangle_index], tile);
+    }
+    flush_fragment_batch(tile);
+    
+    // Resolve back to the frame buffer
+    for (int row = 0; row < tile.height; ++row) {
+        size_t dst = static_cast<size_t>(tile.y0 + row) * viewport_width + tile.x0;
+        std::copy_n(&tile.color[row * BIN_TILE_SIZE], tile.width, &color_buffer_[dst]);
+        encode_depth(&tile.depth[row * BIN_TILE_SIZE], &depth_buffer_[dst * depth_stride],
+                     tile.width, depth_format);
+    }
+    tile_cleared_[bin_index] = 0;
+}
+
+bool GraphicsPipeline::early_depth_enabled() const {
+    return pipeline_state_.depth_test_enabled && pipeline_state_.early_z_enabled &&
+           !pipeline_state_.fragment_shader_writes_depth;
+}
+
+float GraphicsPipeline::hiz_block_max(TileContext& tile, int block) const {
+    if (tile.hiz_stale & (1u << block)) {
+        int bx = tile.x0 + (block % HIZ_BLOCKS_PER_ROW) * HIZ_BLOCK_SIZE;
+        int by = tile.y0 + (block / HIZ_BLOCKS_PER_ROW) * HIZ_BLOCK_SIZE;
+        int x_end = std::min(bx + HIZ_BLOCK_SIZE, tile.x0 + tile.width);
+        int y_end = std::min(by + HIZ_BLOCK_SIZE, tile.y0 + tile.height);
+        
+        // Blocks past the viewport edge hold no pixels and never get drawn
+        float max_depth = 0.0f;
+        bool any = false;
+        for (int y = by; y < y_end; ++y) {
+            const float* row = &tile.depth[(y - tile.y0) * BIN_TILE_SIZE];
+            for (int x = bx; x < x_end; ++x) {
+                float d = row[x - tile.x0];
+                max_depth = any ? std::max(max_depth, d) : d;
+                any = true;
+            }
+        }
+        tile.hiz_max[block] = max_depth;
+        tile.hiz_stale &= ~(1u << block);
+    }
+    return tile.hiz_max[block];
+}
+
+void GraphicsPipeline::rasterization_stage(const TriangleSetup& setup, TileContext& tile) {
+    PerformanceMonitor::ScopedTimer scope(perf_monitor_.get(), perf_ids_.rasterization_stage);
+    const Vertex& v0 = setup.vertices[0];
+    const Vertex& v1 = setup.vertices[1];
+    const Vertex& v2 = setup.vertices[2];
+    const EdgeFunction* edges = setup.edges;
+    const bool early_depth = early_depth_enabled();
+    const DepthFormat depth_format = pipeline_state_.depth_format;
+    const bool quantize = depth_format != DepthFormat::FLOAT32;
+    static_assert(HIZ_BLOCK_SIZE == RASTER_TILE_SIZE, "Hi-Z blocks are raster tiles");
+    
+    // Triangle bounds clipped to the tile
+    int min_x = std::max(setup.min_x, tile.x0);
+    int max_x = std::min(setup.max_x, tile.x0 + tile.width - 1);
+    int min_y = std::max(setup.min_y, tile.y0);
+    int max_y = std::min(setup.max_y, tile.y0 + tile.height - 1);
+    if (min_x > max_x || min_y > max_y) return;
+    
+    auto coverage = [](const EdgeFunction& edge, Float4 values) {
+        Float4 zero = Float4::splat(0.0f);
+        return edge.top_left ? Float4::greater_equal(values, zero) : Float4::greater(values, zero);
+    };
+    
+    const Float4 lane_offsets = Float4::set(0.5f, 1.5f, 2.5f, 3.5f);
+    const Float4 inv_area = Float4::splat(setup.inv_area);
+    float weights[3][4];
+    
+    for (int tile_y = min_y & ~(RASTER_TILE_SIZE - 1); tile_y <= max_y; tile_y += RASTER_TILE_SIZE) {
+        for (int tile_x = min_x & ~(RASTER_TILE_SIZE - 1); tile_x <= max_x; tile_x += RASTER_TILE_SIZE) {
+            bool rejected, accepted;
+            classify_block(edges, tile_x, tile_y, RASTER_TILE_SIZE, rejected, accepted);
+            if (rejected) continue;
+            
+            // Hi-Z: the whole block is occluded if the triangle's nearest
+            // point is no closer than the block's farthest stored depth
+            if (early_depth) {
+                int block = ((tile_y - tile.y0) / HIZ_BLOCK_SIZE) * HIZ_BLOCKS_PER_ROW +
+                            (tile_x - tile.x0) / HIZ_BLOCK_SIZE;
+                if (setup.min_depth >= hiz_block_max(tile, block)) {
+                    tile.hiz_culled_blocks++;
+                    continue;
+                }
+            }
+            
+            int row_begin = std::max(tile_y, min_y);
+            int row_end = std::min(tile_y + RASTER_TILE_SIZE - 1, max_y);
+            
+            // 4 pixels at a time; edge values step by b per row
+            for (int quad_x = tile_x; quad_x < tile_x + RASTER_TILE_SIZE; quad_x += 4) {
+                uint32_t column_mask = 0;
+                for (int lane = 0; lane < 4; ++lane) {
+                    int x = quad_x + lane;
+                    column_mask |= (x >= min_x && x <= max_x ? 1u : 0u) << lane;
+                }
+                if (!column_mask) continue;
                 
-                // Convert to texture coordinates
-                uint32_t tex_x = static_cast<uint32_t>(u * texture.width) % texture.width;
-                uint32_t tex_y = static_cast<uint32_t>(v * texture.height) % texture.height;
-                uint64_t tex_offset = (tex_y * texture.width + tex_x) * 4; // Assume 4 bytes per pixel
+                Float4 pixel_x = Float4::splat(static_cast<float>(quad_x)) + lane_offsets;
+                Float4 values[3];
+                Float4 row_steps[3];
+                for (int e = 0; e < 3; ++e) {
+                    values[e] = Float4::splat(edges[e].a) * pixel_x +
+                                Float4::splat(edges[e].b * (row_begin + 0.5f) + edges[e].c);
+                    row_steps[e] = Float4::splat(edges[e].b);
+                }
                 
-                // Read texture data through cache (this utilizes our new feature!)
-                uint8_t pixel_data[4];
-                if (texture_cache_->read_texture(reinterpret_cast<uint64_t>(&texture), 0, 
-                                               tex_offset, pixel_data, 4)) {
-                    // Apply texture color to fragment
-                    shaded_fragment.color[0] *= pixel_data[0] / 255.0f;
-                    shaded_fragment.color[1] *= pixel_data[1] / 255.0f;
-                    shaded_fragment.color[2] *= pixel_data[2] / 255.0f;
-                    shaded_fragment.color[3] *= pixel_data[3] / 255.0f;
+                for (int y = row_begin; y <= row_end; ++y) {
+                    uint32_t mask = column_mask;
+                    if (!accepted) {
+                        mask &= coverage(edges[0], values[0]) & coverage(edges[1], values[1]) &
+                                coverage(edges[2], values[2]);
+                    }
                     
-                    stats_.texture_samples++;
+                    if (mask) {
+                        for (int e = 0; e < 3; ++e) {
+                            (values[e] * inv_area).store(weights[e]);
+                        }
+                        for (int lane = 0; lane < 4; ++lane) {
+                            if (!(mask & (1u << lane))) continue;
+                            
+                            float depth = interpolate_depth(v0, v1, v2, weights[0][lane],
+                                                            weights[1][lane], weights[2][lane]);
+                            if (quantize) {
+                                depth = quantize_depth(depth, depth_format);
+                            }
+                            int pixel_index = (y - tile.y0) * BIN_TILE_SIZE + (quad_x + lane - tile.x0);
+                            
+                            // Early-Z: reject before interpolating and shading.
+                            // Passing fragments are still tested late, as
+                            // earlier fragments in the batch may win the pixel.
+                            if (early_depth && depth >= tile.depth[pixel_index]) {
+                                tile.early_z_rejected_fragments++;
+                                continue;
+                            }
+                            
+                            FragmentStream& stream = tile.fragments;
+                            size_t index = tile.fragment_count++;
+                            stream.pixel[index] = static_cast<uint16_t>(pixel_index);
+                            stream.depth[index] = depth;
+                            stream.barycentric[0][index] = weights[0][lane];
+                            stream.barycentric[1][index] = weights[1][lane];
+                            stream.barycentric[2][index] = weights[2][lane];
+                            
+                            if (tile.fragment_count == FRAGMENT_BATCH_SIZE) {
+                                interpolate_attributes(tile, setup);
+                                flush_fragment_batch(tile);
+                            }
+                        }
+                    }
+                    
+                    for (int e = 0; e < 3; ++e) {
+                        values[e] = values[e] + row_steps[e];
+                    }
                 }
             }
         }
-        
-        output_fragments.push_back(shaded_fragment);
     }
     
-    stats_.fragments_processed += fragments.size();
-    return output_fragments;
+    interpolate_attributes(tile, setup);
 }
 
-void GraphicsPipeline::output_merger_stage(const std::vector<Fragment>& fragments) {
-    for (const auto& fragment : fragments) {
-        if (!fragment.valid) continue;
+void GraphicsPipeline::interpolate_attributes(TileContext& tile, const TriangleSetup& setup) {
+    FragmentStream& stream = tile.fragments;
+    const Vertex& v0 = setup.vertices[0];
+    const Vertex& v1 = setup.vertices[1];
+    const Vertex& v2 = setup.vertices[2];
+    const float inv_w0 = 1.0f / v0.position[3];
+    const float inv_w1 = 1.0f / v1.position[3];
+    const float inv_w2 = 1.0f / v2.position[3];
+    const size_t begin = tile.interpolated_count;
+    const size_t end = tile.fragment_count;
+    
+    // Attributes are interpolated perspective-correctly (weighted by 1/w);
+    // the screen-space weights are replaced by perspective-correct ones
+    float* perspective[3] = {stream.barycentric[0], stream.barycentric[1], stream.barycentric[2]};
+    for (size_t i = begin; i < end; ++i) {
+        float u = perspective[0][i], v = perspective[1][i], w = perspective[2][i];
+        float inv_w = u * inv_w0 + v * inv_w1 + w * inv_w2;
+        stream.inv_w[i] = inv_w;
+        perspective[0][i] = u * inv_w0 / inv_w;
+        perspective[1][i] = v * inv_w1 / inv_w;
+        perspective[2][i] = w * inv_w2 / inv_w;
+    }
+    
+    for (int c = 0; c < 4; ++c) {
+        const float a0 = v0.color[c], a1 = v1.color[c], a2 = v2.color[c];
+        float* out = stream.color[c];
+        for (size_t i = begin; i < end; ++i) {
+            out[i] = perspective[0][i] * a0 + perspective[1][i] * a1 + perspective[2][i] * a2;
+        }
+    }
+    for (int c = 0; c < 2; ++c) {
+        const float a0 = v0.texcoord[c], a1 = v1.texcoord[c], a2 = v2.texcoord[c];
+        float* out = stream.texcoord[c];
+        for (size_t i = begin; i < end; ++i) {
+            out[i] = perspective[0][i] * a0 + perspective[1][i] * a1 + perspective[2][i] * a2;
+        }
+    }
+    std::fill(stream.valid + begin, stream.valid + end, uint8_t{1});
+    
+    tile.interpolated_count = end;
+}
+
+void GraphicsPipeline::flush_fragment_batch(TileContext& tile) {
+    if (tile.fragment_count == 0) return;
+    
+    fragment_stage(tile);
+    output_merger_stage(tile);
+    tile.fragment_count = 0;
+    tile.interpolated_count = 0;
+}
+
+void GraphicsPipeline::fragment_stage(TileContext& tile) {
+    PerformanceMonitor::ScopedTimer scope(perf_monitor_.get(), perf_ids_.fragment_stage);
+    FragmentStream& stream = tile.fragments;
+    const size_t count = tile.fragment_count;
+    
+    // Texture 0 is sampled at the rasterized (pre-shader) texcoords, so
+    // the stream's texcoords are left untouched by shading
+    const BoundTexture* texture = nullptr;
+    if (!bound_textures_.empty() && texture_cache_ && bound_textures_[0].texture_id != 0) {
+        texture = &bound_textures_[0];
+    }
+    
+    // Shaders see AoS fragments, one call per batch. A shader may change
+    // color, depth and validity; fragments cannot move pixels.
+    if (fragment_shader_) {
+        Fragment* fragments = tile.shader_batch.data();
+        for (size_t i = 0; i < count; ++i) {
+            Fragment& fragment = fragments[i];
+            fragment.position[0] = static_cast<float>(tile.x0 + stream.pixel[i] % BIN_TILE_SIZE);
+            fragment.position[1] = static_cast<float>(tile.y0 + stream.pixel[i] / BIN_TILE_SIZE);
+            fragment.position[2] = stream.depth[i];
+            fragment.position[3] = stream.inv_w[i];
+            for (int c = 0; c < 4; ++c) fragment.color[c] = stream.color[c][i];
+            fragment.texcoord[0] = stream.texcoord[0][i];
+            fragment.texcoord[1] = stream.texcoord[1][i];
+            fragment.depth = stream.depth[i];
+            fragment.valid = true;
+        }
         
-        int x = static_cast<int>(fragment.position[0]);
-        int y = static_cast<int>(fragment.position[1]);
+        fragment_shader_(fragments, count);
         
-        if (x < 0 || x >= static_cast<int>(pipeline_state_.viewport_width) ||
-            y < 0 || y >= static_cast<int>(pipeline_state_.viewport_height)) {
-            continue;
+        for (size_t i = 0; i < count; ++i) {
+            const Fragment& fragment = fragments[i];
+            for (int c = 0; c < 4; ++c) stream.color[c][i] = fragment.color[c];
+            stream.depth[i] = fragment.depth;
+            stream.valid[i] = fragment.valid;
         }
+    }
+    
+    // Texture sampling (if textures are bound)
+    if (texture) {
+        for (size_t i = 0; i < count; ++i) {
+            // Convert to texture coordinates
+            uint32_t tex_x = static_cast<uint32_t>(stream.texcoord[0][i] * texture->width) % texture->width;
+            uint32_t tex_y = static_cast<uint32_t>(stream.texcoord[1][i] * texture->height) % texture->height;
+            
+            // Read texture data through cache (this utilizes our new feature!)
+            uint8_t pixel_data[4];
+            if (texture_cache_->read_texel(texture->texture_id, 0, tex_x, tex_y, pixel_data)) {
+                // Apply texture color to fragment
+                for (int c = 0; c < 4; ++c) {
+                    stream.color[c][i] *= pixel_data[c] / 255.0f;
+                }
+                
+                tile.texture_samples++;
+            }
+        }
+    }
+    
+    tile.fragments_processed += count;
+}
+
+void GraphicsPipeline::output_merger_stage(TileContext& tile) {
+    PerformanceMonitor::ScopedTimer scope(perf_monitor_.get(), perf_ids_.output_merger_stage);
+    const FragmentStream& stream = tile.fragments;
+    const size_t count = tile.fragment_count;
+    const bool depth_test = pipeline_state_.depth_test_enabled;
+    const bool blending = pipeline_state_.blending_enabled;
+    const DepthFormat depth_format = pipeline_state_.depth_format;
+    const bool quantize = pipeline_state_.fragment_shader_writes_depth && depth_format != DepthFormat::FLOAT32;
+    
+    const Float4 zero = Float4::splat(0.0f);
+    const Float4 one = Float4::splat(1.0f);
+    const Float4 scale = Float4::splat(255.0f);
+    
+    // Four fragments at a time. Fragments on distinct pixels are
+    // independent, so a group is tested, blended and packed four-wide; a
+    // group that hits a pixel twice takes the scalar path to keep order.
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32_t valid = 0;
+        int pixels[4];
+        for (int lane = 0; lane < 4; ++lane) {
+            valid |= (stream.valid[i + lane] ? 1u : 0u) << lane;
+            pixels[lane] = stream.pixel[i + lane];
+        }
+        if (!valid) continue;
         
-        size_t pixel_index = y * pipeline_state_.viewport_width + x;
+        bool distinct = true;
+        for (int a = 0; a < 4 && distinct; ++a) {
+            for (int b = a + 1; b < 4; ++b) {
+                if ((valid >> a & 1u) && (valid >> b & 1u) && pixels[a] == pixels[b]) {
+                    distinct = false;
+                    break;
+                }
+            }
+        }
+        if (!distinct) {
+            for (int lane = 0; lane < 4; ++lane) {
+                merge_fragment(tile, i + lane);
+            }
+            continue;
+        }
         
-        // Depth test
-        if (pipeline_state_.depth_test_enabled) {
-            if (fragment.depth >= depth_buffer_[pixel_index]) {
-                continue; // Fragment is behind existing pixel
+        uint32_t pass = valid;
+        if (depth_test) {
+            float depth[4];
+            for (int lane = 0; lane < 4; ++lane) {
+                depth[lane] = quantize ? quantize_depth(stream.depth[i + lane], depth_format) : stream.depth[i + lane];
+            }
+            Float4 stored = Float4::set(tile.depth[pixels[0]], tile.depth[pixels[1]],
+                                        tile.depth[pixels[2]], tile.depth[pixels[3]]);
+            pass &= Float4::greater(stored, Float4::load(depth));
+            for (int lane = 0; lane < 4; ++lane) {
+                if (!(pass & (1u << lane))) continue;
+                int pixel_index = pixels[lane];
+                tile.depth[pixel_index] = depth[lane];
+                int x = pixel_index % BIN_TILE_SIZE;
+                int y = pixel_index / BIN_TILE_SIZE;
+                tile.hiz_stale |= 1u << ((y / HIZ_BLOCK_SIZE) * HIZ_BLOCKS_PER_ROW + x / HIZ_BLOCK_SIZE);
             }
-            depth_buffer_[pixel_index] = fragment.depth;
         }
+        if (!pass) continue;
         
-        // Color blending (simplified)
-        if (pipeline_state_.blending_enabled) {
-            // Simple alpha blending
-            float alpha = fragment.color[3];
-            uint32_t existing_color = color_buffer_[pixel_index];
-            
-            uint8_t existing_r = (existing_color >> 24) & 0xFF;
-            uint8_t existing_g = (existing_color >> 16) & 0xFF;
-            uint8_t existing_b = (existing_color >> 8) & 0xFF;
-            
-            uint8_t new_r = static_cast<uint8_t>(fragment.color[0] * alpha * 255 + existing_r * (1 - alpha));
-            uint8_t new_g = static_cast<uint8_t>(fragment.color[1] * alpha * 255 + existing_g * (1 - alpha));
-            uint8_t new_b = static_cast<uint8_t>(fragment.color[2] * alpha * 255 + existing_b * (1 - alpha));
-            
-            color_buffer_[pixel_index] = (new_r << 24) | (new_g << 16) | (new_b << 8) | 0xFF;
+        Float4 red = Float4::load(&stream.color[0][i]);
+        Float4 green = Float4::load(&stream.color[1][i]);
+        Float4 blue = Float4::load(&stream.color[2][i]);
+        Float4 alpha = Float4::load(&stream.color[3][i]);
+        if (blending) {
+            // Simple alpha blending over the existing colour; alpha stays opaque
+            float existing[3][4];
+            for (int lane = 0; lane < 4; ++lane) {
+                uint32_t color = tile.color[pixels[lane]];
+                existing[0][lane] = static_cast<float>((color >> 24) & 0xFF);
+                existing[1][lane] = static_cast<float>((color >> 16) & 0xFF);
+                existing[2][lane] = static_cast<float>((color >> 8) & 0xFF);
+            }
+            Float4 inverse_alpha = one - alpha;
+            red = red * alpha * scale + Float4::load(existing[0]) * inverse_alpha;
+            green = green * alpha * scale + Float4::load(existing[1]) * inverse_alpha;
+            blue = blue * alpha * scale + Float4::load(existing[2]) * inverse_alpha;
+            alpha = scale;
         } else {
-            // Replace existing color
-            uint8_t r = static_cast<uint8_t>(fragment.color[0] * 255);
-            uint8_t g = static_cast<uint8_t>(fragment.color[1] * 255);
-            uint8_t b = static_cast<uint8_t>(fragment.color[2] * 255);
-            uint8_t a = static_cast<uint8_t>(fragment.color[3] * 255);
-            
-            color_buffer_[pixel_index] = (r << 24) | (g << 16) | (b << 8) | a;
+            red = red * scale;
+            green = green * scale;
+            blue = blue * scale;
+            alpha = alpha * scale;
+        }
+        
+        int32_t channels[4][4];
+        Float4::min(Float4::max(red, zero), scale).store_int(channels[0]);
+        Float4::min(Float4::max(green, zero), scale).store_int(channels[1]);
+        Float4::min(Float4::max(blue, zero), scale).store_int(channels[2]);
+        Float4::min(Float4::max(alpha, zero), scale).store_int(channels[3]);
+        for (int lane = 0; lane < 4; ++lane) {
+            if (!(pass & (1u << lane))) continue;
+            tile.color[pixels[lane]] = (static_cast<uint32_t>(channels[0][lane]) << 24) |
+                                       (static_cast<uint32_t>(channels[1][lane]) << 16) |
+                                       (static_cast<uint32_t>(channels[2][lane]) << 8) |
+                                       static_cast<uint32_t>(channels[3][lane]);
+        }
+    }
+    
+    for (; i < count; ++i) {
+        merge_fragment(tile, i);
+    }
+}
+
+void GraphicsPipeline::merge_fragment(TileContext& tile, size_t index) {
+    const FragmentStream& stream = tile.fragments;
+    if (!stream.valid[index]) return;
+    
+    const int pixel_index = stream.pixel[index];
+    float depth = stream.depth[index];
+    if (pipeline_state_.fragment_shader_writes_depth) {
+        depth = quantize_depth(depth, pipeline_state_.depth_format);
+    }
+    
+    // Depth test
+    if (pipeline_state_.depth_test_enabled) {
+        if (depth >= tile.depth[pixel_index]) {
+            return; // Fragment is behind existing pixel
         }
+        tile.depth[pixel_index] = depth;
+        int x = pixel_index % BIN_TILE_SIZE;
+        int y = pixel_index / BIN_TILE_SIZE;
+        tile.hiz_stale |= 1u << ((y / HIZ_BLOCK_SIZE) * HIZ_BLOCKS_PER_ROW + x / HIZ_BLOCK_SIZE);
+    }
+    
+    const float red = stream.color[0][index];
+    const float green = stream.color[1][index];
+    const float blue = stream.color[2][index];
+    const float alpha = stream.color[3][index];
+    
+    // Color blending (simplified)
+    if (pipeline_state_.blending_enabled) {
+        // Simple alpha blending
+        uint32_t existing_color = tile.color[pixel_index];
+        
+        float existing_r = static_cast<float>((existing_color >> 24) & 0xFF);
+        float existing_g = static_cast<float>((existing_color >> 16) & 0xFF);
+        float existing_b = static_cast<float>((existing_color >> 8) & 0xFF);
+        
+        uint32_t new_r = to_channel(red * alpha * 255.0f + existing_r * (1.0f - alpha));
+        uint32_t new_g = to_channel(green * alpha * 255.0f + existing_g * (1.0f - alpha));
+        uint32_t new_b = to_channel(blue * alpha * 255.0f + existing_b * (1.0f - alpha));
+        
+        tile.color[pixel_index] = (new_r << 24) | (new_g << 16) | (new_b << 8) | 0xFF;
+    } else {
+        // Replace existing color
+        uint32_t r = to_channel(red * 255.0f);
+        uint32_t g = to_channel(green * 255.0f);
+        uint32_t b = to_channel(blue * 255.0f);
+        uint32_t a = to_channel(alpha * 255.0f);
+        
+        tile.color[pixel_index] = (r << 24) | (g << 16) | (b << 8) | a;
     }
 }
 
@@ -306,58 +1381,50 @@ bool GraphicsPipeline::is_triangle_culled(const Vertex& v0, const Vertex& v1, co
     return cross_product <= 0; // Cull if facing away
 }
 
-Fragment GraphicsPipeline::interpolate_fragment(const Vertex& v0, const Vertex& v1, const Vertex& v2,
-                                               float u, float v, float w) {
-    Fragment fragment;
-    
-    // Interpolate position (already set by caller)
-    fragment.position[2] = u * v0.position[2] + v * v1.position[2] + w * v2.position[2];
-    fragment.position[3] = u * v0.position[3] + v * v1.position[3] + w * v2.position[3];
-    
-    // Interpolate color
-    for (int i = 0; i < 4; ++i) {
-        fragment.color[i] = u * v0.color[i] + v * v1.color[i] + w * v2.color[i];
-    }
-    
-    // Interpolate texture coordinates
-    for (int i = 0; i < 2; ++i) {
-        fragment.texcoord[i] = u * v0.texcoord[i] + v * v1.texcoord[i] + w * v2.texcoord[i];
+void GraphicsPipeline::begin_frame() {
+    if (capture_) {
+        capture_->record_begin_frame();
     }
     
-    // Set depth
-    fragment.depth = fragment.position[2];
-    fragment.valid = true;
+    render_bins();
+    frame_active_ = true;
     
-    return fragment;
-}
-
-void GraphicsPipeline::begin_frame() {
-    frame_start_time_ = std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    frame_start_time_ = std::chrono::steady_clock::now();
     
-    // Clear frame buffers
-    std::fill(color_buffer_.begin(), color_buffer_.end(), 0x000000FF); // Black with full alpha
-    std::fill(depth_buffer_.begin(), depth_buffer_.end(), 1.0f);
+    // Fast clear: flag every tile; tiles take the clear values when loaded
+    std::fill(tile_cleared_.begin(), tile_cleared_.end(), 1);
     
     // Reset frame statistics
     stats_.vertices_processed = 0;
     stats_.fragments_processed = 0;
     stats_.triangles_drawn = 0;
     stats_.texture_samples = 0;
+    stats_.vertex_cache_hits = 0;
+    stats_.vertex_cache_misses = 0;
+    stats_.early_z_rejected_fragments = 0;
+    stats_.hiz_culled_blocks = 0;
     
     if (perf_monitor_) {
-        perf_monitor_->start_timer("frame_time");
+        perf_monitor_->start_timer(perf_ids_.frame_time);
     }
 }
 
 void GraphicsPipeline::end_frame() {
-    uint64_t frame_end_time = std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    if (capture_) {
+        capture_->record_end_frame();
+    }
     
-    stats_.frame_time_ms = static_cast<double>(frame_end_time - frame_start_time_);
+    // Resolve the frame's bins before timing it
+    render_bins();
+    frame_active_ = false;
+    
+    // Monotonic and at the clock's full resolution, so sub-millisecond
+    // frames do not round to 0
+    stats_.frame_time_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - frame_start_time_).count();
     
     if (perf_monitor_) {
-        perf_monitor_->end_timer("frame_time");
+        perf_monitor_->end_timer(perf_ids_.frame_time);
         perf_monitor_->record_frame_metrics(stats_.frame_time_ms, 
                                           stats_.triangles_drawn, 
                                           stats_.fragments_processed);
@@ -368,13 +1435,39 @@ void GraphicsPipeline::present() {
     // In a real implementation, this would present the frame buffer to the display
     // For simulation, we just record the presentation
     
+    if (capture_) {
+        capture_->record_present();
+    }
     if (perf_monitor_) {
-        perf_monitor_->increment_counter("frames_presented");
+        perf_monitor_->increment_counter(perf_ids_.frames_presented);
     }
 }
 
+void GraphicsPipeline::set_command_capture(std::shared_ptr<CommandStreamWriter> capture) {
+    capture_ = std::move(capture);
+}
+
 GraphicsPipeline::PipelineStats GraphicsPipeline::get_statistics() const {
     return stats_;
 }
 
+const std::vector<uint32_t>& GraphicsPipeline::get_color_buffer() const {
+    resolve_fast_clears();
+    return color_buffer_;
+}
+
+float GraphicsPipeline::get_depth(uint32_t x, uint32_t y) const {
+    if (x >= pipeline_state_.viewport_width || y >= pipeline_state_.viewport_height) {
+        return CLEAR_DEPTH;
+    }
+    if (tile_cleared_[(y / BIN_TILE_SIZE) * bins_x_ + x / BIN_TILE_SIZE]) {
+        return CLEAR_DEPTH;
+    }
+    const DepthFormat format = pipeline_state_.depth_format;
+    float depth;
+    decode_depth(&depth_buffer_[(static_cast<size_t>(y) * pipeline_state_.viewport_width + x) * depth_bytes(format)],
+                 &depth, 1, format);
+    return depth;
+}
+
 } // namespace gpu_sim
\ No newline at end of file
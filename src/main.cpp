@@ -3,7 +3,9 @@
 #include "graphics_pipeline.h"
 #include "texture_cache.h"
 #include "performance_monitor.h"
+#include "command_stream.h"
 #include <iostream>
+#include <string>
 #include <vector>
 #include <memory>
 #include <chrono>
@@ -146,7 +148,16 @@ void run_performance_benchmark(GraphicsPipeline& pipeline,
     std::cout << "Average FPS: " << (num_frames * 1000.0 / total_time) << std::endl;
 }
 
-int main() {
+int main(int argc, char** argv) {
+    // --capture=PATH records the demo's command stream for gpu_replay
+    std::string capture_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument.compare(0, 10, "--capture=") == 0) {
+            capture_path = argument.substr(10);
+        }
+    }
+    
     std::cout << "GPU Architecture Simulator Enhancement" << std::endl;
     std::cout << "======================================" << std::endl;
     
@@ -164,6 +175,20 @@ int main() {
         gpu_core->initialize(memory_hierarchy, performance_monitor);
         texture_cache->initialize(memory_hierarchy, performance_monitor);
         graphics_pipeline->initialize(gpu_core, memory_hierarchy, texture_cache, performance_monitor);
+        performance_monitor->enable_profiling(true);  // Per-stage call tree in the final report
+        
+        // Attached before any texture is uploaded, so the stream is self-contained
+        std::shared_ptr<CommandStreamWriter> capture;
+        if (!capture_path.empty()) {
+            capture = std::make_shared<CommandStreamWriter>();
+            if (!capture->open(capture_path)) {
+                std::cerr << "Cannot open capture file " << capture_path << std::endl;
+                return 1;
+            }
+            gpu_core->set_command_capture(capture);
+            texture_cache->set_command_capture(capture);
+            graphics_pipeline->set_command_capture(capture);
+        }
         
         std::cout << "✓ GPU Core initialized with 64 shader cores" << std::endl;
         std::cout << "✓ Memory hierarchy initialized" << std::endl;
@@ -273,6 +298,12 @@ int main() {
         std::cout << "  VRAM accesses: " << memory_stats.vram_accesses << std::endl;
         std::cout << "  Average access latency: " << memory_stats.avg_access_latency << " cycles" << std::endl;
         
+        if (capture) {
+            capture->close();
+            std::cout << "\nCaptured " << capture->get_command_count() << " commands to "
+                      << capture_path << std::endl;
+        }
+        
         std::cout << "\n=== Simulation Complete ===" << std::endl;
         std::cout << "The GPU architecture simulator successfully demonstrated:" << std::endl;
         std::cout << "✓ Multi-core GPU simulation with 64 shader cores" << std::endl;
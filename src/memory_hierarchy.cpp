@@ -6,238 +6,809 @@
 namespace gpu_sim {
 
 // GPUCache implementation
-GPUCache::GPUCache(size_t cache_size, size_t line_size, size_t associativity)
+template <typename Policy>
+GPUCache<Policy>::GPUCache(size_t cache_size, size_t line_size, size_t associativity)
     : cache_size_(cache_size), line_size_(line_size), associativity_(associativity),
-      hit_count_(0), miss_count_(0), access_count_(0) {
+      hit_count_(0), miss_count_(0), access_count_(0), writeback_count_(0) {
     
     num_sets_ = cache_size_ / (line_size_ * associativity_);
-    cache_sets_.resize(num_sets_);
     
-    for (auto& set : cache_sets_) {
-        set.resize(associativity_);
-    }
+    size_t num_slots = num_sets_ * associativity_;
+    tags_.resize(num_slots, 0);
+    valid_.resize(num_slots, 0);
+    dirty_.resize(num_slots, 0);
+    data_.resize(num_slots * line_size_, 0);
+    
+    policy_.initialize(num_sets_, associativity_);
 }
 
-size_t GPUCache::get_set_index(uint64_t address) const {
+template <typename Policy>
+size_t GPUCache<Policy>::get_set_index(uint64_t address) const {
     return (address / line_size_) % num_sets_;
 }
 
-uint64_t GPUCache::get_tag(uint64_t address) const {
+template <typename Policy>
+uint64_t GPUCache<Policy>::get_tag(uint64_t address) const {
     return address / (line_size_ * num_sets_);
 }
 
-CacheLine* GPUCache::find_line(uint64_t address) {
-    size_t set_index = get_set_index(address);
+template <typename Policy>
+uint64_t GPUCache<Policy>::line_address(size_t slot) const {
+    uint64_t set = slot / associativity_;
+    return (tags_[slot] * num_sets_ + set) * line_size_;
+}
+
+template <typename Policy>
+size_t GPUCache<Policy>::find_line(uint64_t address) {
+    size_t base = get_set_index(address) * associativity_;
     uint64_t tag = get_tag(address);
     
-    auto& set = cache_sets_[set_index];
-    for (auto& line : set) {
-        if (line && line->valid && line->address == (address & ~(line_size_ - 1))) {
-            line->access_time = access_count_;
-            return line.get();
+    for (size_t slot = base; slot < base + associativity_; ++slot) {
+        if (valid_[slot] && tags_[slot] == tag) {
+            return slot;
         }
     }
-    return nullptr;
+    return INVALID_SLOT;
 }
 
-CacheLine* GPUCache::allocate_line(uint64_t address) {
-    size_t set_index = get_set_index(address);
-    auto& set = cache_sets_[set_index];
+template <typename Policy>
+size_t GPUCache<Policy>::allocate_line(uint64_t address, LineEviction* eviction) {
+    size_t set = get_set_index(address);
+    size_t base = set * associativity_;
     
-    // Find empty slot first
-    for (auto& line : set) {
-        if (!line || !line->valid) {
-            line = std::make_unique<CacheLine>(address & ~(line_size_ - 1), line_size_);
-            line->valid = true;
-            line->access_time = access_count_;
-            return line.get();
+    // Prefer an empty way, otherwise ask the replacement policy
+    size_t way = associativity_;
+    for (size_t w = 0; w < associativity_; ++w) {
+        if (!valid_[base + w]) {
+            way = w;
+            break;
         }
     }
+    if (way == associativity_) {
+        way = policy_.select_victim(set);
+    }
     
-    // No empty slot, evict LRU
-    auto lru_it = std::min_element(set.begin(), set.end(),
-        [](const auto& a, const auto& b) {
-            if (!a || !a->valid) return true;
-            if (!b || !b->valid) return false;
-            return a->access_time < b->access_time;
-        });
+    size_t victim = base + way;
+    if (eviction) {
+        // Report a dirty victim; its data stays in the slab until refilled
+        eviction->dirty = valid_[victim] && dirty_[victim];
+        eviction->address = line_address(victim);
+        if (eviction->dirty) {
+            writeback_count_++;
+        }
+    }
     
-    *lru_it = std::make_unique<CacheLine>(address & ~(line_size_ - 1), line_size_);
-    (*lru_it)->valid = true;
-    (*lru_it)->access_time = access_count_;
-    return lru_it->get();
+    tags_[victim] = get_tag(address);
+    valid_[victim] = 1;
+    dirty_[victim] = 0;
+    policy_.on_fill(set, way);
+    return victim;
 }
 
-bool GPUCache::read(uint64_t address, void* data, size_t size) {
+template <typename Policy>
+size_t GPUCache<Policy>::access_line(uint64_t address) {
     access_count_++;
     
-    CacheLine* line = find_line(address);
-    if (line) {
-        // Cache hit
+    size_t slot = find_line(address);
+    if (slot != INVALID_SLOT) {
         hit_count_++;
+        policy_.on_hit(slot / associativity_, slot % associativity_);
+    } else {
+        miss_count_++;
+    }
+    return slot;
+}
+
+template <typename Policy>
+uint8_t* GPUCache<Policy>::lookup_line(uint64_t address, bool mark_dirty) {
+    size_t slot = access_line(address);
+    if (slot == INVALID_SLOT) {
+        return nullptr;
+    }
+    
+    if (mark_dirty) {
+        dirty_[slot] = 1;
+    }
+    return line_data(slot);
+}
+
+template <typename Policy>
+uint8_t* GPUCache<Policy>::install_line(uint64_t address, bool mark_dirty,
+                                        LineEviction* eviction) {
+    size_t slot = allocate_line(address, eviction);
+    dirty_[slot] = mark_dirty ? 1 : 0;
+    return line_data(slot);
+}
+
+template <typename Policy>
+bool GPUCache<Policy>::read(uint64_t address, void* data, size_t size) {
+    uint8_t* dst = static_cast<uint8_t*>(data);
+    bool hit = true;
+    
+    // An access may span several lines; it hits only if every line is resident
+    while (size > 0) {
         size_t offset = address % line_size_;
         size_t copy_size = std::min(size, line_size_ - offset);
-        std::memcpy(data, line->data.data() + offset, copy_size);
-        return true;
+        
+        uint8_t* line = lookup_line(address);
+        if (line) {
+            std::memcpy(dst, line + offset, copy_size);
+        } else {
+            hit = false;
+        }
+        
+        dst += copy_size;
+        address += copy_size;
+        size -= copy_size;
     }
     
-    // Cache miss
-    miss_count_++;
-    return false;
+    return hit;
 }
 
-bool GPUCache::write(uint64_t address, const void* data, size_t size) {
-    access_count_++;
+template <typename Policy>
+bool GPUCache<Policy>::write(uint64_t address, const void* data, size_t size) {
+    const uint8_t* src = static_cast<const uint8_t*>(data);
     
-    CacheLine* line = find_line(address);
-    if (!line) {
-        // Allocate new line on write miss
-        line = allocate_line(address);
-        miss_count_++;
-    } else {
-        hit_count_++;
+    while (size > 0) {
+        size_t offset = address % line_size_;
+        size_t copy_size = std::min(size, line_size_ - offset);
+        
+        // Allocate a zeroed line on write miss
+        size_t slot = access_line(address);
+        if (slot == INVALID_SLOT) {
+            slot = allocate_line(address);
+            std::memset(line_data(slot), 0, line_size_);
+        }
+        
+        std::memcpy(line_data(slot) + offset, src, copy_size);
+        dirty_[slot] = 1;
+        
+        src += copy_size;
+        address += copy_size;
+        size -= copy_size;
+    }
+    
+    return true;
+}
+
+template <typename Policy>
+void GPUCache<Policy>::invalidate(uint64_t address) {
+    size_t slot = find_line(address);
+    if (slot != INVALID_SLOT) {
+        valid_[slot] = 0;
+        dirty_[slot] = 0;
+    }
+}
+
+template <typename Policy>
+void GPUCache<Policy>::flush() {
+    std::fill(valid_.begin(), valid_.end(), 0);
+    std::fill(dirty_.begin(), dirty_.end(), 0);
+}
+
+template <typename Policy>
+double GPUCache<Policy>::get_hit_rate() const {
+    if (access_count_ == 0) return 0.0;
+    return static_cast<double>(hit_count_) / access_count_;
+}
+
+template class GPUCache<LRUPolicy>;
+template class GPUCache<TreePLRUPolicy>;
+template class GPUCache<SRRIPPolicy>;
+template class GPUCache<BRRIPPolicy>;
+template class GPUCache<RandomPolicy>;
+
+// VRAMStore implementation
+VRAMStore::VRAMStore(uint64_t capacity, size_t page_size)
+    : capacity_(capacity), page_size_(1), page_shift_(0), resident_pages_(0) {
+    
+    // Power-of-two pages, so addresses split with a shift and a mask
+    if (page_size == 0) {
+        page_size = DEFAULT_PAGE_SIZE;
+    }
+    while (page_size_ < page_size) {
+        page_size_ <<= 1;
+        page_shift_++;
     }
     
-    size_t offset = address % line_size_;
-    size_t copy_size = std::min(size, line_size_ - offset);
-    std::memcpy(line->data.data() + offset, data, copy_size);
-    line->dirty = true;
+    // Page table only; page storage is allocated lazily on first write
+    pages_.resize((capacity_ + page_size_ - 1) >> page_shift_);
+}
+
+bool VRAMStore::in_bounds(uint64_t address, size_t size) const {
+    return address <= capacity_ && size <= capacity_ - address;
+}
+
+bool VRAMStore::read(uint64_t address, void* data, size_t size) const {
+    if (!in_bounds(address, size)) {
+        return false;
+    }
     
+    uint8_t* dst = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        uint64_t page_index = address >> page_shift_;
+        size_t page_offset = static_cast<size_t>(address & (page_size_ - 1));
+        size_t chunk = std::min(size, page_size_ - page_offset);
+        
+        const auto& page = pages_[page_index];
+        if (page) {
+            std::memcpy(dst, page.get() + page_offset, chunk);
+        } else {
+            std::memset(dst, 0, chunk); // Untouched memory reads as zero
+        }
+        
+        dst += chunk;
+        address += chunk;
+        size -= chunk;
+    }
     return true;
 }
 
-void GPUCache::invalidate(uint64_t address) {
-    CacheLine* line = find_line(address);
-    if (line) {
-        line->valid = false;
-        line->dirty = false;
+bool VRAMStore::write(uint64_t address, const void* data, size_t size) {
+    if (!in_bounds(address, size)) {
+        return false;
     }
+    
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        uint64_t page_index = address >> page_shift_;
+        size_t page_offset = static_cast<size_t>(address & (page_size_ - 1));
+        size_t chunk = std::min(size, page_size_ - page_offset);
+        
+        auto& page = pages_[page_index];
+        if (!page) {
+            page.reset(new uint8_t[page_size_]());
+            resident_pages_++;
+        }
+        std::memcpy(page.get() + page_offset, src, chunk);
+        
+        src += chunk;
+        address += chunk;
+        size -= chunk;
+    }
+    return true;
 }
 
-void GPUCache::flush() {
-    for (auto& set : cache_sets_) {
-        for (auto& line : set) {
-            if (line) {
-                line->valid = false;
-                line->dirty = false;
-            }
+// BuddyAllocator implementation
+BuddyAllocator::BuddyAllocator(uint64_t base, uint64_t limit)
+    : free_lists_(MAX_ORDER + 1), bytes_requested_(0), bytes_allocated_(0),
+      peak_bytes_allocated_(0), free_bytes_(0) {
+    
+    // Carve [base, limit) into the largest blocks aligned to their own size
+    uint64_t min_block = 1ULL << MIN_ORDER;
+    uint64_t address = (base + min_block - 1) & ~(min_block - 1);
+    while (address < limit && limit - address >= min_block) {
+        uint32_t order = MIN_ORDER;
+        while (order < MAX_ORDER &&
+               (address & ((1ULL << (order + 1)) - 1)) == 0 &&
+               limit - address >= (1ULL << (order + 1))) {
+            order++;
         }
+        free_lists_[order].insert(address);
+        free_bytes_ += 1ULL << order;
+        address += 1ULL << order;
     }
 }
 
-double GPUCache::get_hit_rate() const {
-    if (access_count_ == 0) return 0.0;
-    return static_cast<double>(hit_count_) / access_count_;
+uint32_t BuddyAllocator::order_for_size(uint64_t size) {
+    uint32_t order = MIN_ORDER;
+    while (order < MAX_ORDER && (1ULL << order) < size) {
+        order++;
+    }
+    return order;
+}
+
+uint64_t BuddyAllocator::allocate(size_t size) {
+    uint32_t order = order_for_size(size);
+    
+    // Smallest free block that fits
+    uint32_t block_order = order;
+    while (block_order <= MAX_ORDER && free_lists_[block_order].empty()) {
+        block_order++;
+    }
+    if (block_order > MAX_ORDER) {
+        return 0; // Out of memory
+    }
+    
+    uint64_t address = *free_lists_[block_order].begin();
+    free_lists_[block_order].erase(free_lists_[block_order].begin());
+    
+    // Split down, returning upper halves to the free lists
+    while (block_order > order) {
+        block_order--;
+        free_lists_[block_order].insert(address + (1ULL << block_order));
+    }
+    
+    allocations_[address] = {order, size};
+    bytes_requested_ += size;
+    bytes_allocated_ += 1ULL << order;
+    free_bytes_ -= 1ULL << order;
+    peak_bytes_allocated_ = std::max(peak_bytes_allocated_, bytes_allocated_);
+    
+    return address;
+}
+
+uint64_t BuddyAllocator::free(uint64_t address) {
+    auto it = allocations_.find(address);
+    if (it == allocations_.end()) {
+        return 0;
+    }
+    
+    uint32_t order = it->second.order;
+    uint64_t block_size = 1ULL << order;
+    bytes_requested_ -= it->second.requested;
+    bytes_allocated_ -= block_size;
+    free_bytes_ += block_size;
+    allocations_.erase(it);
+    
+    // Coalesce with free buddies
+    while (order < MAX_ORDER) {
+        uint64_t buddy = address ^ (1ULL << order);
+        auto buddy_it = free_lists_[order].find(buddy);
+        if (buddy_it == free_lists_[order].end()) {
+            break;
+        }
+        free_lists_[order].erase(buddy_it);
+        address = std::min(address, buddy);
+        order++;
+    }
+    free_lists_[order].insert(address);
+    
+    return block_size;
+}
+
+BuddyAllocator::AllocatorStats BuddyAllocator::get_statistics() const {
+    AllocatorStats stats;
+    stats.live_allocations = allocations_.size();
+    stats.bytes_requested = bytes_requested_;
+    stats.bytes_allocated = bytes_allocated_;
+    stats.peak_bytes_allocated = peak_bytes_allocated_;
+    stats.free_bytes = free_bytes_;
+    
+    stats.largest_free_block = 0;
+    for (uint32_t order = MAX_ORDER + 1; order-- > MIN_ORDER;) {
+        if (!free_lists_[order].empty()) {
+            stats.largest_free_block = 1ULL << order;
+            break;
+        }
+    }
+    
+    stats.external_fragmentation = free_bytes_ > 0 ?
+        1.0 - static_cast<double>(stats.largest_free_block) / free_bytes_ : 0.0;
+    stats.internal_fragmentation = bytes_allocated_ > 0 ?
+        1.0 - static_cast<double>(bytes_requested_) / bytes_allocated_ : 0.0;
+    
+    return stats;
+}
+
+// LatencyHistogram implementation
+void LatencyHistogram::record(uint64_t cycles) {
+    size_t bucket = 0;
+    while (bucket + 1 < NUM_BUCKETS && (cycles >> (bucket + 1)) != 0) {
+        bucket++;
+    }
+    
+    buckets[bucket]++;
+    samples++;
+    total_cycles += cycles;
+    max_cycles = std::max(max_cycles, cycles);
 }
 
 // MemoryHierarchy implementation
-MemoryHierarchy::MemoryHierarchy()
-    : next_allocation_address_(0x10000000) { // Start allocations at 256MB
+namespace {
+
+CacheLevel make_cache_level(ReplacementPolicy policy, size_t cache_size,
+                            size_t line_size, size_t associativity) {
+    switch (policy) {
+        case ReplacementPolicy::TREE_PLRU:
+            return CacheLevel(std::in_place_type<GPUCache<TreePLRUPolicy>>, cache_size, line_size, associativity);
+        case ReplacementPolicy::SRRIP:
+            return CacheLevel(std::in_place_type<GPUCache<SRRIPPolicy>>, cache_size, line_size, associativity);
+        case ReplacementPolicy::BRRIP:
+            return CacheLevel(std::in_place_type<GPUCache<BRRIPPolicy>>, cache_size, line_size, associativity);
+        case ReplacementPolicy::RANDOM:
+            return CacheLevel(std::in_place_type<GPUCache<RandomPolicy>>, cache_size, line_size, associativity);
+        case ReplacementPolicy::LRU:
+        default:
+            return CacheLevel(std::in_place_type<GPUCache<LRUPolicy>>, cache_size, line_size, associativity);
+    }
+}
+
+} // namespace
+
+MemoryHierarchy::MemoryHierarchy(const MemoryConfig& config)
+    : vram_(config.vram_size, config.vram_page_size),
+      write_policy_(config.write_policy), write_allocate_(config.write_allocate),
+      level_latencies_{config.l1_latency, config.l2_latency},
+      vram_latency_(config.vram_latency),
+      vram_bytes_per_cycle_(std::max(1u, config.vram_bytes_per_cycle)),
+      current_cycle_(0), vram_busy_until_(0), vram_queue_cycles_(0),
+      vram_reads_(0), vram_writes_(0), vram_bytes_read_(0), vram_bytes_written_(0),
+      // Start allocations at 256MB (or half of a smaller VRAM)
+      allocator_(std::min<uint64_t>(0x10000000, config.vram_size / 2), config.vram_size) {
+    
+    cache_levels_.reserve(2);
+    cache_levels_.push_back(make_cache_level(config.l1_policy, config.l1_size,
+                                             config.l1_line_size, config.l1_associativity));
+    cache_levels_.push_back(make_cache_level(config.l2_policy, config.l2_size,
+                                             config.l2_line_size, config.l2_associativity));
+    level_histograms_.resize(cache_levels_.size());
+}
+
+size_t MemoryHierarchy::get_line_size(size_t level) const {
+    return std::visit([](const auto& cache) { return cache.get_line_size(); }, cache_levels_[level]);
+}
+
+uint8_t* MemoryHierarchy::lookup_line(size_t level, uint64_t line_address, bool mark_dirty) {
+    return std::visit([&](auto& cache) {
+        return cache.lookup_line(line_address, mark_dirty);
+    }, cache_levels_[level]);
+}
+
+uint8_t* MemoryHierarchy::fill_line(size_t level, uint64_t line_address, bool fetch, bool mark_dirty,
+                                    uint64_t& cycle) {
+    return std::visit([&](auto& cache) {
+        LineEviction eviction;
+        uint8_t* line = cache.install_line(line_address, mark_dirty, &eviction);
+        size_t line_size = cache.get_line_size();
+        
+        // Write the dirty victim back before its storage is reused. The
+        // writeback is posted: it occupies the lower levels but is not waited on.
+        if (eviction.dirty) {
+            write_level(level + 1, eviction.address, line, line_size, cycle);
+        }
+        if (fetch) {
+            cycle = read_through(level + 1, line_address, line, line_size, cycle);
+        }
+        return line;
+    }, cache_levels_[level]);
+}
+
+uint8_t* MemoryHierarchy::acquire_line(size_t level, uint64_t line_address, uint64_t& cycle) {
+    uint64_t issue_cycle = cycle;
+    cycle += level_latencies_[level];
+    
+    uint8_t* line = lookup_line(level, line_address, false);
+    if (!line) {
+        line = fill_line(level, line_address, true, false, cycle);
+    }
     
-    // Initialize L1 cache: 32KB, 64-byte lines, 4-way associative
-    l1_cache_ = std::make_unique<GPUCache>(32 * 1024, 64, 4);
+    level_histograms_[level].record(cycle - issue_cycle);
+    return line;
+}
+
+uint64_t MemoryHierarchy::schedule_vram(uint64_t cycle, size_t size) {
+    // Single channel: a transfer starts once the previous one has drained
+    uint64_t start = std::max(cycle, vram_busy_until_);
+    uint64_t transfer = (size + vram_bytes_per_cycle_ - 1) / vram_bytes_per_cycle_;
     
-    // Initialize L2 cache: 512KB, 128-byte lines, 8-way associative
-    l2_cache_ = std::make_unique<GPUCache>(512 * 1024, 128, 8);
+    vram_queue_cycles_ += start - cycle;
+    vram_busy_until_ = start + transfer;
     
-    // Initialize VRAM: 4GB simulation
-    vram_.resize(4ULL * 1024 * 1024 * 1024);
+    uint64_t completion = start + transfer + vram_latency_;
+    vram_histogram_.record(completion - cycle);
+    return completion;
 }
 
-bool MemoryHierarchy::read(uint64_t address, void* data, size_t size) {
-    // Try L1 cache first
-    if (l1_cache_->read(address, data, size)) {
-        return true;
+uint64_t MemoryHierarchy::read_through(size_t level, uint64_t address, uint8_t* data, size_t size,
+                                       uint64_t cycle) {
+    if (level >= cache_levels_.size()) {
+        vram_reads_++;
+        vram_bytes_read_ += size;
+        
+        // Line fills that run past the end of VRAM read as zero
+        if (!vram_.read(address, data, size)) {
+            std::memset(data, 0, size);
+        }
+        return schedule_vram(cycle, size);
     }
     
-    // Try L2 cache
-    if (l2_cache_->read(address, data, size)) {
-        // Load into L1
-        l1_cache_->write(address, data, size);
-        return true;
+    // Lines of one access are issued together; the access completes with the last
+    uint64_t completion = cycle;
+    size_t line_size = get_line_size(level);
+    while (size > 0) {
+        uint64_t line_address = address & ~(line_size - 1);
+        size_t offset = address - line_address;
+        size_t chunk = std::min(size, line_size - offset);
+        
+        uint64_t line_cycle = cycle;
+        std::memcpy(data, acquire_line(level, line_address, line_cycle) + offset, chunk);
+        completion = std::max(completion, line_cycle);
+        
+        data += chunk;
+        address += chunk;
+        size -= chunk;
     }
+    return completion;
+}
+
+uint64_t MemoryHierarchy::write_level(size_t level, uint64_t address, const uint8_t* data, size_t size,
+                                      uint64_t cycle) {
+    if (level >= cache_levels_.size()) {
+        vram_writes_++;
+        vram_bytes_written_ += size;
+        vram_.write(address, data, size);
+        return schedule_vram(cycle, size);
+    }
+    
+    bool write_back = (write_policy_ == WritePolicy::WRITE_BACK);
+    uint64_t completion = cycle;
     
-    // Read from VRAM
-    if (address + size <= vram_.size()) {
-        std::memcpy(data, vram_.data() + address, size);
+    size_t line_size = get_line_size(level);
+    uint64_t current = address;
+    const uint8_t* src = data;
+    size_t remaining = size;
+    while (remaining > 0) {
+        uint64_t line_address = current & ~(line_size - 1);
+        size_t offset = current - line_address;
+        size_t chunk = std::min(remaining, line_size - offset);
         
-        // Load into caches
-        l2_cache_->write(address, data, size);
-        l1_cache_->write(address, data, size);
-        return true;
+        uint64_t line_cycle = cycle + level_latencies_[level];
+        uint8_t* line = lookup_line(level, line_address, write_back);
+        if (!line && write_allocate_) {
+            // Fetch the rest of the line unless the store covers all of it
+            line = fill_line(level, line_address, chunk < line_size, write_back, line_cycle);
+        }
+        
+        if (line) {
+            std::memcpy(line + offset, src, chunk);
+        } else if (write_back) {
+            // No-write-allocate: the store bypasses this level
+            line_cycle = write_level(level + 1, current, src, chunk, line_cycle);
+        }
+        
+        level_histograms_[level].record(line_cycle - cycle);
+        completion = std::max(completion, line_cycle);
+        
+        src += chunk;
+        current += chunk;
+        remaining -= chunk;
     }
     
-    return false;
+    if (!write_back) {
+        // A write-through store completes when the last level has it
+        completion = std::max(completion,
+                              write_level(level + 1, address, data, size, cycle + level_latencies_[level]));
+    }
+    return completion;
+}
+
+uint64_t MemoryHierarchy::begin_access(const MemoryTiming* timing) const {
+    return timing ? timing->issue_cycle : current_cycle_;
+}
+
+void MemoryHierarchy::end_access(MemoryTiming* timing, uint64_t issue_cycle, uint64_t completion_cycle) {
+    if (timing) {
+        timing->latency_cycles = completion_cycle - issue_cycle;
+    } else {
+        current_cycle_ = completion_cycle;
+    }
 }
 
-bool MemoryHierarchy::write(uint64_t address, const void* data, size_t size) {
-    // Write through to all levels
-    l1_cache_->write(address, data, size);
-    l2_cache_->write(address, data, size);
+bool MemoryHierarchy::read(uint64_t address, void* data, size_t size, MemoryTiming* timing) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!vram_.in_bounds(address, size)) {
+        return false;
+    }
     
-    // Write to VRAM
-    if (address + size <= vram_.size()) {
-        std::memcpy(vram_.data() + address, data, size);
-        return true;
+    uint64_t issue_cycle = begin_access(timing);
+    uint64_t completion = read_through(0, address, static_cast<uint8_t*>(data), size, issue_cycle);
+    end_access(timing, issue_cycle, completion);
+    return true;
+}
+
+bool MemoryHierarchy::write(uint64_t address, const void* data, size_t size, MemoryTiming* timing) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!vram_.in_bounds(address, size)) {
+        return false;
     }
     
-    return false;
+    uint64_t issue_cycle = begin_access(timing);
+    uint64_t completion = write_level(0, address, static_cast<const uint8_t*>(data), size, issue_cycle);
+    end_access(timing, issue_cycle, completion);
+    return true;
 }
 
-uint64_t MemoryHierarchy::allocate(size_t size) {
-    uint64_t address = next_allocation_address_;
+template <typename Request>
+bool MemoryHierarchy::build_line_segments(const std::vector<Request>& requests) {
+    size_t line_size = get_line_size(0);
+    bool all_in_bounds = true;
     
-    // Align to 16-byte boundary
-    size = (size + 15) & ~15ULL;
+    batch_segments_.clear();
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const auto& request = requests[i];
+        if (!vram_.in_bounds(request.address, request.size)) {
+            all_in_bounds = false;
+            continue;
+        }
+        
+        uint64_t address = request.address;
+        size_t request_offset = 0;
+        while (request_offset < request.size) {
+            uint64_t line_address = address & ~(line_size - 1);
+            size_t line_offset = address - line_address;
+            size_t chunk = std::min(request.size - request_offset, line_size - line_offset);
+            
+            batch_segments_.push_back({line_address, line_offset, chunk, request_offset, i});
+            
+            address += chunk;
+            request_offset += chunk;
+        }
+    }
     
-    if (address + size > vram_.size()) {
-        return 0; // Out of memory
+    // Group by line; ties keep request order so overlapping writes apply in order
+    std::sort(batch_segments_.begin(), batch_segments_.end(),
+        [](const LineSegment& a, const LineSegment& b) {
+            if (a.line_address != b.line_address) return a.line_address < b.line_address;
+            if (a.request_index != b.request_index) return a.request_index < b.request_index;
+            return a.request_offset < b.request_offset;
+        });
+    
+    return all_in_bounds;
+}
+
+bool MemoryHierarchy::read_batch(const std::vector<MemoryReadRequest>& requests, MemoryTiming* timing) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool all_in_bounds = build_line_segments(requests);
+    uint64_t issue_cycle = begin_access(timing);
+    uint64_t completion = issue_cycle;
+    
+    size_t i = 0;
+    while (i < batch_segments_.size()) {
+        uint64_t line_address = batch_segments_[i].line_address;
+        uint64_t line_cycle = issue_cycle;
+        uint8_t* line = acquire_line(0, line_address, line_cycle);
+        completion = std::max(completion, line_cycle);
+        
+        for (; i < batch_segments_.size() && batch_segments_[i].line_address == line_address; ++i) {
+            const auto& segment = batch_segments_[i];
+            uint8_t* dst = static_cast<uint8_t*>(requests[segment.request_index].data);
+            std::memcpy(dst + segment.request_offset, line + segment.line_offset, segment.size);
+        }
     }
     
-    allocations_[address] = size;
-    next_allocation_address_ += size;
+    end_access(timing, issue_cycle, completion);
+    return all_in_bounds;
+}
+
+bool MemoryHierarchy::write_batch(const std::vector<MemoryWriteRequest>& requests, MemoryTiming* timing) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool all_in_bounds = build_line_segments(requests);
+    bool write_back = (write_policy_ == WritePolicy::WRITE_BACK);
+    size_t line_size = get_line_size(0);
+    uint64_t issue_cycle = begin_access(timing);
+    uint64_t completion = issue_cycle;
     
-    return address;
+    size_t i = 0;
+    while (i < batch_segments_.size()) {
+        uint64_t line_address = batch_segments_[i].line_address;
+        size_t group_end = i;
+        while (group_end < batch_segments_.size() &&
+               batch_segments_[group_end].line_address == line_address) {
+            group_end++;
+        }
+        
+        uint64_t line_cycle = issue_cycle + level_latencies_[0];
+        uint8_t* line = lookup_line(0, line_address, write_back);
+        if (!line && write_allocate_) {
+            line = fill_line(0, line_address, true, write_back, line_cycle);
+        }
+        
+        if (!line) {
+            // No-write-allocate miss: each store goes straight to the next level
+            for (; i < group_end; ++i) {
+                const auto& segment = batch_segments_[i];
+                const uint8_t* src = static_cast<const uint8_t*>(requests[segment.request_index].data);
+                completion = std::max(completion,
+                                      write_level(1, line_address + segment.line_offset,
+                                                  src + segment.request_offset, segment.size, line_cycle));
+            }
+            continue;
+        }
+        
+        // Merge every store to this line, then write the touched span through once
+        size_t dirty_begin = line_size;
+        size_t dirty_end = 0;
+        for (; i < group_end; ++i) {
+            const auto& segment = batch_segments_[i];
+            const uint8_t* src = static_cast<const uint8_t*>(requests[segment.request_index].data);
+            std::memcpy(line + segment.line_offset, src + segment.request_offset, segment.size);
+            
+            dirty_begin = std::min(dirty_begin, segment.line_offset);
+            dirty_end = std::max(dirty_end, segment.line_offset + segment.size);
+        }
+        
+        if (!write_back) {
+            line_cycle = std::max(line_cycle,
+                                  write_level(1, line_address + dirty_begin, line + dirty_begin,
+                                              dirty_end - dirty_begin, issue_cycle + level_latencies_[0]));
+        }
+        level_histograms_[0].record(line_cycle - issue_cycle);
+        completion = std::max(completion, line_cycle);
+    }
+    
+    end_access(timing, issue_cycle, completion);
+    return all_in_bounds;
+}
+
+uint64_t MemoryHierarchy::allocate(size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocator_.allocate(size);
+}
+
+BuddyAllocator::AllocatorStats MemoryHierarchy::get_allocator_statistics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocator_.get_statistics();
 }
 
 void MemoryHierarchy::deallocate(uint64_t address) {
-    auto it = allocations_.find(address);
-    if (it != allocations_.end()) {
-        // Invalidate cache lines for this allocation
-        size_t size = it->second;
-        for (uint64_t addr = address; addr < address + size; addr += 64) {
-            l1_cache_->invalidate(addr);
-            l2_cache_->invalidate(addr);
-        }
-        allocations_.erase(it);
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t size = allocator_.free(address);
+    if (size == 0) {
+        return;
+    }
+    
+    // Invalidate cache lines for this allocation at each level's line size
+    for (auto& level : cache_levels_) {
+        std::visit([&](auto& cache) {
+            size_t line_size = cache.get_line_size();
+            uint64_t first_line = address & ~(line_size - 1);
+            for (uint64_t addr = first_line; addr < address + size; addr += line_size) {
+                cache.invalidate(addr);
+            }
+        }, level);
     }
 }
 
 void MemoryHierarchy::flush_all_caches() {
-    l1_cache_->flush();
-    l2_cache_->flush();
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Drain dirty lines level by level so L1 data passes through L2 to VRAM
+    for (size_t level = 0; level < cache_levels_.size(); ++level) {
+        std::visit([&](auto& cache) {
+            cache.write_back_dirty_lines([&](uint64_t address, const uint8_t* data, size_t size) {
+                current_cycle_ = std::max(current_cycle_,
+                                          write_level(level + 1, address, data, size, current_cycle_));
+            });
+        }, cache_levels_[level]);
+    }
+    
+    for (auto& level : cache_levels_) {
+        std::visit([](auto& cache) { cache.flush(); }, level);
+    }
 }
 
 MemoryHierarchy::MemoryStats MemoryHierarchy::get_statistics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
     MemoryStats stats;
-    stats.l1_hits = l1_cache_->get_hit_count();
-    stats.l1_misses = l1_cache_->get_miss_count();
-    stats.l2_hits = l2_cache_->get_hit_count();
-    stats.l2_misses = l2_cache_->get_miss_count();
-    stats.vram_accesses = stats.l2_misses; // VRAM accessed on L2 miss
-    
-    // Calculate average access latency
-    uint64_t total_accesses = stats.l1_hits + stats.l1_misses;
-    if (total_accesses > 0) {
-        double l1_contribution = (static_cast<double>(stats.l1_hits) / total_accesses) * L1_LATENCY;
-        double l2_contribution = (static_cast<double>(stats.l2_hits) / total_accesses) * L2_LATENCY;
-        double vram_contribution = (static_cast<double>(stats.vram_accesses) / total_accesses) * VRAM_LATENCY;
-        stats.avg_access_latency = l1_contribution + l2_contribution + vram_contribution;
-    } else {
-        stats.avg_access_latency = 0.0;
-    }
+    auto hits = [](const auto& cache) { return cache.get_hit_count(); };
+    auto misses = [](const auto& cache) { return cache.get_miss_count(); };
+    stats.l1_hits = std::visit(hits, cache_levels_[0]);
+    stats.l1_misses = std::visit(misses, cache_levels_[0]);
+    stats.l2_hits = std::visit(hits, cache_levels_[1]);
+    stats.l2_misses = std::visit(misses, cache_levels_[1]);
+    auto writebacks = [](const auto& cache) { return cache.get_writeback_count(); };
+    stats.l1_writebacks = std::visit(writebacks, cache_levels_[0]);
+    stats.l2_writebacks = std::visit(writebacks, cache_levels_[1]);
+    stats.vram_reads = vram_reads_;
+    stats.vram_writes = vram_writes_;
+    stats.vram_bytes_read = vram_bytes_read_;
+    stats.vram_bytes_written = vram_bytes_written_;
+    stats.vram_accesses = vram_reads_ + vram_writes_;
+    stats.vram_resident_pages = vram_.get_resident_pages();
+    
+    stats.vram_queue_cycles = vram_queue_cycles_;
+    
+    stats.l1_latency = level_histograms_[0];
+    stats.l2_latency = level_histograms_[1];
+    stats.vram_latency = vram_histogram_;
+    stats.avg_access_latency = stats.l1_latency.mean();
     
     return stats;
 }
 
+uint64_t MemoryHierarchy::get_current_cycle() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return current_cycle_;
+}
+
 } // namespace gpu_sim
\ No newline at end of file
@@ -1,57 +1,478 @@
 #include "performance_monitor.h"
 #include <algorithm>
-#include <numeric>
 #include <iostream>
 #include <iomanip>
+#include <cmath>
+#include <map>
+#include <cstdio>
 
 namespace gpu_sim {
 
+namespace {
+
+std::atomic<uint64_t> next_instance_id{1};
+
+uint64_t nanoseconds_since(std::chrono::high_resolution_clock::time_point origin,
+                           std::chrono::high_resolution_clock::time_point when) {
+    if (when <= origin) {
+        return 0;
+    }
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(when - origin).count());
+}
+
+void write_json_string(std::ostream& out, const std::string& text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) >= 0x20) {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+} // namespace
+
+const double QuantileSketch::LOG_BUCKET_GROWTH = std::log(QuantileSketch::BUCKET_GROWTH);
+
+QuantileSketch::QuantileSketch()
+    : buckets_(BUCKET_COUNT, 0), count_(0), min_ms_(0.0), max_ms_(0.0) {
+}
+
+void QuantileSketch::record(double value_ms) {
+    size_t bucket = 0;
+    if (value_ms > MIN_VALUE_MS) {
+        double index = std::log(value_ms / MIN_VALUE_MS) / LOG_BUCKET_GROWTH;
+        bucket = std::min(static_cast<size_t>(index), BUCKET_COUNT - 1);
+    }
+    buckets_[bucket]++;
+    
+    min_ms_ = count_ == 0 ? value_ms : std::min(min_ms_, value_ms);
+    max_ms_ = count_ == 0 ? value_ms : std::max(max_ms_, value_ms);
+    count_++;
+}
+
+void QuantileSketch::clear() {
+    std::fill(buckets_.begin(), buckets_.end(), 0);
+    count_ = 0;
+    min_ms_ = 0.0;
+    max_ms_ = 0.0;
+}
+
+double QuantileSketch::quantile(double q) const {
+    if (count_ == 0) {
+        return 0.0;
+    }
+    
+    // Nearest-rank: the smallest sample with at least q of all samples at or below it
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * count_));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        seen += buckets_[bucket];
+        if (seen >= rank) {
+            // Geometric midpoint of the bucket, kept inside the observed range
+            double value = MIN_VALUE_MS * std::exp((bucket + 0.5) * LOG_BUCKET_GROWTH);
+            return std::clamp(value, min_ms_, max_ms_);
+        }
+    }
+    return max_ms_;
+}
+
 PerformanceMonitor::PerformanceMonitor() 
-    : real_time_monitoring_(false), max_history_size_(1000) {
+    : instance_id_(next_instance_id.fetch_add(1, std::memory_order_relaxed)),
+      frame_history_(DEFAULT_HISTORY_SIZE),
+      tracing_(false), trace_event_limit_(0), trace_events_accepted_(0),
+      trace_events_written_(0), trace_events_dropped_(0), trace_stopping_(false),
+      profiling_enabled_(false), real_time_monitoring_(false), max_history_size_(DEFAULT_HISTORY_SIZE) {
 }
 
-void PerformanceMonitor::start_timer(const std::string& event) {
-    start_times_[event] = std::chrono::high_resolution_clock::now();
+PerformanceMonitor::CounterId PerformanceMonitor::register_counter(const std::string& counter) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = counter_ids_.find(counter);
+    if (it != counter_ids_.end()) {
+        return it->second;
+    }
+    CounterId id = allocate_counter(counter);
+    counter_ids_.emplace(counter, id);
+    return id;
 }
 
-void PerformanceMonitor::end_timer(const std::string& event) {
-    auto end_time = std::chrono::high_resolution_clock::now();
-    auto it = start_times_.find(event);
+PerformanceMonitor::CacheId PerformanceMonitor::register_cache(const std::string& cache) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = cache_ids_.find(cache);
+    if (it != cache_ids_.end()) {
+        return it->second;
+    }
+    CacheId id{allocate_counter(std::string()), allocate_counter(std::string())};
+    cache_ids_.emplace(cache, id);
+    return id;
+}
+
+PerformanceMonitor::TimerId PerformanceMonitor::register_timer(const std::string& event) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = timer_ids_.find(event);
+    if (it != timer_ids_.end()) {
+        return it->second;
+    }
+    TimerId id = static_cast<TimerId>(timer_names_.size());
+    timer_names_.push_back(event);
+    timers_.emplace_back(max_history_size_);
+    timer_ids_.emplace(event, id);
+    return id;
+}
+
+PerformanceMonitor::CounterId PerformanceMonitor::allocate_counter(const std::string& name) {
+    CounterId id = static_cast<CounterId>(counter_names_.size());
+    counter_names_.push_back(name);
+    counter_bases_.push_back(0);
+    return id;
+}
+
+PerformanceMonitor::ThreadState& PerformanceMonitor::local_state() {
+    // Small per-thread cache of recently used monitors, keyed by instance id
+    // so a destroyed monitor's entry can never match a new one
+    struct CachedState {
+        uint64_t instance_id = 0;
+        ThreadState* state = nullptr;
+    };
+    thread_local CachedState cache[4];
+    
+    CachedState& cached = cache[instance_id_ % 4];
+    if (cached.instance_id != instance_id_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& state = thread_states_[std::this_thread::get_id()];
+        if (!state) {
+            state = std::make_unique<ThreadState>();
+            state->thread_index = static_cast<uint32_t>(thread_states_.size());
+            if (tracing_.load(std::memory_order_relaxed)) {
+                state->trace.events = std::make_unique<TraceEvent[]>(TRACE_BUFFER_EVENTS);
+            }
+        }
+        cached.instance_id = instance_id_;
+        cached.state = state.get();
+    }
+    return *cached.state;
+}
+
+uint32_t PerformanceMonitor::enter_scope(TimerId timer, std::chrono::high_resolution_clock::time_point& start_time) {
+    ThreadProfile& profile = local_state().profile;
+    uint32_t node = 0;
+    {
+        std::lock_guard<std::mutex> lock(profile.mutex);
+        uint32_t parent = profile.open_scopes.empty() ? NO_PARENT : profile.open_scopes.back();
+        uint64_t key = (static_cast<uint64_t>(parent) << 32) | timer;
+        auto it = profile.node_index.find(key);
+        if (it != profile.node_index.end()) {
+            node = it->second;
+        } else {
+            node = static_cast<uint32_t>(profile.nodes.size());
+            ProfileNode created;
+            created.timer = timer;
+            created.parent = parent;
+            profile.nodes.push_back(created);
+            profile.node_index.emplace(key, node);
+        }
+        profile.open_scopes.push_back(node);
+    }
+    // Taken last so the bookkeeping above is not charged to the scope
+    start_time = std::chrono::high_resolution_clock::now();
+    return node;
+}
+
+void PerformanceMonitor::exit_scope(uint32_t node, std::chrono::high_resolution_clock::time_point start_time,
+                                    std::chrono::high_resolution_clock::time_point end_time) {
+    double duration = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    ThreadProfile& profile = local_state().profile;
+    TimerId timer = 0;
+    {
+        std::lock_guard<std::mutex> lock(profile.mutex);
+        ProfileNode& scope = profile.nodes[node];
+        scope.calls++;
+        scope.total_ms += duration;
+        if (scope.parent != NO_PARENT) {
+            profile.nodes[scope.parent].child_ms += duration;
+        }
+        profile.open_scopes.pop_back();
+        timer = scope.timer;
+    }
+    trace_span(timer, start_time, end_time);
+}
+
+PerformanceMonitor::~PerformanceMonitor() {
+    stop_trace();
+}
+
+bool PerformanceMonitor::start_trace(const std::string& path, size_t max_events) {
+    std::lock_guard<std::mutex> trace_lock(trace_mutex_);
+    if (trace_writer_.joinable()) {
+        return false;
+    }
     
-    if (it != start_times_.end()) {
-        auto duration = std::chrono::duration<double, std::milli>(end_time - it->second).count();
-        
-        if (timing_history_[event].size() >= max_history_size_) {
-            timing_history_[event].erase(timing_history_[event].begin());
+    trace_file_.open(path, std::ios::out | std::ios::trunc);
+    if (!trace_file_) {
+        trace_file_.clear();
+        return false;
+    }
+    trace_file_ << "{\"traceEvents\":[\n"
+                << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Host threads\"}},\n"
+                << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"GPU cores\"}}";
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& thread : thread_states_) {
+            TraceBuffer& buffer = thread.second->trace;
+            if (!buffer.events) {
+                buffer.events = std::make_unique<TraceEvent[]>(TRACE_BUFFER_EVENTS);
+            }
+            buffer.tail.store(buffer.head.load(std::memory_order_relaxed), std::memory_order_relaxed);
         }
-        timing_history_[event].push_back(duration);
-        
-        start_times_.erase(it);
+        trace_start_ = std::chrono::high_resolution_clock::now();
+        trace_event_limit_ = max_events;
+        trace_events_accepted_.store(0, std::memory_order_relaxed);
+        trace_events_written_.store(0, std::memory_order_relaxed);
+        trace_events_dropped_.store(0, std::memory_order_relaxed);
+        tracing_.store(true, std::memory_order_release);
+    }
+    
+    trace_stopping_ = false;
+    trace_writer_ = std::thread(&PerformanceMonitor::trace_writer_loop, this);
+    return true;
+}
+
+void PerformanceMonitor::stop_trace() {
+    std::unique_lock<std::mutex> trace_lock(trace_mutex_);
+    if (!trace_writer_.joinable()) {
+        return;
     }
+    tracing_.store(false, std::memory_order_relaxed);
+    trace_stopping_ = true;
+    trace_wake_.notify_all();
+    std::thread writer = std::move(trace_writer_);
+    
+    // The writer drains what is left before it exits
+    trace_lock.unlock();
+    writer.join();
+    trace_lock.lock();
+    
+    trace_file_ << "\n]}\n";
+    trace_file_.close();
+}
+
+void PerformanceMonitor::trace_span(TimerId event, std::chrono::high_resolution_clock::time_point start,
+                                    std::chrono::high_resolution_clock::time_point end, int32_t gpu_core) {
+    if (!tracing_.load(std::memory_order_acquire)) {
+        return;
+    }
+    TraceEvent trace_event;
+    trace_event.timestamp_ns = nanoseconds_since(trace_start_, start);
+    trace_event.duration_ns = nanoseconds_since(start, end);
+    trace_event.value = 0;
+    trace_event.name = event;
+    trace_event.gpu_core = gpu_core;
+    trace_event.phase = 'X';
+    record_trace_event(trace_event);
+}
+
+void PerformanceMonitor::trace_instant(TimerId event, uint64_t value) {
+    if (!tracing_.load(std::memory_order_acquire)) {
+        return;
+    }
+    TraceEvent trace_event;
+    trace_event.timestamp_ns = nanoseconds_since(trace_start_, std::chrono::high_resolution_clock::now());
+    trace_event.duration_ns = 0;
+    trace_event.value = value;
+    trace_event.name = event;
+    trace_event.gpu_core = -1;
+    trace_event.phase = 'i';
+    record_trace_event(trace_event);
+}
+
+PerformanceMonitor::TraceStats PerformanceMonitor::get_trace_stats() const {
+    return {trace_events_written_.load(std::memory_order_relaxed),
+            trace_events_dropped_.load(std::memory_order_relaxed)};
+}
+
+void PerformanceMonitor::record_trace_event(const TraceEvent& event) {
+    if (trace_events_accepted_.fetch_add(1, std::memory_order_relaxed) >= trace_event_limit_) {
+        trace_events_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    TraceBuffer& buffer = local_state().trace;
+    size_t head = buffer.head.load(std::memory_order_relaxed);
+    if (head - buffer.tail.load(std::memory_order_acquire) >= TRACE_BUFFER_EVENTS) {
+        // The writer has fallen behind; dropping keeps recording lock-free
+        trace_events_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer.events[head % TRACE_BUFFER_EVENTS] = event;
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void PerformanceMonitor::trace_writer_loop() {
+    std::vector<std::string> names;
+    std::unique_lock<std::mutex> trace_lock(trace_mutex_);
+    for (;;) {
+        bool stopping = trace_wake_.wait_for(trace_lock, std::chrono::milliseconds(TRACE_FLUSH_INTERVAL_MS),
+                                             [this] { return trace_stopping_; });
+        trace_lock.unlock();
+        drain_trace_buffers(names);
+        if (stopping) {
+            return;
+        }
+        trace_lock.lock();
+    }
+}
+
+void PerformanceMonitor::drain_trace_buffers(std::vector<std::string>& names) {
+    // Buffers are never freed while the monitor lives, so they can be read
+    // after the registry lock is dropped
+    std::vector<std::pair<uint32_t, TraceBuffer*>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& thread : thread_states_) {
+            if (thread.second->trace.events) {
+                buffers.emplace_back(thread.second->thread_index, &thread.second->trace);
+            }
+        }
+        if (names.size() != timer_names_.size()) {
+            names = timer_names_;
+        }
+    }
+    
+    char fields[160];
+    uint64_t written = 0;
+    for (auto& [thread_index, buffer] : buffers) {
+        size_t tail = buffer->tail.load(std::memory_order_relaxed);
+        size_t head = buffer->head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) {
+            const TraceEvent& event = buffer->events[tail % TRACE_BUFFER_EVENTS];
+            int pid = event.gpu_core < 0 ? 1 : 2;
+            int tid = event.gpu_core < 0 ? static_cast<int>(thread_index) : event.gpu_core;
+            if (event.phase == 'X') {
+                std::snprintf(fields, sizeof(fields), ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                              event.timestamp_ns / 1000.0, event.duration_ns / 1000.0, pid, tid);
+            } else {
+                std::snprintf(fields, sizeof(fields),
+                              ",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"value\":%llu}}",
+                              event.timestamp_ns / 1000.0, pid, tid, static_cast<unsigned long long>(event.value));
+            }
+            trace_file_ << ",\n{\"name\":";
+            static const std::string unknown_name = "unknown";
+            write_json_string(trace_file_, event.name < names.size() ? names[event.name] : unknown_name);
+            trace_file_ << fields;
+            written++;
+        }
+        buffer->tail.store(tail, std::memory_order_release);
+    }
+    if (written > 0) {
+        trace_events_written_.fetch_add(written, std::memory_order_relaxed);
+        trace_file_.flush();
+    }
+}
+
+uint64_t PerformanceMonitor::counter_value(CounterId counter) const {
+    if (counter >= counter_bases_.size()) {
+        return 0;
+    }
+    uint64_t value = counter_bases_[counter];
+    if (counter < COUNTER_SLOTS) {
+        for (const auto& thread : thread_states_) {
+            value += thread.second->counters.values[counter].load(std::memory_order_relaxed);
+        }
+    }
+    return value;
+}
+
+void PerformanceMonitor::start_timer(TimerId event) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (event < timers_.size()) {
+        timers_[event].start_times.push_back(start_time);
+    }
+}
+
+void PerformanceMonitor::end_timer(TimerId event) {
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (event < timers_.size() && !timers_[event].start_times.empty()) {
+        TimerState& timer = timers_[event];
+        auto duration = std::chrono::duration<double, std::milli>(end_time - timer.start_times.back()).count();
+        timer.start_times.pop_back();
+        timer.history.push(duration);
+        timer.latency.record(duration);
+    }
+}
+
+void PerformanceMonitor::record_timer(TimerId event, double duration_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (event < timers_.size()) {
+        timers_[event].history.push(duration_ms);
+        timers_[event].latency.record(duration_ms);
+    }
+}
+
+void PerformanceMonitor::start_timer(const std::string& event) {
+    start_timer(register_timer(event));
+}
+
+void PerformanceMonitor::end_timer(const std::string& event) {
+    end_timer(register_timer(event));
 }
 
 double PerformanceMonitor::get_elapsed_time_ms(const std::string& event) const {
-    auto it = timing_history_.find(event);
-    if (it != timing_history_.end() && !it->second.empty()) {
-        return calculate_average(it->second);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = timer_ids_.find(event);
+    if (it != timer_ids_.end() && !timers_[it->second].history.empty()) {
+        return calculate_average(timers_[it->second].history);
     }
     return 0.0;
 }
 
+void PerformanceMonitor::increment_counter(CounterId counter, uint64_t value) {
+    if (counter >= COUNTER_SLOTS) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (counter < counter_bases_.size()) {
+            counter_bases_[counter] += value;
+        }
+        return;
+    }
+    // Only this thread writes its slot, so no read-modify-write is needed
+    auto& slot = local_state().counters.values[counter];
+    slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void PerformanceMonitor::set_counter(CounterId counter, uint64_t value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (counter < counter_bases_.size()) {
+        // Wraps so that the base plus the per-thread slots sums to value
+        counter_bases_[counter] += value - counter_value(counter);
+    }
+}
+
+uint64_t PerformanceMonitor::get_counter(CounterId counter) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return counter_value(counter);
+}
+
 void PerformanceMonitor::increment_counter(const std::string& counter, uint64_t value) {
-    counters_[counter] += value;
+    increment_counter(register_counter(counter), value);
 }
 
 void PerformanceMonitor::set_counter(const std::string& counter, uint64_t value) {
-    counters_[counter] = value;
+    set_counter(register_counter(counter), value);
 }
 
 uint64_t PerformanceMonitor::get_counter(const std::string& counter) const {
-    auto it = counters_.find(counter);
-    return (it != counters_.end()) ? it->second : 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = counter_ids_.find(counter);
+    return (it != counter_ids_.end()) ? counter_value(it->second) : 0;
 }
 
 void PerformanceMonitor::record_bandwidth_usage(const std::string& component, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto now = std::chrono::high_resolution_clock::now();
     
     // Initialize start time if this is the first measurement
@@ -62,45 +483,49 @@ void PerformanceMonitor::record_bandwidth_usage(const std::string& component, ui
     bandwidth_bytes_[component] += bytes;
 }
 
+void PerformanceMonitor::record_cache_access(CacheId cache, bool hit) {
+    increment_counter(hit ? cache.hits : cache.misses);
+}
+
 void PerformanceMonitor::record_cache_access(const std::string& cache, bool hit) {
-    if (hit) {
-        cache_hits_[cache]++;
-    } else {
-        cache_misses_[cache]++;
-    }
+    record_cache_access(register_cache(cache), hit);
 }
 
 void PerformanceMonitor::record_frame_metrics(double frame_time_ms, uint32_t triangles, uint32_t fragments) {
-    if (frame_times_.size() >= max_history_size_) {
-        frame_times_.erase(frame_times_.begin());
-        triangle_counts_.erase(triangle_counts_.begin());
-        fragment_counts_.erase(fragment_counts_.begin());
-    }
-    
-    frame_times_.push_back(frame_time_ms);
-    triangle_counts_.push_back(triangles);
-    fragment_counts_.push_back(fragments);
+    std::lock_guard<std::mutex> lock(mutex_);
+    FrameSample sample;
+    sample.frame_time_ms = frame_time_ms;
+    sample.triangles = triangles;
+    sample.fragments = fragments;
+    frame_history_.push(sample);
+    frame_latency_.record(frame_time_ms);
 }
 
-double PerformanceMonitor::calculate_average(const std::vector<double>& values) const {
+double PerformanceMonitor::calculate_average(const HistoryRing<double>& values) const {
     if (values.empty()) return 0.0;
-    return std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+    double sum = 0.0;
+    values.for_each([&sum](double value) { sum += value; });
+    return sum / values.size();
 }
 
-double PerformanceMonitor::calculate_variance(const std::vector<double>& values) const {
+double PerformanceMonitor::calculate_variance(const HistoryRing<double>& values) const {
     if (values.size() < 2) return 0.0;
     
     double mean = calculate_average(values);
     double sum_squared_diff = 0.0;
     
-    for (double value : values) {
+    values.for_each([&](double value) {
         double diff = value - mean;
         sum_squared_diff += diff * diff;
-    }
+    });
     
     return sum_squared_diff / (values.size() - 1);
 }
 
+PerformanceMonitor::LatencyPercentiles PerformanceMonitor::percentiles(const QuantileSketch& histogram) {
+    return {histogram.quantile(0.50), histogram.quantile(0.95), histogram.quantile(0.99)};
+}
+
 double PerformanceMonitor::calculate_bandwidth_mbps(const std::string& component) const {
     auto bytes_it = bandwidth_bytes_.find(component);
     auto start_it = bandwidth_start_times_.find(component);
@@ -119,17 +544,23 @@ double PerformanceMonitor::calculate_bandwidth_mbps(const std::string& component
 }
 
 PerformanceMonitor::PerformanceReport PerformanceMonitor::generate_report() const {
+    std::lock_guard<std::mutex> lock(mutex_);
     PerformanceReport report;
     
     // Timing data
-    for (const auto& [event, times] : timing_history_) {
-        if (!times.empty()) {
-            report.timing_data[event] = calculate_average(times);
+    for (size_t event = 0; event < timer_names_.size(); ++event) {
+        if (!timers_[event].history.empty()) {
+            report.timing_data[timer_names_[event]] = calculate_average(timers_[event].history);
+        }
+        if (timers_[event].latency.count() > 0) {
+            report.timing_percentiles[timer_names_[event]] = percentiles(timers_[event].latency);
         }
     }
     
-    // Counter data
-    report.counter_data = counters_;
+    // Counter data, aggregated over every thread's slots
+    for (const auto& [counter, id] : counter_ids_) {
+        report.counter_data[counter] = counter_value(id);
+    }
     
     // Bandwidth data
     for (const auto& [component, _] : bandwidth_bytes_) {
@@ -137,12 +568,9 @@ PerformanceMonitor::PerformanceReport PerformanceMonitor::generate_report() cons
     }
     
     // Cache hit rates
-    for (const auto& [cache, hits] : cache_hits_) {
-        uint64_t misses = 0;
-        auto miss_it = cache_misses_.find(cache);
-        if (miss_it != cache_misses_.end()) {
-            misses = miss_it->second;
-        }
+    for (const auto& [cache, id] : cache_ids_) {
+        uint64_t hits = cache_hits(id);
+        uint64_t misses = cache_misses(id);
         
         uint64_t total_accesses = hits + misses;
         if (total_accesses > 0) {
@@ -151,13 +579,21 @@ PerformanceMonitor::PerformanceReport PerformanceMonitor::generate_report() cons
     }
     
     // Frame metrics
-    if (!frame_times_.empty()) {
-        report.avg_frame_time_ms = calculate_average(frame_times_);
-        report.min_frame_time_ms = *std::min_element(frame_times_.begin(), frame_times_.end());
-        report.max_frame_time_ms = *std::max_element(frame_times_.begin(), frame_times_.end());
-        
-        report.total_triangles = std::accumulate(triangle_counts_.begin(), triangle_counts_.end(), 0ULL);
-        report.total_fragments = std::accumulate(fragment_counts_.begin(), fragment_counts_.end(), 0ULL);
+    report.frame_time_percentiles = percentiles(frame_latency_);
+    if (!frame_history_.empty()) {
+        double frame_time_sum = 0.0;
+        report.min_frame_time_ms = frame_history_.newest().frame_time_ms;
+        report.max_frame_time_ms = report.min_frame_time_ms;
+        report.total_triangles = 0;
+        report.total_fragments = 0;
+        frame_history_.for_each([&](const FrameSample& sample) {
+            frame_time_sum += sample.frame_time_ms;
+            report.min_frame_time_ms = std::min(report.min_frame_time_ms, sample.frame_time_ms);
+            report.max_frame_time_ms = std::max(report.max_frame_time_ms, sample.frame_time_ms);
+            report.total_triangles += sample.triangles;
+            report.total_fragments += sample.fragments;
+        });
+        report.avg_frame_time_ms = frame_time_sum / frame_history_.size();
     } else {
         report.avg_frame_time_ms = 0.0;
         report.min_frame_time_ms = 0.0;
@@ -166,6 +602,36 @@ PerformanceMonitor::PerformanceReport PerformanceMonitor::generate_report() cons
         report.total_fragments = 0;
     }
     
+    // Call tree, merged across threads by call path; ordering paths as
+    // timer id sequences puts every scope right before its children
+    std::map<std::vector<TimerId>, ProfileEntry> merged_scopes;
+    for (const auto& thread : thread_states_) {
+        ThreadProfile& profile = thread.second->profile;
+        std::lock_guard<std::mutex> profile_lock(profile.mutex);
+        std::vector<std::vector<TimerId>> paths(profile.nodes.size());
+        for (size_t index = 0; index < profile.nodes.size(); ++index) {
+            const ProfileNode& node = profile.nodes[index];
+            if (node.parent != NO_PARENT) {
+                paths[index] = paths[node.parent];
+            }
+            paths[index].push_back(node.timer);
+            if (node.calls == 0) {
+                continue;
+            }
+            ProfileEntry& entry = merged_scopes[paths[index]];
+            entry.calls += node.calls;
+            entry.total_ms += node.total_ms;
+            entry.self_ms += node.total_ms - node.child_ms;
+        }
+    }
+    for (auto& [path, entry] : merged_scopes) {
+        for (TimerId timer : path) {
+            entry.path += (entry.path.empty() ? "" : "/") + timer_names_[timer];
+        }
+        entry.depth = static_cast<uint32_t>(path.size() - 1);
+        report.call_tree.push_back(entry);
+    }
+    
     // Efficiency metrics
     report.memory_efficiency = 0.0;
     report.cache_efficiency = 0.0;
@@ -202,7 +668,13 @@ void PerformanceMonitor::print_report() const {
     // Timing information
     std::cout << "\nTiming Information:" << std::endl;
     for (const auto& [event, avg_time] : report.timing_data) {
-        std::cout << "  " << event << ": " << avg_time << " ms" << std::endl;
+        std::cout << "  " << event << ": " << avg_time << " ms";
+        auto latency = report.timing_percentiles.find(event);
+        if (latency != report.timing_percentiles.end()) {
+            std::cout << " (p50 " << latency->second.p50_ms << ", p95 " << latency->second.p95_ms
+                      << ", p99 " << latency->second.p99_ms << ")";
+        }
+        std::cout << std::endl;
     }
     
     // Frame metrics
@@ -210,12 +682,25 @@ void PerformanceMonitor::print_report() const {
     std::cout << "  Average frame time: " << report.avg_frame_time_ms << " ms" << std::endl;
     std::cout << "  Min frame time: " << report.min_frame_time_ms << " ms" << std::endl;
     std::cout << "  Max frame time: " << report.max_frame_time_ms << " ms" << std::endl;
+    std::cout << "  Frame time p50/p95/p99: " << report.frame_time_percentiles.p50_ms << " / "
+              << report.frame_time_percentiles.p95_ms << " / "
+              << report.frame_time_percentiles.p99_ms << " ms" << std::endl;
     if (report.avg_frame_time_ms > 0) {
         std::cout << "  Average FPS: " << (1000.0 / report.avg_frame_time_ms) << std::endl;
     }
     std::cout << "  Total triangles: " << report.total_triangles << std::endl;
     std::cout << "  Total fragments: " << report.total_fragments << std::endl;
     
+    // Call tree
+    if (!report.call_tree.empty()) {
+        std::cout << "\nCall Tree (total / self):" << std::endl;
+        for (const auto& entry : report.call_tree) {
+            std::string name = entry.path.substr(entry.path.rfind('/') + 1);
+            std::cout << "  " << std::string(entry.depth * 2, ' ') << name << ": " << entry.total_ms
+                      << " / " << entry.self_ms << " ms over " << entry.calls << " calls" << std::endl;
+        }
+    }
+    
     // Cache performance
     std::cout << "\nCache Performance:" << std::endl;
     for (const auto& [cache, hit_rate] : report.cache_hit_rates) {
@@ -244,17 +729,32 @@ void PerformanceMonitor::print_report() const {
 }
 
 void PerformanceMonitor::reset_all_metrics() {
-    start_times_.clear();
-    timing_history_.clear();
-    counters_.clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Registrations survive so that handles held by components stay valid
+    for (auto& timer : timers_) {
+        timer.start_times.clear();
+        timer.history.clear();
+        timer.latency.clear();
+    }
+    for (CounterId counter = 0; counter < counter_bases_.size(); ++counter) {
+        counter_bases_[counter] -= counter_value(counter);
+    }
     bandwidth_bytes_.clear();
     bandwidth_start_times_.clear();
-    cache_hits_.clear();
-    cache_misses_.clear();
-    frame_times_.clear();
-    triangle_counts_.clear();
-    fragment_counts_.clear();
+    frame_history_.clear();
+    frame_latency_.clear();
     performance_thresholds_.clear();
+    
+    // Call tree nodes stay, as scopes may still be open on other threads
+    for (auto& thread : thread_states_) {
+        ThreadProfile& profile = thread.second->profile;
+        std::lock_guard<std::mutex> profile_lock(profile.mutex);
+        for (auto& node : profile.nodes) {
+            node.calls = 0;
+            node.total_ms = 0.0;
+            node.child_ms = 0.0;
+        }
+    }
 }
 
 void PerformanceMonitor::update_real_time_metrics() {
@@ -266,18 +766,20 @@ void PerformanceMonitor::update_real_time_metrics() {
 }
 
 void PerformanceMonitor::set_performance_threshold(const std::string& metric, double threshold) {
+    std::lock_guard<std::mutex> lock(mutex_);
     performance_thresholds_[metric] = threshold;
 }
 
 std::vector<std::string> PerformanceMonitor::check_performance_alerts() const {
+    std::lock_guard<std::mutex> lock(mutex_);
     std::vector<std::string> alerts;
     
     for (const auto& [metric, threshold] : performance_thresholds_) {
         bool alert_triggered = false;
         std::string alert_message;
         
-        if (metric == "frame_time_ms" && !frame_times_.empty()) {
-            double current_frame_time = frame_times_.back();
+        if (metric == "frame_time_ms" && !frame_history_.empty()) {
+            double current_frame_time = frame_history_.newest().frame_time_ms;
             if (current_frame_time > threshold) {
                 alert_triggered = true;
                 alert_message = "Frame time exceeded threshold: " + 
@@ -287,13 +789,13 @@ std::vector<std::string> PerformanceMonitor::check_performance_alerts() const {
         } else if (metric.find("hit_rate") != std::string::npos) {
             // Extract cache name from metric
             std::string cache_name = metric.substr(0, metric.find("_hit_rate"));
-            auto hit_it = cache_hits_.find(cache_name);
-            auto miss_it = cache_misses_.find(cache_name);
+            auto cache_it = cache_ids_.find(cache_name);
             
-            if (hit_it != cache_hits_.end() && miss_it != cache_misses_.end()) {
-                uint64_t total = hit_it->second + miss_it->second;
+            if (cache_it != cache_ids_.end()) {
+                uint64_t hits = cache_hits(cache_it->second);
+                uint64_t total = hits + cache_misses(cache_it->second);
                 if (total > 0) {
-                    double hit_rate = static_cast<double>(hit_it->second) / total;
+                    double hit_rate = static_cast<double>(hits) / total;
                     if (hit_rate < threshold) {
                         alert_triggered = true;
                         alert_message = cache_name + " hit rate below threshold: " +
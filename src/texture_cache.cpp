@@ -1,6 +1,8 @@
 #include "texture_cache.h"
+#include "graphics_pipeline.h"
 #include "memory_hierarchy.h"
 #include "performance_monitor.h"
+#include "command_stream.h"
 #include <algorithm>
 #include <cmath>
 #include <iostream>
@@ -8,22 +10,65 @@
 
 namespace gpu_sim {
 
+namespace {
+
+// Block coordinates for stride detection; blocks_per_row is 0 for untyped
+// surfaces, which are walked as a single row
+void block_coordinates(uint64_t block_index, uint64_t blocks_per_row, int64_t& x, int64_t& y) {
+    if (blocks_per_row == 0) {
+        x = static_cast<int64_t>(block_index);
+        y = 0;
+        return;
+    }
+    x = static_cast<int64_t>(block_index % blocks_per_row);
+    y = static_cast<int64_t>(block_index / blocks_per_row);
+}
+
+} // namespace
+
 TextureCache::TextureCache(size_t cache_size_mb)
-    : max_cache_size_bytes_(cache_size_mb * 1024 * 1024),
+    : next_texture_id_(FIRST_REGISTERED_TEXTURE_ID),
+      surface_generation_(0),
+      access_clock_(0),
+      prefetches_in_flight_(0),
+      prefetch_worker_stopping_(false),
+      max_cache_size_bytes_(cache_size_mb * 1024 * 1024),
       current_cache_size_bytes_(0),
-      prefetch_distance_(DEFAULT_OPTIMIZATION_INTERVAL),
+      prefetch_distance_(DEFAULT_PREFETCH_DISTANCE),
       smart_prefetching_enabled_(true),
       adaptive_caching_enabled_(true),
       max_pattern_history_(DEFAULT_PATTERN_HISTORY_SIZE),
+      history_next_(0),
+      history_count_(0),
       prefetch_aggressiveness_(DEFAULT_PREFETCH_AGGRESSIVENESS),
       eviction_threshold_(DEFAULT_EVICTION_THRESHOLD),
       optimization_interval_ms_(DEFAULT_OPTIMIZATION_INTERVAL) {
     
-    recent_accesses_.reserve(max_pattern_history_);
+    recent_accesses_.resize(max_pattern_history_);
     last_optimization_time_ = std::chrono::high_resolution_clock::now();
     
     // Initialize metrics
     reset_metrics();
+    
+    prefetch_worker_ = std::thread(&TextureCache::prefetch_worker_loop, this);
+}
+
+TextureCache::~TextureCache() {
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        prefetch_worker_stopping_ = true;
+    }
+    prefetch_work_.notify_all();
+    prefetch_worker_.join();
+    
+    if (!memory_) return;
+    for (auto& texture : surfaces_) {
+        for (auto& surface : texture.second) {
+            if (surface.address != 0) {
+                memory_->deallocate(surface.address);
+            }
+        }
+    }
 }
 
 void TextureCache::initialize(std::shared_ptr<MemoryHierarchy> memory,
@@ -32,115 +77,202 @@ void TextureCache::initialize(std::shared_ptr<MemoryHierarchy> memory,
     perf_monitor_ = perf_monitor;
     
     if (perf_monitor_) {
+        perf_ids_.cache_access = perf_monitor_->register_cache("texture_cache");
+        perf_ids_.load_from_memory = perf_monitor_->register_timer("texture_load_from_memory");
+        perf_ids_.bytes_read = perf_monitor_->register_counter("texture_cache_bytes_read");
+        perf_ids_.prefetch_dropped = perf_monitor_->register_counter("texture_prefetch_dropped");
+        perf_ids_.prefetch_operations = perf_monitor_->register_counter("texture_prefetch_operations");
+        perf_ids_.prefetched_blocks = perf_monitor_->register_counter("texture_prefetched_blocks");
+        perf_ids_.predicted_prefetches = perf_monitor_->register_counter("texture_predicted_prefetches");
+        perf_ids_.miss_event = perf_monitor_->register_timer("texture_miss");
+        perf_ids_.prefetch_event = perf_monitor_->register_timer("texture_prefetch");
+        perf_ids_.eviction_event = perf_monitor_->register_timer("texture_eviction");
         perf_monitor_->set_counter("texture_cache_size_mb", max_cache_size_bytes_ / (1024 * 1024));
     }
 }
 
-bool TextureCache::read_texture(uint64_t texture_id, uint32_t mip_level,
-                               uint64_t offset, void* data, size_t size) {
-    auto start_time = std::chrono::high_resolution_clock::now();
-    
-    // Record access pattern for analysis
-    if (recent_accesses_.size() >= max_pattern_history_) {
-        recent_accesses_.erase(recent_accesses_.begin());
+TextureView TextureView::of(const Texture& texture) {
+    TextureView view;
+    view.width = texture.width;
+    view.height = texture.height;
+    view.format = texture.format;
+    view.mip_levels = texture.mip_levels;
+    view.data = texture.data.data();
+    view.size = texture.data.size();
+    return view;
+}
+
+bool TextureCache::upload_texture(uint64_t texture_id, const Texture& texture) {
+    return upload_texture(texture_id, TextureView::of(texture));
+}
+
+bool TextureCache::upload_texture(uint64_t texture_id, const TextureView& texture) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (!memory_ || texture.width == 0 || texture.height == 0 || !texture.data ||
+        texture.size < static_cast<size_t>(texture.width) * texture.height * TextureLayout::TEXEL_BYTES) {
+        return false;
     }
     
-    AccessPattern pattern;
-    pattern.texture_id = texture_id;
-    pattern.mip_level = mip_level;
-    pattern.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
-        start_time.time_since_epoch()).count();
-    recent_accesses_.push_back(pattern);
-    
-    // Generate cache key
-    uint64_t cache_key = (texture_id << 8) | mip_level;
+    release_surfaces(texture_id);
     
-    // Check cache
-    auto it = cache_entries_.find(cache_key);
-    if (it != cache_entries_.end()) {
-        auto& entry = it->second;
-        
-        // Update access metadata
-        entry->last_access_time = pattern.timestamp;
-        entry->access_count++;
+    // Levels beyond 1x1 do not exist
+    uint32_t full_chain = 1;
+    while ((texture.width >> full_chain) > 0 || (texture.height >> full_chain) > 0) {
+        full_chain++;
+    }
+    uint32_t levels = std::min({std::max(texture.mip_levels, 1u), full_chain, MAX_MIP_LEVELS});
+    
+    // Linear source texels per level: taken from texture.data when it holds
+    // the whole chain back to back, otherwise box-filtered from the level above
+    std::vector<uint8_t> linear(texture.data,
+                                texture.data + static_cast<size_t>(texture.width) * texture.height * 4);
+    size_t source_offset = linear.size();
+    std::vector<TextureSurface> surfaces(levels);
+    std::vector<uint8_t> tiled;
+    
+    for (uint32_t level = 0; level < levels; ++level) {
+        uint32_t width = TextureLayout::mip_dimension(texture.width, level);
+        uint32_t height = TextureLayout::mip_dimension(texture.height, level);
         
-        // Check if requested data is within cached texture
-        if (offset + size <= entry->data.size()) {
-            memcpy(data, entry->data.data() + offset, size);
+        if (level > 0) {
+            size_t level_bytes = static_cast<size_t>(width) * height * 4;
+            uint32_t parent_width = TextureLayout::mip_dimension(texture.width, level - 1);
+            uint32_t parent_height = TextureLayout::mip_dimension(texture.height, level - 1);
             
-            // Update metrics
-            metrics_.cache_hits++;
-            if (entry->is_prefetched) {
-                metrics_.prefetch_hits++;
+            if (source_offset + level_bytes <= texture.size) {
+                linear.assign(texture.data + source_offset,
+                              texture.data + source_offset + level_bytes);
+                source_offset += level_bytes;
+            } else {
+                std::vector<uint8_t> parent = std::move(linear);
+                linear.assign(level_bytes, 0);
+                for (uint32_t y = 0; y < height; ++y) {
+                    for (uint32_t x = 0; x < width; ++x) {
+                        uint32_t x0 = std::min(x * 2, parent_width - 1), x1 = std::min(x * 2 + 1, parent_width - 1);
+                        uint32_t y0 = std::min(y * 2, parent_height - 1), y1 = std::min(y * 2 + 1, parent_height - 1);
+                        for (int c = 0; c < 4; ++c) {
+                            uint32_t sum = parent[(y0 * parent_width + x0) * 4 + c] +
+                                           parent[(y0 * parent_width + x1) * 4 + c] +
+                                           parent[(y1 * parent_width + x0) * 4 + c] +
+                                           parent[(y1 * parent_width + x1) * 4 + c];
+                            linear[(y * width + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+                        }
+                    }
+                }
+                source_offset = texture.size;  // Later levels are generated too
             }
-            
-            auto end_time = std::chrono::high_resolution_clock::now();
-            auto latency = std::chrono::duration<double, std::milli>(end_time - start_time).count();
-            
-            if (perf_monitor_) {
-                perf_monitor_->record_cache_access("texture_cache", true);
-                perf_monitor_->increment_counter("texture_cache_bytes_read", size);
+        }
+        
+        // Swizzle into blocks
+        TextureSurface& surface = surfaces[level];
+        surface.generation = ++surface_generation_;
+        surface.width = width;
+        surface.height = height;
+        surface.size_bytes = TextureLayout::mip_size_bytes(width, height);
+        tiled.assign(surface.size_bytes, 0);
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                memcpy(&tiled[TextureLayout::texel_offset(x, y, width)],
+                       &linear[(static_cast<size_t>(y) * width + x) * 4], TextureLayout::TEXEL_BYTES);
             }
-            
-            // Trigger smart prefetching
-            if (smart_prefetching_enabled_) {
-                predict_future_accesses();
+        }
+        
+        surface.address = memory_->allocate(surface.size_bytes);
+        if (surface.address == 0 || !memory_->write(surface.address, tiled.data(), tiled.size())) {
+            for (auto& allocated : surfaces) {
+                if (allocated.address != 0) memory_->deallocate(allocated.address);
             }
-            
-            return true;
+            return false;
         }
     }
     
-    // Cache miss - load from memory
-    metrics_.cache_misses++;
+    surfaces_[texture_id] = std::move(surfaces);
     
+    if (capture_) {
+        capture_->record_upload_texture(texture_id, texture);
+    }
     if (perf_monitor_) {
-        perf_monitor_->record_cache_access("texture_cache", false);
-        perf_monitor_->start_timer("texture_load_from_memory");
+        perf_monitor_->increment_counter("texture_uploads");
     }
-    
-    // Calculate texture size (simplified - assume 4 bytes per pixel)
-    size_t texture_size = std::max(size, static_cast<size_t>(1024 * 1024)); // At least 1MB
-    
-    // Allocate memory for full texture
-    uint64_t texture_address = memory_->allocate(texture_size);
-    if (texture_address == 0) {
-        return false; // Memory allocation failed
+    return true;
+}
+
+uint64_t TextureCache::register_texture(const Texture& texture) {
+    return register_texture(TextureView::of(texture));
+}
+
+uint64_t TextureCache::register_texture(const TextureView& texture) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    uint64_t texture_id = next_texture_id_;
+    if (!upload_texture(texture_id, texture)) {
+        return 0;
     }
-    
-    // Load texture data from memory hierarchy
-    std::vector<uint8_t> texture_data(texture_size);
-    if (!memory_->read(texture_address, texture_data.data(), texture_size)) {
-        memory_->deallocate(texture_address);
+    next_texture_id_++;
+    return texture_id;
+}
+
+bool TextureCache::get_texture_size(uint64_t texture_id, uint32_t& width, uint32_t& height) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    auto it = surfaces_.find(texture_id);
+    if (it == surfaces_.end() || it->second.empty() || !it->second[0].tiled()) {
+        return false;
+    }
+    width = it->second[0].width;
+    height = it->second[0].height;
+    return true;
+}
+
+bool TextureCache::read_texture(uint64_t texture_id, uint32_t mip_level,
+                               uint64_t offset, void* data, size_t size) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    const TextureSurface* surface = find_surface(texture_id, mip_level, true);
+    if (!surface) {
         return false;
     }
     
-    // Create cache entry
-    auto entry = allocate_entry(texture_id, mip_level, texture_address, texture_size);
-    if (entry) {
-        entry->data = std::move(texture_data);
-        entry->last_access_time = pattern.timestamp;
-        entry->access_count = 1;
-        entry->is_prefetched = false;
-        
-        // Copy requested data
-        if (offset + size <= entry->data.size()) {
-            memcpy(data, entry->data.data() + offset, size);
+    uint64_t misses_before = metrics_.cache_misses;
+    uint8_t* out = static_cast<uint8_t*>(data);
+    uint64_t first_block = 0;
+    bool ok = true;
+    
+    if (!surface->tiled()) {
+        first_block = offset / TextureLayout::BLOCK_BYTES;
+        ok = read_surface_bytes(texture_id, mip_level, *surface, offset, out, size);
+    } else {
+        // Linear row-major offsets map texel by texel onto the tiled layout
+        uint64_t linear_size = static_cast<uint64_t>(surface->width) * surface->height * TextureLayout::TEXEL_BYTES;
+        if (offset + size > linear_size) {
+            return false;
+        }
+        uint64_t first_texel = offset / TextureLayout::TEXEL_BYTES;
+        first_block = TextureLayout::texel_offset(static_cast<uint32_t>(first_texel % surface->width),
+                                                  static_cast<uint32_t>(first_texel / surface->width),
+                                                  surface->width) / TextureLayout::BLOCK_BYTES;
+        while (size > 0 && ok) {
+            uint64_t texel = offset / TextureLayout::TEXEL_BYTES;
+            uint32_t byte = static_cast<uint32_t>(offset % TextureLayout::TEXEL_BYTES);
+            size_t chunk = std::min<size_t>(size, TextureLayout::TEXEL_BYTES - byte);
+            uint32_t x = static_cast<uint32_t>(texel % surface->width);
+            uint32_t y = static_cast<uint32_t>(texel / surface->width);
+            
+            ok = read_surface_bytes(texture_id, mip_level, *surface,
+                                    TextureLayout::texel_offset(x, y, surface->width) + byte, out, chunk);
+            offset += chunk;
+            out += chunk;
+            size -= chunk;
         }
-        
-        metrics_.bytes_transferred += texture_size;
     }
     
-    if (perf_monitor_) {
-        perf_monitor_->end_timer("texture_load_from_memory");
+    if (perf_monitor_ && ok) {
+        perf_monitor_->increment_counter(perf_ids_.bytes_read, out - static_cast<uint8_t*>(data));
     }
     
-    // Update performance metrics
-    auto end_time = std::chrono::high_resolution_clock::now();
-    auto latency = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    if (ok) {
+        record_access(texture_id, mip_level, *surface, first_block);
+    }
     
-    // Trigger adaptive optimization
-    if (adaptive_caching_enabled_) {
+    if (metrics_.cache_misses != misses_before && adaptive_caching_enabled_) {
+        // Trigger adaptive optimization
         auto now = std::chrono::high_resolution_clock::now();
         auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
             now - last_optimization_time_).count();
@@ -151,125 +283,492 @@ bool TextureCache::read_texture(uint64_t texture_id, uint32_t mip_level,
         }
     }
     
-    return entry != nullptr;
+    return ok;
+}
+
+bool TextureCache::read_texel(uint64_t texture_id, uint32_t mip_level,
+                              uint32_t x, uint32_t y, void* texel) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    const TextureSurface* surface = find_surface(texture_id, mip_level, false);
+    if (!surface || !surface->tiled() || x >= surface->width || y >= surface->height) {
+        return false;
+    }
+    
+    uint64_t offset = TextureLayout::texel_offset(x, y, surface->width);
+    if (!read_surface_bytes(texture_id, mip_level, *surface, offset,
+                            static_cast<uint8_t*>(texel), TextureLayout::TEXEL_BYTES)) {
+        return false;
+    }
+    record_access(texture_id, mip_level, *surface, offset / TextureLayout::BLOCK_BYTES);
+    return true;
 }
 
 void TextureCache::prefetch_texture(uint64_t texture_id, uint32_t mip_level) {
-    uint64_t cache_key = (texture_id << 8) | mip_level;
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     
-    // Don't prefetch if already cached
-    if (cache_entries_.find(cache_key) != cache_entries_.end()) {
-        return;
+    // Request size scales with the adaptive aggressiveness
+    uint32_t blocks = static_cast<uint32_t>(std::lround(prefetch_distance_ * prefetch_aggressiveness_));
+    enqueue_prefetch(texture_id, mip_level, 0, std::max(blocks, 1u));
+}
+
+void TextureCache::wait_for_prefetches() {
+    std::unique_lock<std::recursive_mutex> lock(mutex_);
+    prefetch_idle_.wait(lock, [this] { return prefetch_queue_.empty() && prefetches_in_flight_ == 0; });
+}
+
+bool TextureCache::enqueue_prefetch(uint64_t texture_id, uint32_t mip_level,
+                                    uint64_t first_block, uint32_t block_count) {
+    if (!memory_ || mip_level >= MAX_MIP_LEVELS || find_entry(texture_id, mip_level, first_block)) {
+        return false;
     }
     
-    // Add to prefetch queue
-    prefetch_queue_.push(cache_key);
+    BlockKey key{texture_id, mip_level, first_block};
+    if (pending_prefetches_.count(key)) {
+        return false;
+    }
+    if (prefetch_queue_.size() >= MAX_PREFETCH_QUEUE_DEPTH) {
+        if (perf_monitor_) {
+            perf_monitor_->increment_counter(perf_ids_.prefetch_dropped);
+        }
+        return false;
+    }
     
-    // Process prefetch queue (simplified - immediate processing)
-    if (!prefetch_queue_.empty()) {
-        uint64_t prefetch_key = prefetch_queue_.front();
-        prefetch_queue_.pop();
+    pending_prefetches_.insert(key);
+    prefetch_queue_.push_back({texture_id, mip_level, first_block, block_count});
+    prefetch_work_.notify_one();
+    return true;
+}
+
+void TextureCache::prefetch_worker_loop() {
+    std::unique_lock<std::recursive_mutex> lock(mutex_);
+    std::vector<uint64_t> blocks;
+    std::vector<uint8_t> block_data;
+    
+    for (;;) {
+        prefetch_work_.wait(lock, [this] { return prefetch_worker_stopping_ || !prefetch_queue_.empty(); });
+        if (prefetch_worker_stopping_) {
+            return;
+        }
         
-        uint64_t prefetch_texture_id = prefetch_key >> 8;
-        uint32_t prefetch_mip = prefetch_key & 0xFF;
+        PrefetchRequest request = prefetch_queue_.front();
+        prefetch_queue_.pop_front();
+        prefetches_in_flight_++;
         
-        // Simulate prefetch operation
-        size_t texture_size = 1024 * 1024; // 1MB default
-        uint64_t texture_address = memory_->allocate(texture_size);
+        // Pick the requested blocks that are not resident yet
+        blocks.clear();
+        uint64_t address = 0;
+        uint64_t generation = 0;
+        if (const TextureSurface* surface = find_surface(request.texture_id, request.mip_level, true)) {
+            address = surface->address;
+            generation = surface->generation;
+            uint64_t block_count = surface->size_bytes / TextureLayout::BLOCK_BYTES;
+            uint64_t end = std::min<uint64_t>(block_count, request.first_block + request.block_count);
+            for (uint64_t block = request.first_block; block < end; ++block) {
+                if (!find_entry(request.texture_id, request.mip_level, block)) {
+                    blocks.push_back(block);
+                }
+            }
+        }
         
-        if (texture_address != 0) {
-            auto entry = allocate_entry(prefetch_texture_id, prefetch_mip, 
-                                       texture_address, texture_size);
-            if (entry) {
-                entry->data.resize(texture_size);
-                memory_->read(texture_address, entry->data.data(), texture_size);
-                entry->is_prefetched = true;
-                
-                metrics_.bytes_transferred += texture_size;
+        if (!blocks.empty()) {
+            // Memory latency overlaps with shading: the cache stays unlocked
+            // for the transfer
+            block_data.resize(blocks.size() * TextureLayout::BLOCK_BYTES);
+            lock.unlock();
+            auto transfer_start = std::chrono::high_resolution_clock::now();
+            bool ok = true;
+            for (size_t i = 0; i < blocks.size() && ok; ++i) {
+                ok = memory_->read(address + blocks[i] * TextureLayout::BLOCK_BYTES,
+                                   &block_data[i * TextureLayout::BLOCK_BYTES], TextureLayout::BLOCK_BYTES);
+            }
+            if (perf_monitor_) {
+                perf_monitor_->trace_span(perf_ids_.prefetch_event, transfer_start,
+                                          std::chrono::high_resolution_clock::now());
+            }
+            lock.lock();
+            
+            // Discard the data if the texture was released or re-uploaded meanwhile
+            const TextureSurface* surface = find_surface(request.texture_id, request.mip_level, false);
+            if (ok && surface && surface->generation == generation) {
+                uint64_t fetched = 0;
+                for (size_t i = 0; i < blocks.size(); ++i) {
+                    if (find_entry(request.texture_id, request.mip_level, blocks[i])) continue;
+                    
+                    TextureCacheEntry* entry = allocate_entry(request.texture_id, request.mip_level, blocks[i],
+                                                              address + blocks[i] * TextureLayout::BLOCK_BYTES);
+                    memcpy(entry->data, &block_data[i * TextureLayout::BLOCK_BYTES], TextureLayout::BLOCK_BYTES);
+                    entry->last_access_time = ++access_clock_;
+                    entry->access_count = 0;
+                    entry->is_prefetched = true;
+                    metrics_.bytes_transferred += TextureLayout::BLOCK_BYTES;
+                    fetched++;
+                }
                 
-                if (perf_monitor_) {
-                    perf_monitor_->increment_counter("texture_prefetch_operations");
+                if (perf_monitor_ && fetched > 0) {
+                    perf_monitor_->increment_counter(perf_ids_.prefetch_operations);
+                    perf_monitor_->increment_counter(perf_ids_.prefetched_blocks, fetched);
                 }
             }
         }
+        
+        pending_prefetches_.erase(BlockKey{request.texture_id, request.mip_level, request.first_block});
+        prefetches_in_flight_--;
+        if (prefetch_queue_.empty() && prefetches_in_flight_ == 0) {
+            prefetch_idle_.notify_all();
+        }
+    }
+}
+
+const TextureCache::TextureSurface* TextureCache::find_surface(uint64_t texture_id, uint32_t mip_level,
+                                                              bool create) {
+    if (mip_level >= MAX_MIP_LEVELS) {
+        return nullptr;
+    }
+    
+    auto it = surfaces_.find(texture_id);
+    if (it != surfaces_.end() && mip_level < it->second.size() && it->second[mip_level].address != 0) {
+        return &it->second[mip_level];
+    }
+    
+    // Uploaded textures have a fixed mip chain
+    bool uploaded = it != surfaces_.end() && !it->second.empty() && it->second[0].tiled();
+    if (!create || uploaded || !memory_) {
+        return nullptr;
+    }
+    
+    // Untyped linear surface for a texture that was never uploaded
+    auto& levels = surfaces_[texture_id];
+    if (levels.size() <= mip_level) {
+        levels.resize(mip_level + 1);
+    }
+    TextureSurface& surface = levels[mip_level];
+    surface.generation = ++surface_generation_;
+    surface.size_bytes = UNTYPED_SURFACE_BYTES;
+    surface.address = memory_->allocate(surface.size_bytes);
+    return surface.address != 0 ? &surface : nullptr;
+}
+
+bool TextureCache::read_surface_bytes(uint64_t texture_id, uint32_t mip_level, const TextureSurface& surface,
+                                      uint64_t offset, uint8_t* data, size_t size) {
+    if (offset + size > surface.size_bytes) {
+        return false;
+    }
+    
+    while (size > 0) {
+        uint64_t block = offset / TextureLayout::BLOCK_BYTES;
+        size_t block_offset = static_cast<size_t>(offset % TextureLayout::BLOCK_BYTES);
+        size_t chunk = std::min<size_t>(size, TextureLayout::BLOCK_BYTES - block_offset);
+        
+        TextureCacheEntry* entry = fetch_block(texture_id, mip_level, surface, block);
+        if (!entry) {
+            return false;
+        }
+        memcpy(data, entry->data + block_offset, chunk);
+        
+        offset += chunk;
+        data += chunk;
+        size -= chunk;
     }
+    return true;
 }
 
-TextureCacheEntry* TextureCache::find_entry(uint64_t texture_id, uint32_t mip_level) {
-    uint64_t cache_key = (texture_id << 8) | mip_level;
-    auto it = cache_entries_.find(cache_key);
+TextureCacheEntry* TextureCache::fetch_block(uint64_t texture_id, uint32_t mip_level,
+                                             const TextureSurface& surface, uint64_t block_index) {
+    TextureCacheEntry* entry = find_entry(texture_id, mip_level, block_index);
+    if (entry) {
+        metrics_.cache_hits++;
+        if (entry->is_prefetched) {
+            // First demand use of a prefetched block
+            metrics_.prefetch_hits++;
+            entry->is_prefetched = false;
+        }
+        
+        // Update access metadata
+        touch_entry(entry);
+        if (perf_monitor_) {
+            perf_monitor_->record_cache_access(perf_ids_.cache_access, true);
+        }
+        return entry;
+    }
+    
+    // Cache miss - load one block from memory
+    metrics_.cache_misses++;
+    if (perf_monitor_) {
+        perf_monitor_->record_cache_access(perf_ids_.cache_access, false);
+        perf_monitor_->trace_instant(perf_ids_.miss_event, block_index);
+        perf_monitor_->start_timer(perf_ids_.load_from_memory);
+    }
+    
+    uint64_t address = surface.address + block_index * TextureLayout::BLOCK_BYTES;
+    entry = allocate_entry(texture_id, mip_level, block_index, address);
+    if (!memory_->read(address, entry->data, TextureLayout::BLOCK_BYTES)) {
+        remove_entry(entry);
+        entry = nullptr;
+    } else {
+        entry->last_access_time = ++access_clock_;
+        entry->access_count = 1;
+        metrics_.bytes_transferred += TextureLayout::BLOCK_BYTES;
+    }
+    
+    if (perf_monitor_) {
+        perf_monitor_->end_timer(perf_ids_.load_from_memory);
+    }
+    return entry;
+}
+
+TextureCacheEntry* TextureCache::find_entry(uint64_t texture_id, uint32_t mip_level, uint64_t block_index) {
+    auto it = cache_entries_.find(BlockKey{texture_id, mip_level, block_index});
     return (it != cache_entries_.end()) ? it->second.get() : nullptr;
 }
 
 TextureCacheEntry* TextureCache::allocate_entry(uint64_t texture_id, uint32_t mip_level,
-                                               uint64_t address, size_t size) {
+                                               uint64_t block_index, uint64_t address) {
     // Check if we need to evict entries
-    while (current_cache_size_bytes_ + size > max_cache_size_bytes_ && !cache_entries_.empty()) {
+    while (current_cache_size_bytes_ + TextureLayout::BLOCK_BYTES > max_cache_size_bytes_ &&
+           !cache_entries_.empty()) {
         evict_least_valuable_entry();
     }
     
-    uint64_t cache_key = (texture_id << 8) | mip_level;
-    auto entry = std::make_unique<TextureCacheEntry>(texture_id, mip_level, address, size);
+    auto entry = std::make_unique<TextureCacheEntry>(texture_id, mip_level, block_index, address);
     
     TextureCacheEntry* entry_ptr = entry.get();
-    cache_entries_[cache_key] = std::move(entry);
-    current_cache_size_bytes_ += size;
+    cache_entries_[BlockKey{texture_id, mip_level, block_index}] = std::move(entry);
+    current_cache_size_bytes_ += TextureLayout::BLOCK_BYTES;
+    probation_.push_front(entry_ptr);
     
     return entry_ptr;
 }
 
-void TextureCache::evict_least_valuable_entry() {
-    if (cache_entries_.empty()) return;
+void TextureCache::touch_entry(TextureCacheEntry* entry) {
+    entry->last_access_time = ++access_clock_;
+    entry->access_count++;
+    
+    if (entry->is_protected) {
+        protected_.unlink(entry);
+        protected_.push_front(entry);
+        return;
+    }
     
-    // Find entry with lowest priority score
-    auto least_valuable = std::min_element(cache_entries_.begin(), cache_entries_.end(),
-        [this](const auto& a, const auto& b) {
-            return calculate_priority_score(*a.second) < calculate_priority_score(*b.second);
-        });
+    probation_.unlink(entry);
+    if (entry->access_count < 2) {
+        // First demand use of a prefetched block
+        probation_.push_front(entry);
+        return;
+    }
+    
+    entry->is_protected = true;
+    protected_.push_front(entry);
     
-    if (least_valuable != cache_entries_.end()) {
-        current_cache_size_bytes_ -= least_valuable->second->data.size();
-        memory_->deallocate(least_valuable->second->address);
-        cache_entries_.erase(least_valuable);
+    size_t max_blocks = max_cache_size_bytes_ / TextureLayout::BLOCK_BYTES;
+    size_t protected_capacity = std::max<size_t>(1, static_cast<size_t>(max_blocks * eviction_threshold_));
+    while (protected_.size > protected_capacity) {
+        TextureCacheEntry* demoted = protected_.tail;
+        protected_.unlink(demoted);
+        demoted->is_protected = false;
+        probation_.push_front(demoted);
     }
 }
 
-float TextureCache::calculate_priority_score(const TextureCacheEntry& entry) const {
-    auto current_time = std::chrono::duration_cast<std::chrono::microseconds>(
-        std::chrono::high_resolution_clock::now().time_since_epoch()).count();
-    
-    // Factors: recency, frequency, prefetch status
-    float recency_score = 1.0f / (1.0f + (current_time - entry.last_access_time) / 1000000.0f);
-    float frequency_score = std::log(1.0f + entry.access_count);
-    float prefetch_bonus = entry.is_prefetched ? 0.5f : 1.0f;
+void TextureCache::evict_least_valuable_entry() {
+    // Least recent probation block, or least recent protected block when
+    // everything resident has been reused
+    TextureCacheEntry* victim = probation_.tail ? probation_.tail : protected_.tail;
+    if (!victim) return;
     
-    return recency_score * frequency_score * prefetch_bonus;
+    // Blocks are copies; the texture's surface keeps the storage
+    if (perf_monitor_) {
+        perf_monitor_->trace_instant(perf_ids_.eviction_event, victim->block_index);
+    }
+    remove_entry(victim);
+    metrics_.evictions++;
 }
 
-void TextureCache::predict_future_accesses() {
-    if (recent_accesses_.size() < 3) return;
+void TextureCache::remove_entry(TextureCacheEntry* entry) {
+    if (entry->is_prefetched) {
+        metrics_.prefetch_misses++;
+    }
+    (entry->is_protected ? protected_ : probation_).unlink(entry);
+    current_cache_size_bytes_ -= TextureLayout::BLOCK_BYTES;
+    cache_entries_.erase(BlockKey{entry->texture_id, entry->mip_level, entry->block_index});
+}
+
+void TextureCache::EntryList::push_front(TextureCacheEntry* entry) {
+    entry->prev = nullptr;
+    entry->next = head;
+    if (head) head->prev = entry;
+    head = entry;
+    if (!tail) tail = entry;
+    size++;
+}
+
+void TextureCache::EntryList::unlink(TextureCacheEntry* entry) {
+    if (entry->prev) entry->prev->next = entry->next; else head = entry->next;
+    if (entry->next) entry->next->prev = entry->prev; else tail = entry->prev;
+    entry->prev = entry->next = nullptr;
+    size--;
+}
+
+void TextureCache::release_surfaces(uint64_t texture_id) {
+    // Queued prefetches must not re-create the texture's storage
+    auto request = prefetch_queue_.begin();
+    while (request != prefetch_queue_.end()) {
+        if (request->texture_id == texture_id) {
+            pending_prefetches_.erase(BlockKey{request->texture_id, request->mip_level, request->first_block});
+            request = prefetch_queue_.erase(request);
+        } else {
+            ++request;
+        }
+    }
+    if (prefetch_queue_.empty() && prefetches_in_flight_ == 0) {
+        prefetch_idle_.notify_all();
+    }
     
-    // Simple pattern detection: look for sequential texture accesses
-    auto& last_access = recent_accesses_.back();
+    auto it = cache_entries_.begin();
+    while (it != cache_entries_.end()) {
+        TextureCacheEntry* entry = it->second.get();
+        ++it;
+        if (entry->texture_id == texture_id) {
+            remove_entry(entry);
+        }
+    }
     
-    // Predict next mip level or texture ID
-    if (recent_accesses_.size() >= 2) {
-        auto& prev_access = recent_accesses_[recent_accesses_.size() - 2];
-        
-        if (prev_access.texture_id == last_access.texture_id) {
-            // Same texture, different mip level - prefetch next mip
-            uint32_t next_mip = last_access.mip_level + 1;
-            if (next_mip < 16) { // Reasonable mip level limit
-                prefetch_texture(last_access.texture_id, next_mip);
+    access_streams_.erase(texture_id);
+    
+    auto surfaces = surfaces_.find(texture_id);
+    if (surfaces != surfaces_.end()) {
+        for (auto& surface : surfaces->second) {
+            if (surface.address != 0) {
+                memory_->deallocate(surface.address);
             }
-        } else if (last_access.texture_id == prev_access.texture_id + 1) {
-            // Sequential texture access - prefetch next texture
-            prefetch_texture(last_access.texture_id + 1, last_access.mip_level);
         }
+        surfaces_.erase(surfaces);
+    }
+}
+
+void TextureCache::record_access(uint64_t texture_id, uint32_t mip_level,
+                                 const TextureSurface& surface, uint64_t block_index) {
+    bool switched = history_count_ == 0 || recent_access(0).texture_id != texture_id ||
+                    recent_access(0).mip_level != mip_level;
+    
+    auto inserted = access_streams_.emplace(texture_id, AccessStream{});
+    AccessStream& stream = inserted.first->second;
+    if (inserted.second || stream.mip_level != mip_level) {
+        // A new walk has no step to learn from yet
+        stream = AccessStream{};
+        stream.mip_level = mip_level;
+        stream.block_index = block_index;
+        block_coordinates(block_index, surface.tiled() ? TextureLayout::blocks_across(surface.width) : 0,
+                          stream.block_x, stream.block_y);
+    } else if (block_index == stream.block_index) {
+        stream.temporal_locality += LOCALITY_WEIGHT * (1.0f - stream.temporal_locality);
+    } else {
+        stream.temporal_locality -= LOCALITY_WEIGHT * stream.temporal_locality;
+        analyze_access_patterns(stream, surface, block_index);
+        if (smart_prefetching_enabled_) {
+            schedule_prefetch_operations(texture_id, stream, surface);
+        }
+    }
+    
+    // Overwrites the oldest record once the history is full
+    AccessPattern& pattern = recent_accesses_[history_next_];
+    pattern.texture_id = texture_id;
+    pattern.mip_level = mip_level;
+    pattern.block_index = block_index;
+    pattern.timestamp = access_clock_;
+    pattern.spatial_locality = stream.spatial_locality;
+    pattern.temporal_locality = stream.temporal_locality;
+    history_next_ = (history_next_ + 1) % max_pattern_history_;
+    history_count_ = std::min(history_count_ + 1, max_pattern_history_);
+    
+    if (switched && smart_prefetching_enabled_) {
+        predict_future_accesses();
+    }
+}
+
+const TextureCache::AccessPattern& TextureCache::recent_access(size_t age) const {
+    return recent_accesses_[(history_next_ + max_pattern_history_ - 1 - age) % max_pattern_history_];
+}
+
+void TextureCache::analyze_access_patterns(AccessStream& stream, const TextureSurface& surface,
+                                           uint64_t block_index) {
+    int64_t x = 0;
+    int64_t y = 0;
+    block_coordinates(block_index, surface.tiled() ? TextureLayout::blocks_across(surface.width) : 0, x, y);
+    
+    int64_t step_x = x - stream.block_x;
+    int64_t step_y = y - stream.block_y;
+    bool neighbour = step_x >= -1 && step_x <= 1 && step_y >= -1 && step_y <= 1;
+    stream.spatial_locality += LOCALITY_WEIGHT * ((neighbour ? 1.0f : 0.0f) - stream.spatial_locality);
+    
+    // A UV stride shows up as a repeated step in block coordinates
+    if (step_x == stream.stride_x && step_y == stream.stride_y) {
+        stream.stride_repeats++;
+    } else {
+        stream.stride_x = step_x;
+        stream.stride_y = step_y;
+        stream.stride_repeats = 0;
+    }
+    
+    stream.block_index = block_index;
+    stream.block_x = x;
+    stream.block_y = y;
+}
+
+void TextureCache::schedule_prefetch_operations(uint64_t texture_id, const AccessStream& stream,
+                                                const TextureSurface& surface) {
+    uint64_t blocks_per_row = surface.tiled() ? TextureLayout::blocks_across(surface.width) : 0;
+    uint64_t block_rows = surface.tiled() ? TextureLayout::blocks_across(surface.height) : 1;
+    uint64_t block_count = surface.size_bytes / TextureLayout::BLOCK_BYTES;
+    
+    auto prefetch_block = [&](int64_t x, int64_t y) {
+        if (x < 0 || y < 0 || static_cast<uint64_t>(y) >= block_rows ||
+            (blocks_per_row != 0 && static_cast<uint64_t>(x) >= blocks_per_row)) {
+            return;
+        }
+        uint64_t block = static_cast<uint64_t>(y) * blocks_per_row + static_cast<uint64_t>(x);
+        if (block < block_count && enqueue_prefetch(texture_id, stream.mip_level, block, 1) && perf_monitor_) {
+            perf_monitor_->increment_counter(perf_ids_.predicted_prefetches);
+        }
+    };
+    
+    if (stream.stride_repeats >= STRIDE_CONFIRMATIONS) {
+        // Steady stride: run ahead along it
+        uint32_t lookahead = static_cast<uint32_t>(std::lround(STRIDE_LOOKAHEAD_BLOCKS * prefetch_aggressiveness_));
+        for (uint32_t step = 1; step <= std::max(lookahead, 1u); ++step) {
+            prefetch_block(stream.block_x + stream.stride_x * step, stream.block_y + stream.stride_y * step);
+        }
+    } else if (stream.spatial_locality >= NEIGHBOUR_LOCALITY_THRESHOLD) {
+        // Wandering over neighbouring tiles, as rasterized footprints do:
+        // continue the last step and pull in the block row below
+        prefetch_block(stream.block_x + stream.stride_x, stream.block_y + stream.stride_y);
+        if (surface.tiled()) {
+            prefetch_block(stream.block_x, stream.block_y + 1);
+        }
+    }
+}
+
+void TextureCache::predict_future_accesses() {
+    if (history_count_ < 2) return;
+    
+    // Called when the sampled texture or mip changes: look for sequential
+    // texture accesses
+    const AccessPattern& last_access = recent_access(0);
+    const AccessPattern& prev_access = recent_access(1);
+    
+    if (prev_access.texture_id == last_access.texture_id) {
+        // Same texture, different mip level - prefetch next mip
+        uint32_t next_mip = last_access.mip_level + 1;
+        if (next_mip < MAX_MIP_LEVELS) {
+            prefetch_texture(last_access.texture_id, next_mip);
+        }
+    } else if (last_access.texture_id == prev_access.texture_id + 1) {
+        // Sequential texture access - prefetch next texture
+        prefetch_texture(last_access.texture_id + 1, last_access.mip_level);
     }
 }
 
 void TextureCache::tune_performance_parameters() {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     // Analyze cache performance and adjust parameters
     double hit_rate = static_cast<double>(metrics_.cache_hits) / 
                      std::max(static_cast<uint64_t>(1), metrics_.cache_hits + metrics_.cache_misses);
@@ -300,32 +799,43 @@ void TextureCache::tune_performance_parameters() {
 }
 
 void TextureCache::invalidate_texture(uint64_t texture_id) {
-    auto it = cache_entries_.begin();
-    while (it != cache_entries_.end()) {
-        if (it->second->texture_id == texture_id) {
-            current_cache_size_bytes_ -= it->second->data.size();
-            memory_->deallocate(it->second->address);
-            it = cache_entries_.erase(it);
-        } else {
-            ++it;
-        }
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    release_surfaces(texture_id);
+    if (capture_) {
+        capture_->record_invalidate_texture(texture_id);
     }
 }
 
+void TextureCache::set_command_capture(std::shared_ptr<CommandStreamWriter> capture) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    capture_ = std::move(capture);
+}
+
 void TextureCache::flush() {
-    for (auto& entry : cache_entries_) {
-        memory_->deallocate(entry.second->address);
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    // Drops cached blocks; uploaded textures stay resident in memory
+    for (const auto& entry : cache_entries_) {
+        if (entry.second->is_prefetched) {
+            metrics_.prefetch_misses++;
+        }
     }
     cache_entries_.clear();
+    probation_ = EntryList{};
+    protected_ = EntryList{};
     current_cache_size_bytes_ = 0;
     
-    // Clear prefetch queue
-    while (!prefetch_queue_.empty()) {
-        prefetch_queue_.pop();
+    // Clear prefetch queue; a request already in flight still completes
+    for (const auto& request : prefetch_queue_) {
+        pending_prefetches_.erase(BlockKey{request.texture_id, request.mip_level, request.first_block});
+    }
+    prefetch_queue_.clear();
+    if (prefetches_in_flight_ == 0) {
+        prefetch_idle_.notify_all();
     }
 }
 
 TextureCache::CacheMetrics TextureCache::get_metrics() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     CacheMetrics metrics = metrics_;
     
     uint64_t total_accesses = metrics.cache_hits + metrics.cache_misses;
@@ -345,6 +855,7 @@ TextureCache::CacheMetrics TextureCache::get_metrics() const {
 }
 
 void TextureCache::reset_metrics() {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     metrics_ = CacheMetrics{};
 }
 
@@ -0,0 +1,112 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace gpu_sim {
+
+ThreadPool::ThreadPool(size_t num_threads)
+    : queued_tasks_(0), pending_tasks_(0), stopping_(false), next_queue_(0) {
+
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    queues_.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        queues_.emplace_back(std::make_unique<WorkerQueue>());
+    }
+
+    workers_.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers_.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    wait_idle();
+
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        stopping_ = true;
+    }
+    work_available_.notify_all();
+
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    size_t index = next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        queued_tasks_++;
+        pending_tasks_++;
+    }
+    work_available_.notify_one();
+}
+
+void ThreadPool::wait_idle() {
+    std::unique_lock<std::mutex> lock(state_mutex_);
+    all_idle_.wait(lock, [this] { return pending_tasks_ == 0; });
+}
+
+bool ThreadPool::try_pop(size_t index, std::function<void()>& task) {
+    auto& queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    queue.reset_if_drained();
+    return true;
+}
+
+bool ThreadPool::try_steal(size_t thief, std::function<void()>& task) {
+    for (size_t offset = 1; offset < queues_.size(); ++offset) {
+        auto& queue = *queues_[(thief + offset) % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.empty()) {
+            task = std::move(queue.tasks[queue.head++]);
+            queue.reset_if_drained();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(size_t index) {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(state_mutex_);
+            work_available_.wait(lock, [this] { return stopping_ || queued_tasks_ > 0; });
+            if (stopping_ && queued_tasks_ == 0) {
+                return;
+            }
+            // Claim one queued task; it is guaranteed to be in some deque
+            queued_tasks_--;
+        }
+
+        std::function<void()> task;
+        while (!try_pop(index, task) && !try_steal(index, task)) {
+            std::this_thread::yield();
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            pending_tasks_--;
+            if (pending_tasks_ == 0) {
+                all_idle_.notify_all();
+            }
+        }
+    }
+}
+
+} // namespace gpu_sim
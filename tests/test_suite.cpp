@@ -3,15 +3,47 @@
 #include "graphics_pipeline.h"
 #include "texture_cache.h"
 #include "performance_monitor.h"
+#include "thread_pool.h"
+#include "command_stream.h"
 #include <iostream>
 #include <cassert>
 #include <vector>
 #include <memory>
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <new>
 
 using namespace gpu_sim;
 
+// Counts heap allocations so tests can check allocation-free hot paths
+static std::atomic<uint64_t> g_heap_allocations{0};
+
+// Kept out of line so the compiler doesn't pair inlined malloc/free with new/delete
+#if defined(__GNUC__)
+#define TEST_NOINLINE __attribute__((noinline))
+#else
+#define TEST_NOINLINE
+#endif
+
+TEST_NOINLINE void* operator new(size_t size) {
+    g_heap_allocations++;
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+TEST_NOINLINE void operator delete(void* ptr) noexcept { std::free(ptr); }
+TEST_NOINLINE void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
 // Simple test framework
 class TestFramework {
 public:
@@ -61,10 +93,134 @@ void test_gpu_core() {
     gpu_core->wait_for_completion();
     
     TestFramework::assert_true(gpu_core->is_idle(), "GPU core should be idle after completion");
-    
+
+    // Programs are decoded once, with operands validated up front
+    std::vector<uint32_t> mixed_program = {0x01, 0, 1, 2,    // ADD
+                                           0x02, 0, 99, 2,   // MUL with a bad register
+                                           0x03, 0, 64, 0,   // Malformed LOAD
+                                           0x04, 1};         // Truncated STORE
+    DecodedProgram decoded = decode_program(mixed_program);
+    TestFramework::assert_equals(4, decoded.instruction_count, "Decode should keep one entry per instruction");
+    TestFramework::assert_true(decoded.code.back().op == DecodedOp::END, "Decoded program should end with END");
+    TestFramework::assert_true(decoded.code[1].op == DecodedOp::NOP, "Out-of-range operands should decode to NOP");
+    TestFramework::assert_true(decoded.code[2].op == DecodedOp::STALL && decoded.code[2].stall_cycles == 10,
+                               "Malformed LOAD should keep its memory penalty");
+    TestFramework::assert_true(decoded.code[3].op == DecodedOp::STALL && decoded.code[3].stall_cycles == 5,
+                               "Truncated STORE should keep its memory penalty");
+
+    ShaderCore core(0);
+    core.execute_threads(decoded, 2);
+    TestFramework::assert_equals(8, core.get_instruction_count(), "Each thread should retire every instruction");
+    TestFramework::assert_equals(4, core.get_warp_instruction_count(), "Both threads should share one warp");
+    TestFramework::assert_equals(4 + 10 + 5, core.get_cycle_count(),
+                                 "Issue cycles plus stall penalties should be charged per warp");
+
     std::cout << "GPU Core tests passed!" << std::endl;
 }
 
+void test_parallel_dispatch() {
+    std::cout << "\n=== Testing Parallel Dispatch ===" << std::endl;
+    
+    // Thread pool barrier and concurrent monitor updates
+    auto perf_monitor = std::make_shared<PerformanceMonitor>();
+    {
+        ThreadPool pool(4);
+        std::atomic<uint32_t> executed{0};
+        for (int i = 0; i < 1000; ++i) {
+            pool.submit([&] {
+                executed++;
+                perf_monitor->increment_counter("pool_tasks");
+            });
+        }
+        pool.wait_idle();
+        
+        TestFramework::assert_equals(4, pool.get_thread_count(), "Pool should own 4 workers");
+        TestFramework::assert_equals(1000, executed.load(), "Every submitted task should run before the barrier");
+        TestFramework::assert_equals(1000, perf_monitor->get_counter("pool_tasks"),
+                                     "Concurrent counter updates should not be lost");
+    }
+    
+    // Chunked dispatch keeps per-core counters exact
+    auto memory = std::make_shared<MemoryHierarchy>();
+    GPUCore gpu_core(4, 4);
+    gpu_core.initialize(memory, perf_monitor);
+    TestFramework::assert_equals(4, gpu_core.get_worker_thread_count(), "GPU core should use 4 workers");
+    
+    std::vector<uint32_t> alu_program = {0x01, 0, 1, 2,   // ADD
+                                         0x02, 3, 0, 1};  // MUL
+    gpu_core.dispatch_compute(alu_program, 1000);
+    gpu_core.dispatch_compute(alu_program, 1000);
+    gpu_core.wait_for_completion();
+    
+    TestFramework::assert_true(gpu_core.is_idle(), "GPU core should be idle after the barrier");
+    uint64_t total_instructions = 0;
+    bool balanced = true;
+    for (const auto& core : gpu_core.get_shader_cores()) {
+        total_instructions += core->get_instruction_count();
+        balanced = balanced && core->get_instruction_count() == 1000;
+    }
+    TestFramework::assert_equals(4000, total_instructions, "Every thread should execute every instruction");
+    TestFramework::assert_true(balanced, "Each core should retire exactly its share of threads");
+    TestFramework::assert_equals(2000, perf_monitor->get_counter("dispatched_threads"),
+                                 "Dispatched threads should be counted per dispatch");
+    TestFramework::assert_true(perf_monitor->get_elapsed_time_ms("compute_dispatch") >= 0.0,
+                               "Dispatch time should be recorded at the barrier");
+    
+    // LOAD/STORE from several workers share one memory hierarchy
+    std::vector<uint32_t> memory_program = {0x04, 0, 1, 0,   // STORE [r0], r1
+                                            0x03, 2, 0, 0};  // LOAD r2, [r0]
+    gpu_core.dispatch_compute(memory_program, 512);
+    gpu_core.wait_for_completion();
+    
+    auto stats = memory->get_statistics();
+    TestFramework::assert_equals(2 * 512 / ShaderCore::WARP_SIZE, stats.l1_hits + stats.l1_misses,
+                                 "Each warp LOAD/STORE should coalesce into one L1 access");
+    
+    std::cout << "Parallel dispatch tests passed!" << std::endl;
+}
+
+void test_simt_warps() {
+    std::cout << "\n=== Testing SIMT Warp Execution ===" << std::endl;
+    
+    auto memory = std::make_shared<MemoryHierarchy>();
+    GPUCore gpu_core(2, 2);
+    gpu_core.initialize(memory, nullptr);
+    
+    // out[tid] = tid * tid + tid, each lane on its own registers
+    std::vector<uint32_t> program = {0x05, 0, 0, 0,   // TID r0
+                                     0x02, 1, 0, 0,   // MUL r1, r0, r0
+                                     0x01, 1, 1, 0,   // ADD r1, r1, r0
+                                     0x04, 0, 1, 0};  // STORE [r0], r1
+    const uint32_t num_threads = 100;
+    gpu_core.dispatch_compute(program, num_threads);
+    gpu_core.wait_for_completion();
+    
+    // Four warps of consecutive 4-byte stores touch at most 3 L1 lines each
+    auto stats = memory->get_statistics();
+    uint64_t l1_accesses = stats.l1_hits + stats.l1_misses;
+    TestFramework::assert_true(l1_accesses > 0 && l1_accesses <= 4 * 3,
+                               "Warp stores should coalesce by cache line, not by lane");
+    
+    bool per_lane_results = true;
+    for (uint32_t tid = 0; tid < num_threads; ++tid) {
+        float value = -1.0f;
+        memory->read(tid * sizeof(float), &value, sizeof(float));
+        per_lane_results = per_lane_results && value == static_cast<float>(tid * tid + tid);
+    }
+    TestFramework::assert_true(per_lane_results, "Every lane should compute with its own registers");
+    
+    // 50 threads per core: one full warp and one warp with 18 active lanes
+    for (const auto& core : gpu_core.get_shader_cores()) {
+        TestFramework::assert_equals(2, core->get_warp_count(), "Each core should launch two warps");
+        TestFramework::assert_equals(2 * 4, core->get_warp_instruction_count(),
+                                     "Instructions should issue once per warp");
+        TestFramework::assert_equals(50 * 4, core->get_instruction_count(),
+                                     "Only active lanes should count as thread instructions");
+    }
+    
+    std::cout << "SIMT warp tests passed!" << std::endl;
+}
+
 void test_memory_hierarchy() {
     std::cout << "\n=== Testing Memory Hierarchy ===" << std::endl;
     
@@ -99,6 +255,370 @@ void test_memory_hierarchy() {
     std::cout << "Memory Hierarchy tests passed!" << std::endl;
 }
 
+void test_gpu_cache() {
+    std::cout << "\n=== Testing GPU Cache ===" << std::endl;
+    
+    // 4 sets, 2 ways, 64-byte lines
+    GPUCache cache(512, 64, 2);
+    uint32_t value = 0x12345678;
+    uint32_t read_value = 0;
+    
+    TestFramework::assert_true(!cache.read(0x100, &read_value, 4), "Cold read should miss");
+    cache.write(0x100, &value, 4);
+    TestFramework::assert_true(cache.read(0x100, &read_value, 4), "Read after write should hit");
+    TestFramework::assert_equals(value, read_value, "Cached data should match written data");
+    
+    // Three lines mapping to the same set: the least recently used is evicted
+    uint64_t set_stride = 4 * 64;
+    cache.write(0x100 + set_stride, &value, 4);
+    cache.read(0x100, &read_value, 4);
+    cache.write(0x100 + 2 * set_stride, &value, 4);
+    TestFramework::assert_true(cache.read(0x100, &read_value, 4), "Recently used line should survive eviction");
+    TestFramework::assert_true(!cache.read(0x100 + set_stride, &read_value, 4), "LRU line should be evicted");
+    
+    cache.invalidate(0x100);
+    TestFramework::assert_true(!cache.read(0x100, &read_value, 4), "Invalidated line should miss");
+    
+    cache.flush();
+    TestFramework::assert_true(!cache.read(0x100 + 2 * set_stride, &read_value, 4), "Flushed cache should miss");
+    
+    std::cout << "GPU Cache tests passed!" << std::endl;
+}
+
+void test_unaligned_and_batched_access() {
+    std::cout << "\n=== Testing Unaligned and Batched Memory Access ===" << std::endl;
+    
+    auto memory = std::make_shared<MemoryHierarchy>();
+    uint64_t base = memory->allocate(4096);
+    
+    // Write a pattern that crosses several L1 (64B) and L2 (128B) lines
+    std::vector<uint8_t> pattern(300);
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        pattern[i] = static_cast<uint8_t>(i * 7 + 3);
+    }
+    TestFramework::assert_true(memory->write(base + 37, pattern.data(), pattern.size()),
+                              "Line-spanning write should succeed");
+    
+    std::vector<uint8_t> read_back(pattern.size());
+    TestFramework::assert_true(memory->read(base + 37, read_back.data(), read_back.size()),
+                              "Line-spanning read should succeed");
+    TestFramework::assert_true(read_back == pattern, "Line-spanning read should return all written bytes");
+    
+    // Partial accesses must see neighbouring bytes that are already in the line
+    uint8_t neighbour = 0;
+    memory->read(base + 38, &neighbour, 1);
+    TestFramework::assert_equals(pattern[1], neighbour, "Partial read should see previously written neighbour");
+    
+    // Batched reads of scattered, overlapping requests
+    std::vector<uint8_t> a(16), b(100), c(8);
+    std::vector<MemoryReadRequest> reads = {
+        {base + 200, a.size(), a.data()},
+        {base + 37, b.size(), b.data()},
+        {base + 40, c.size(), c.data()}
+    };
+    TestFramework::assert_true(memory->read_batch(reads), "Batched read should succeed");
+    TestFramework::assert_true(std::equal(a.begin(), a.end(), pattern.begin() + 163), "Batched read A should match");
+    TestFramework::assert_true(std::equal(b.begin(), b.end(), pattern.begin()), "Batched read B should match");
+    TestFramework::assert_true(std::equal(c.begin(), c.end(), pattern.begin() + 3), "Batched read C should match");
+    
+    // Batched writes apply in request order and coalesce per line
+    uint32_t first = 0x11111111, second = 0x22222222;
+    std::vector<MemoryWriteRequest> writes = {
+        {base + 1000, sizeof(first), &first},
+        {base + 1000, sizeof(second), &second},
+        {base + 1086, sizeof(first), &first}
+    };
+    TestFramework::assert_true(memory->write_batch(writes), "Batched write should succeed");
+    
+    uint32_t result = 0;
+    memory->flush_all_caches();
+    memory->read(base + 1000, &result, sizeof(result));
+    TestFramework::assert_equals(second, result, "Later batched write should win");
+    memory->read(base + 1086, &result, sizeof(result));
+    TestFramework::assert_equals(first, result, "Line-spanning batched write should reach memory");
+    
+    std::vector<MemoryReadRequest> out_of_bounds = {{memory->get_vram_size() - 2, 4, &result}};
+    TestFramework::assert_true(!memory->read_batch(out_of_bounds), "Out-of-bounds batched read should fail");
+    
+    std::cout << "Unaligned and Batched Memory Access tests passed!" << std::endl;
+}
+
+template <typename Policy>
+void check_replacement_policy(const std::string& name, bool tracks_recency) {
+    // Single set, 4 ways, 64-byte lines
+    GPUCache<Policy> cache(256, 64, 4);
+    uint32_t value = 0;
+    
+    for (uint64_t line = 0; line < 4; ++line) {
+        cache.write(line * 64, &value, sizeof(value));
+    }
+    // Touch line 3 so a recency-tracking policy keeps it
+    cache.read(3 * 64, &value, sizeof(value));
+    cache.write(4 * 64, &value, sizeof(value));
+    
+    uint32_t resident = 0;
+    for (uint64_t line = 0; line < 5; ++line) {
+        if (cache.read(line * 64, &value, sizeof(value))) {
+            resident++;
+        }
+    }
+    TestFramework::assert_equals(4, resident, name + " should evict exactly one line");
+    
+    if (tracks_recency) {
+        GPUCache<Policy> fresh(256, 64, 4);
+        for (uint64_t line = 0; line < 4; ++line) {
+            fresh.write(line * 64, &value, sizeof(value));
+        }
+        fresh.read(0, &value, sizeof(value));
+        fresh.write(4 * 64, &value, sizeof(value));
+        TestFramework::assert_true(fresh.read(0, &value, sizeof(value)),
+                                  name + " should keep the most recently used line");
+    }
+}
+
+void test_replacement_policies() {
+    std::cout << "\n=== Testing Cache Replacement Policies ===" << std::endl;
+    
+    check_replacement_policy<LRUPolicy>("LRU", true);
+    check_replacement_policy<TreePLRUPolicy>("Tree-PLRU", true);
+    check_replacement_policy<SRRIPPolicy>("SRRIP", true);
+    check_replacement_policy<BRRIPPolicy>("BRRIP", false);
+    check_replacement_policy<RandomPolicy>("Random", false);
+    
+    // Per-level policy selection through MemoryConfig
+    MemoryConfig config;
+    config.vram_size = 64ULL * 1024 * 1024;
+    config.l1_policy = ReplacementPolicy::TREE_PLRU;
+    config.l2_policy = ReplacementPolicy::SRRIP;
+    auto memory = std::make_shared<MemoryHierarchy>(config);
+    
+    bool data_correct = true;
+    for (uint32_t i = 0; i < 4096; ++i) {
+        memory->write(i * 256, &i, sizeof(i));
+    }
+    for (uint32_t i = 0; i < 4096; ++i) {
+        uint32_t value = 0;
+        memory->read(i * 256, &value, sizeof(value));
+        data_correct &= (value == i);
+    }
+    TestFramework::assert_true(data_correct, "Configured policies should preserve data under eviction");
+    
+    std::cout << "Cache Replacement Policy tests passed!" << std::endl;
+}
+
+void test_write_policies() {
+    std::cout << "\n=== Testing Cache Write Policies ===" << std::endl;
+    
+    MemoryConfig config;
+    config.vram_size = 64ULL * 1024 * 1024;
+    config.write_policy = WritePolicy::WRITE_BACK;
+    auto memory = std::make_shared<MemoryHierarchy>(config);
+    
+    // Repeated stores to a resident line stay in L1
+    uint64_t value = 0;
+    for (value = 0; value < 100; ++value) {
+        memory->write(0x1000, &value, sizeof(value));
+    }
+    auto stats = memory->get_statistics();
+    TestFramework::assert_equals(0, stats.vram_writes, "Write-back stores should not reach VRAM");
+    
+    memory->flush_all_caches();
+    stats = memory->get_statistics();
+    TestFramework::assert_true(stats.vram_writes > 0, "Flush should write dirty lines back to VRAM");
+    TestFramework::assert_true(stats.l1_writebacks > 0 && stats.l2_writebacks > 0,
+                              "Flush should write back through both levels");
+    
+    uint64_t read_value = 0;
+    memory->read(0x1000, &read_value, sizeof(read_value));
+    TestFramework::assert_equals(99, read_value, "Flushed data should be read back from VRAM");
+    
+    // Stream far more data than L1 + L2 hold so dirty lines are evicted
+    bool data_correct = true;
+    for (uint64_t i = 0; i < 32768; ++i) {
+        memory->write(0x100000 + i * 64, &i, sizeof(i));
+    }
+    for (uint64_t i = 0; i < 32768; ++i) {
+        memory->read(0x100000 + i * 64, &read_value, sizeof(read_value));
+        data_correct &= (read_value == i);
+    }
+    TestFramework::assert_true(data_correct, "Evicted dirty lines should be written back");
+    
+    // No-write-allocate: store misses bypass the caches
+    MemoryConfig no_allocate_config = config;
+    no_allocate_config.write_allocate = false;
+    auto no_allocate = std::make_shared<MemoryHierarchy>(no_allocate_config);
+    value = 42;
+    no_allocate->write(0x2000, &value, sizeof(value));
+    stats = no_allocate->get_statistics();
+    TestFramework::assert_equals(1, stats.vram_writes, "No-write-allocate store miss should go to VRAM");
+    no_allocate->read(0x2000, &read_value, sizeof(read_value));
+    TestFramework::assert_equals(42, read_value, "No-write-allocate store should be readable");
+    TestFramework::assert_equals(1, no_allocate->get_statistics().vram_reads,
+                                "First read after a bypassed store should miss to VRAM");
+    
+    std::cout << "Cache Write Policy tests passed!" << std::endl;
+}
+
+void test_memory_latency() {
+    std::cout << "\n=== Testing Memory Latency Model ===" << std::endl;
+    
+    MemoryConfig config;
+    config.vram_size = 64ULL * 1024 * 1024;
+    auto memory = std::make_shared<MemoryHierarchy>(config);
+    
+    uint32_t value = 0;
+    MemoryTiming cold;
+    memory->read(0x4000, &value, sizeof(value), &cold);
+    MemoryTiming warm;
+    memory->read(0x4000, &value, sizeof(value), &warm);
+    
+    TestFramework::assert_true(cold.latency_cycles >= config.l1_latency + config.l2_latency + config.vram_latency,
+                              "Cold read should pay L1, L2 and VRAM latency");
+    TestFramework::assert_equals(config.l1_latency, warm.latency_cycles, "Warm read should cost one L1 hit");
+    
+    // Misses issued together serialize on the VRAM channel
+    std::vector<uint32_t> values(64);
+    std::vector<MemoryReadRequest> requests;
+    for (size_t i = 0; i < values.size(); ++i) {
+        requests.push_back({0x100000 + i * 4096, sizeof(uint32_t), &values[i]});
+    }
+    MemoryTiming batch;
+    batch.issue_cycle = 1000;
+    memory->read_batch(requests, &batch);
+    
+    auto stats = memory->get_statistics();
+    TestFramework::assert_true(stats.vram_queue_cycles > 0, "Back-to-back misses should queue on VRAM");
+    TestFramework::assert_true(batch.latency_cycles > cold.latency_cycles,
+                              "Batched misses should take longer than a single miss");
+    TestFramework::assert_equals(66, stats.l1_latency.samples, "L1 histogram should record every line access");
+    TestFramework::assert_equals(65, stats.vram_latency.samples, "VRAM histogram should record every transfer");
+    
+    // Shader LOAD charges the real access latency
+    auto gpu_core = std::make_shared<GPUCore>(1);
+    gpu_core->initialize(memory, std::make_shared<PerformanceMonitor>());
+    auto& core = gpu_core->get_shader_cores()[0];
+    core->execute_instruction({0x03, 4, 0, 0});
+    uint64_t cold_cycles = core->get_cycle_count();
+    core->execute_instruction({0x03, 4, 0, 0});
+    uint64_t warm_cycles = core->get_cycle_count() - cold_cycles;
+    TestFramework::assert_true(cold_cycles > warm_cycles, "Shader LOAD miss should cost more than a hit");
+    
+    std::cout << "Memory Latency Model tests passed!" << std::endl;
+}
+
+void test_vram_allocator() {
+    std::cout << "\n=== Testing VRAM Allocator ===" << std::endl;
+    
+    MemoryConfig config;
+    config.l1_line_size = 32;
+    auto memory = std::make_shared<MemoryHierarchy>(config);
+    
+    uint64_t initial_largest = memory->get_allocator_statistics().largest_free_block;
+    
+    // Freed memory is reused, so repeated 1MB allocations never exhaust VRAM
+    bool all_succeeded = true;
+    for (int i = 0; i < 10000; ++i) {
+        uint64_t address = memory->allocate(1024 * 1024);
+        all_succeeded &= (address != 0);
+        memory->deallocate(address);
+    }
+    TestFramework::assert_true(all_succeeded, "Allocate/free cycles should not exhaust VRAM");
+    
+    auto stats = memory->get_allocator_statistics();
+    TestFramework::assert_equals(0, stats.live_allocations, "No allocations should remain live");
+    TestFramework::assert_equals(1024 * 1024, stats.peak_bytes_allocated, "High-water mark should be one block");
+    TestFramework::assert_equals(initial_largest, stats.largest_free_block, "Freed blocks should coalesce");
+    
+    // Fragment the heap and check the statistics reflect it
+    std::vector<uint64_t> blocks;
+    for (int i = 0; i < 8; ++i) {
+        blocks.push_back(memory->allocate(4096));
+    }
+    uint64_t largest_before = memory->get_allocator_statistics().largest_free_block;
+    for (size_t i = 0; i < blocks.size(); i += 2) {
+        memory->deallocate(blocks[i]);
+    }
+    stats = memory->get_allocator_statistics();
+    TestFramework::assert_equals(4, stats.live_allocations, "Half of the blocks should remain live");
+    TestFramework::assert_equals(largest_before, stats.largest_free_block,
+                                "Non-adjacent frees should not coalesce into a larger block");
+    for (size_t i = 1; i < blocks.size(); i += 2) {
+        memory->deallocate(blocks[i]);
+    }
+    uint64_t reused = memory->allocate(8 * 4096);
+    TestFramework::assert_equals(blocks[0], reused, "Coalesced blocks should be reused for a larger request");
+    
+    // Internal fragmentation from rounding to a power of two
+    uint64_t odd = memory->allocate(3000);
+    stats = memory->get_allocator_statistics();
+    TestFramework::assert_true(stats.internal_fragmentation > 0.0, "Rounded allocations should report internal fragmentation");
+    
+    // Deallocation invalidates every line of the allocation at each level's line size
+    uint32_t value = 7;
+    memory->write(odd + 32, &value, sizeof(value));
+    memory->deallocate(odd);
+    uint64_t misses_before = memory->get_statistics().l1_misses;
+    memory->read(odd + 32, &value, sizeof(value));
+    TestFramework::assert_equals(misses_before + 1, memory->get_statistics().l1_misses,
+                                "Deallocated lines should be invalidated in L1");
+    
+    std::cout << "VRAM Allocator tests passed!" << std::endl;
+}
+
+void test_sparse_vram() {
+    std::cout << "\n=== Testing Sparse VRAM ===" << std::endl;
+    
+    MemoryConfig config;
+    config.vram_size = 512ULL * 1024 * 1024; // 512MB
+    config.vram_page_size = 4096;
+    auto memory = std::make_shared<MemoryHierarchy>(config);
+    
+    TestFramework::assert_equals(config.vram_size, memory->get_vram_size(), "VRAM size should be configurable");
+    TestFramework::assert_equals(0, memory->get_statistics().vram_resident_pages,
+                                "No pages should be resident after construction");
+    
+    // Reads of untouched memory return zeros without materializing pages
+    std::vector<uint8_t> read_buffer(8192, 0xFF);
+    TestFramework::assert_true(memory->read(0x1000, read_buffer.data(), read_buffer.size()),
+                              "Read of untouched memory should succeed");
+    bool all_zero = std::all_of(read_buffer.begin(), read_buffer.end(), [](uint8_t b) { return b == 0; });
+    TestFramework::assert_true(all_zero, "Untouched memory should read as zero");
+    TestFramework::assert_equals(0, memory->get_statistics().vram_resident_pages,
+                                "Reads should not materialize pages");
+    
+    // A write straddling a page boundary materializes both pages
+    uint64_t addr = 3 * config.vram_page_size - 2;
+    uint32_t value = 0xCAFEBABE;
+    TestFramework::assert_true(memory->write(addr, &value, sizeof(value)), "Page-straddling write should succeed");
+    TestFramework::assert_equals(2, memory->get_statistics().vram_resident_pages,
+                                "Page-straddling write should materialize two pages");
+    
+    // Bounds checking against configured capacity
+    TestFramework::assert_true(!memory->write(config.vram_size - 2, &value, sizeof(value)),
+                              "Write past end of VRAM should fail");
+    TestFramework::assert_true(memory->allocate(config.vram_size) == 0,
+                              "Allocation larger than VRAM should fail");
+    
+    // Page sizes become powers of two; zero takes the default
+    VRAMStore default_pages(1024 * 1024, 0);
+    TestFramework::assert_equals(VRAMStore::DEFAULT_PAGE_SIZE, default_pages.get_page_size(),
+                                 "Zero page size should select the default");
+    VRAMStore rounded_pages(1024 * 1024, 3000);
+    TestFramework::assert_equals(4096, rounded_pages.get_page_size(), "Page size should round up to a power of two");
+    TestFramework::assert_true(rounded_pages.write(4096 - 2, &value, sizeof(value)) &&
+                               rounded_pages.get_resident_pages() == 2,
+                               "Rounded pages should split writes at their boundaries");
+    uint32_t read_back = 0;
+    TestFramework::assert_true(rounded_pages.read(4096 - 2, &read_back, sizeof(read_back)) && read_back == value,
+                               "Rounded pages should read back straddling writes");
+    config.vram_page_size = 0;
+    auto default_memory = std::make_shared<MemoryHierarchy>(config);
+    TestFramework::assert_true(default_memory->write(addr, &value, sizeof(value)),
+                               "Zero page size in the config should still store writes");
+    
+    std::cout << "Sparse VRAM tests passed!" << std::endl;
+}
+
 void test_texture_cache() {
     std::cout << "\n=== Testing Advanced Texture Cache ===" << std::endl;
     
@@ -142,6 +662,294 @@ void test_texture_cache() {
     std::cout << "Advanced Texture Cache tests passed!" << std::endl;
 }
 
+void test_texture_blocks() {
+    std::cout << "\n=== Testing Tiled Texture Blocks ===" << std::endl;
+    
+    // Tiled addressing is a bijection onto the padded block grid
+    const uint32_t width = 6, height = 5;
+    std::vector<bool> used(TextureLayout::mip_size_bytes(width, height) / TextureLayout::TEXEL_BYTES, false);
+    bool unique = true;
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            uint64_t texel = TextureLayout::texel_offset(x, y, width) / TextureLayout::TEXEL_BYTES;
+            unique = unique && !used[texel];
+            used[texel] = true;
+        }
+    }
+    TestFramework::assert_true(unique, "Every texel should map to its own tiled slot");
+    TestFramework::assert_equals(TextureLayout::texel_offset(1, 1, width) + TextureLayout::TEXEL_BYTES,
+                                 TextureLayout::texel_offset(2, 0, width),
+                                 "Texels should be Morton-ordered within a block");
+    
+    auto memory = std::make_shared<MemoryHierarchy>();
+    TextureCache texture_cache(16);
+    texture_cache.initialize(memory, nullptr);
+    texture_cache.enable_smart_prefetching(false);
+    texture_cache.enable_adaptive_caching(false);
+    
+    // 64x32 texture with a distinct value per texel and a generated mip chain
+    Texture texture;
+    texture.width = 64;
+    texture.height = 32;
+    texture.format = 0;
+    texture.mip_levels = 4;
+    texture.data.resize(texture.width * texture.height * 4);
+    for (uint32_t y = 0; y < texture.height; ++y) {
+        for (uint32_t x = 0; x < texture.width; ++x) {
+            uint8_t* texel = &texture.data[(y * texture.width + x) * 4];
+            texel[0] = static_cast<uint8_t>(x * 4);
+            texel[1] = static_cast<uint8_t>(y * 8);
+            texel[2] = static_cast<uint8_t>(x ^ y);
+            texel[3] = 255;
+        }
+    }
+    TestFramework::assert_true(texture_cache.upload_texture(7, texture), "Texture upload should succeed");
+    
+    uint8_t texel[4];
+    auto before = texture_cache.get_metrics();
+    TestFramework::assert_true(texture_cache.read_texel(7, 0, 37, 21, texel), "Texel read should succeed");
+    TestFramework::assert_true(texel[0] == 37 * 4 && texel[1] == 21 * 8 && texel[2] == (37 ^ 21),
+                               "Texel read should return the uploaded texel");
+    auto after_miss = texture_cache.get_metrics();
+    TestFramework::assert_equals(TextureLayout::BLOCK_BYTES, after_miss.bytes_transferred - before.bytes_transferred,
+                                 "A single-texel miss should fetch one block");
+    
+    // Texels in the same 4x4 block hit; the linear byte API agrees
+    texture_cache.read_texel(7, 0, 38, 22, texel);
+    auto after_neighbour = texture_cache.get_metrics();
+    TestFramework::assert_equals(after_miss.cache_hits + 1, after_neighbour.cache_hits,
+                                 "A neighbouring texel should hit the cached block");
+    uint8_t row[16];
+    TestFramework::assert_true(texture_cache.read_texture(7, 0, (21 * 64 + 36) * 4, row, sizeof(row)),
+                               "Linear reads of uploaded textures should succeed");
+    TestFramework::assert_true(memcmp(row, &texture.data[(21 * 64 + 36) * 4], sizeof(row)) == 0,
+                               "Linear reads should see the original row-major texels");
+    
+    // Mips are box-filtered from the level above; the chain stops at 1x1
+    TestFramework::assert_true(texture_cache.read_texel(7, 1, 3, 2, texel), "Mip texel read should succeed");
+    TestFramework::assert_equals(((6 + 7) * 4 * 2 + 2) / 4, texel[0], "Mip 1 should average its 2x2 footprint");
+    TestFramework::assert_true(!texture_cache.read_texel(7, 1, 32, 0, texel), "Reads outside a mip should fail");
+    TestFramework::assert_true(!texture_cache.read_texel(7, 4, 0, 0, texel), "Missing mip levels should fail");
+    
+    std::cout << "Tiled texture block tests passed!" << std::endl;
+}
+
+void test_texture_eviction() {
+    std::cout << "\n=== Testing Texture Cache Eviction ===" << std::endl;
+    
+    auto memory = std::make_shared<MemoryHierarchy>();
+    TextureCache texture_cache(1);  // 16384 blocks
+    texture_cache.initialize(memory, nullptr);
+    texture_cache.enable_smart_prefetching(false);
+    texture_cache.enable_adaptive_caching(false);
+    
+    const uint64_t capacity_blocks = 1024 * 1024 / TextureLayout::BLOCK_BYTES;
+    uint8_t block[TextureLayout::BLOCK_BYTES];
+    
+    // A reused working set, then a one-touch scan of twice the cache size
+    for (int pass = 0; pass < 2; ++pass) {
+        for (uint64_t i = 0; i < 256; ++i) {
+            texture_cache.read_texture(1, 0, i * TextureLayout::BLOCK_BYTES, block, sizeof(block));
+        }
+    }
+    for (uint64_t texture_id = 2; texture_id <= 3; ++texture_id) {
+        for (uint64_t i = 0; i < capacity_blocks; ++i) {
+            texture_cache.read_texture(texture_id, 0, i * TextureLayout::BLOCK_BYTES, block, sizeof(block));
+        }
+    }
+    auto before = texture_cache.get_metrics();
+    for (uint64_t i = 0; i < 256; ++i) {
+        texture_cache.read_texture(1, 0, i * TextureLayout::BLOCK_BYTES, block, sizeof(block));
+    }
+    auto after = texture_cache.get_metrics();
+    
+    TestFramework::assert_greater_than(before.evictions, capacity_blocks,
+                                       "A scan larger than the cache should evict");
+    TestFramework::assert_true(before.cache_utilization_percent <= 100, "The cache should stay within capacity");
+    TestFramework::assert_equals(256, after.cache_hits - before.cache_hits,
+                                 "Reused blocks should survive a one-touch scan");
+    
+    std::cout << "Texture cache eviction tests passed!" << std::endl;
+}
+
+void test_texture_prefetch() {
+    std::cout << "\n=== Testing Asynchronous Texture Prefetch ===" << std::endl;
+    
+    auto memory = std::make_shared<MemoryHierarchy>();
+    auto perf_monitor = std::make_shared<PerformanceMonitor>();
+    TextureCache texture_cache(1);
+    texture_cache.initialize(memory, perf_monitor);
+    texture_cache.enable_smart_prefetching(false);
+    texture_cache.enable_adaptive_caching(false);
+    texture_cache.set_prefetch_distance(20);  // 14 blocks at the default 0.7 aggressiveness
+    
+    Texture texture;
+    texture.width = 64;
+    texture.height = 64;
+    texture.format = 0;
+    texture.mip_levels = 1;
+    texture.data.assign(texture.width * texture.height * 4, 0x80);
+    uint64_t texture_id = texture_cache.register_texture(texture);
+    
+    // Duplicate requests collapse onto the pending one or the resident blocks
+    for (int i = 0; i < 8; ++i) {
+        texture_cache.prefetch_texture(texture_id, 0);
+    }
+    texture_cache.wait_for_prefetches();
+    auto prefetched = texture_cache.get_metrics();
+    TestFramework::assert_equals(14 * TextureLayout::BLOCK_BYTES, prefetched.bytes_transferred,
+                                 "Prefetch should fetch distance x aggressiveness blocks once");
+    TestFramework::assert_equals(0, prefetched.cache_hits + prefetched.cache_misses,
+                                 "Prefetching should not count as demand accesses");
+    
+    // Block 1 is texels (4..7, 0..3)
+    uint8_t texel[4];
+    texture_cache.read_texel(texture_id, 0, 5, 2, texel);
+    texture_cache.read_texel(texture_id, 0, 6, 3, texel);
+    auto used = texture_cache.get_metrics();
+    TestFramework::assert_equals(2, used.cache_hits, "Prefetched blocks should serve demand reads");
+    TestFramework::assert_equals(1, used.prefetch_hits, "A prefetched block should count one prefetch hit");
+    
+    // Prefetched blocks evicted unused are prefetch misses
+    uint8_t block[TextureLayout::BLOCK_BYTES];
+    for (uint64_t i = 0; i < 1024 * 1024 / TextureLayout::BLOCK_BYTES; ++i) {
+        texture_cache.read_texture(99, 0, i * sizeof(block), block, sizeof(block));
+    }
+    auto evicted = texture_cache.get_metrics();
+    TestFramework::assert_equals(13, evicted.prefetch_misses, "Unused prefetched blocks should count as misses");
+    TestFramework::assert_true(evicted.prefetch_efficiency > 0.0 && evicted.prefetch_efficiency < 0.1,
+                               "Prefetch efficiency should reflect used versus wasted prefetches");
+    
+    std::cout << "Asynchronous texture prefetch tests passed!" << std::endl;
+}
+
+void test_texture_access_prediction() {
+    std::cout << "\n=== Testing Texture Access Prediction ===" << std::endl;
+    
+    auto memory = std::make_shared<MemoryHierarchy>();
+    auto perf_monitor = std::make_shared<PerformanceMonitor>();
+    TextureCache texture_cache(1);
+    texture_cache.initialize(memory, perf_monitor);
+    texture_cache.enable_adaptive_caching(false);
+    
+    Texture texture;
+    texture.width = 64;
+    texture.height = 64;
+    texture.format = 0;
+    texture.mip_levels = 1;
+    texture.data.assign(texture.width * texture.height * 4, 0x40);
+    uint64_t texture_id = texture_cache.register_texture(texture);
+    
+    // Hopping between distant blocks gives the predictor nothing to follow
+    const uint32_t scattered[][2] = {{0, 0}, {9, 3}, {2, 12}, {14, 7}, {5, 1}, {11, 14}, {1, 6}, {8, 10}};
+    uint8_t texel[4];
+    for (const auto& block : scattered) {
+        texture_cache.read_texel(texture_id, 0, block[0] * 4, block[1] * 4, texel);
+        texture_cache.wait_for_prefetches();
+    }
+    TestFramework::assert_equals(0, perf_monitor->get_counter("texture_predicted_prefetches"),
+                                 "Scattered reads should not trigger predicted prefetches");
+    
+    // Walking down a column of blocks: three steps confirm the stride, then
+    // every following block arrives ahead of its first sample
+    texture_cache.flush();
+    texture_cache.reset_metrics();
+    for (uint32_t row = 0; row < 16; ++row) {
+        texture_cache.read_texel(texture_id, 0, 1, row * 4 + 1, texel);
+        texture_cache.read_texel(texture_id, 0, 2, row * 4 + 2, texel);
+        texture_cache.wait_for_prefetches();
+    }
+    auto strided = texture_cache.get_metrics();
+    TestFramework::assert_equals(4, strided.cache_misses, "Only blocks before the stride is confirmed should miss");
+    TestFramework::assert_equals(12, strided.prefetch_hits, "Every block past the confirmed stride should be prefetched");
+    TestFramework::assert_equals(12, perf_monitor->get_counter("texture_predicted_prefetches"),
+                                 "The stride should stop at the texture's edge");
+    
+    // Untyped surfaces are walked as one row of blocks; the access history
+    // wraps well before the walk ends
+    texture_cache.reset_metrics();
+    uint8_t block[TextureLayout::BLOCK_BYTES];
+    for (uint64_t i = 0; i < 1500; ++i) {
+        texture_cache.read_texture(7, 0, i * sizeof(block), block, sizeof(block));
+        texture_cache.wait_for_prefetches();
+    }
+    auto sequential = texture_cache.get_metrics();
+    TestFramework::assert_equals(4, sequential.cache_misses, "Sequential untyped reads should be prefetched");
+    TestFramework::assert_equals(1496, sequential.prefetch_hits, "Prefetched untyped blocks should all be used");
+    
+    std::cout << "Texture access prediction tests passed!" << std::endl;
+}
+
+void test_texture_registry() {
+    std::cout << "\n=== Testing Texture Registry ===" << std::endl;
+    
+    auto memory = std::make_shared<MemoryHierarchy>();
+    auto texture_cache = std::make_shared<TextureCache>(16);
+    texture_cache->initialize(memory, nullptr);
+    
+    auto solid_texture = [](uint8_t r, uint8_t g, uint8_t b) {
+        Texture texture;
+        texture.width = 16;
+        texture.height = 16;
+        texture.format = 0;
+        texture.mip_levels = 1;
+        for (uint32_t i = 0; i < texture.width * texture.height; ++i) {
+            texture.data.insert(texture.data.end(), {r, g, b, 255});
+        }
+        return texture;
+    };
+    
+    uint64_t first = texture_cache->register_texture(solid_texture(255, 0, 0));
+    uint64_t second = texture_cache->register_texture(solid_texture(255, 0, 0));
+    TestFramework::assert_true(first >= TextureCache::FIRST_REGISTERED_TEXTURE_ID && second != first,
+                               "Registered textures should get distinct ids");
+    texture_cache->invalidate_texture(first);
+    uint64_t third = texture_cache->register_texture(solid_texture(0, 0, 255));
+    TestFramework::assert_true(third != first && third != second, "Released ids should not be reused");
+    uint8_t texel[4];
+    TestFramework::assert_true(!texture_cache->read_texel(first, 0, 0, 0, texel),
+                               "Released textures should no longer be readable");
+    
+    // The pipeline uploads at bind time and samples real texels; a re-bind
+    // with new contents must not hit the previous texture's blocks
+    PipelineState state;
+    state.viewport_width = 64;
+    state.viewport_height = 64;
+    state.depth_test_enabled = false;
+    state.blending_enabled = false;
+    state.culling_enabled = true;
+    
+    GraphicsPipeline pipeline(1);
+    pipeline.initialize(nullptr, memory, texture_cache, nullptr);
+    pipeline.set_pipeline_state(state);
+    std::vector<Vertex> triangle = {
+        {{-1.0f, -1.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+        {{1.0f, -1.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.9f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+        {{-1.0f, 1.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.9f}, {0.0f, 0.0f, 1.0f}}
+    };
+    
+    auto center_color = [&](const Texture& texture) {
+        pipeline.bind_texture(0, texture);
+        pipeline.begin_frame();
+        pipeline.draw_triangles(triangle);
+        pipeline.end_frame();
+        return pipeline.get_color_buffer()[16 * 64 + 16];
+    };
+    TestFramework::assert_equals(0xFF0000FFu, center_color(solid_texture(255, 0, 0)),
+                                 "Fragments should be modulated by the bound texture");
+    TestFramework::assert_equals(0x00FF00FFu, center_color(solid_texture(0, 255, 0)),
+                                 "Re-binding new contents should not return stale texels");
+    
+    pipeline.bind_texture(0, third);
+    pipeline.begin_frame();
+    pipeline.draw_triangles(triangle);
+    pipeline.end_frame();
+    TestFramework::assert_equals(0x0000FFFFu, pipeline.get_color_buffer()[16 * 64 + 16],
+                                 "Binding by id should sample the registered texture");
+    
+    std::cout << "Texture registry tests passed!" << std::endl;
+}
+
 void test_graphics_pipeline() {
     std::cout << "\n=== Testing Graphics Pipeline ===" << std::endl;
     
@@ -185,6 +993,727 @@ void test_graphics_pipeline() {
     std::cout << "Graphics Pipeline tests passed!" << std::endl;
 }
 
+void test_rasterizer() {
+    std::cout << "\n=== Testing Edge-Function Rasterizer ===" << std::endl;
+    
+    auto pipeline = std::make_shared<GraphicsPipeline>();
+    pipeline->initialize(nullptr, nullptr, nullptr, nullptr);
+    
+    PipelineState state;
+    state.viewport_width = 400;
+    state.viewport_height = 400;
+    state.depth_test_enabled = false;
+    state.blending_enabled = false;
+    state.culling_enabled = true;
+    pipeline->set_pipeline_state(state);
+    
+    auto vertex = [](float x, float y, float w, float s) {
+        return Vertex{{x * w, y * w, 0.0f, w}, {1.0f, 1.0f, 1.0f, 1.0f}, {s, 0.0f}, {0.0f, 0.0f, 1.0f}};
+    };
+    
+    // A 200x200 pixel quad split along a diagonal whose pixel centres lie
+    // exactly on the shared edge: the fill rule must cover each pixel once
+    std::vector<Vertex> quad = {
+        vertex(-0.5f, -0.5f, 1.0f, 0.0f), vertex(0.5f, -0.5f, 1.0f, 0.0f), vertex(0.5f, 0.5f, 1.0f, 0.0f),
+        vertex(-0.5f, -0.5f, 1.0f, 0.0f), vertex(0.5f, 0.5f, 1.0f, 0.0f), vertex(-0.5f, 0.5f, 1.0f, 0.0f)
+    };
+    pipeline->begin_frame();
+    pipeline->draw_triangles(quad);
+    pipeline->end_frame();
+    TestFramework::assert_equals(200 * 200, pipeline->get_statistics().fragments_processed,
+                                 "Shared edges should be rasterized exactly once");
+    
+    // A thin diagonal sliver covers far fewer pixels than its bounding box
+    std::vector<Vertex> sliver = {
+        vertex(-0.9f, -0.9f, 1.0f, 0.0f), vertex(0.9f, 0.85f, 1.0f, 0.0f), vertex(0.85f, 0.9f, 1.0f, 0.0f)
+    };
+    pipeline->begin_frame();
+    pipeline->draw_triangles(sliver);
+    pipeline->end_frame();
+    uint64_t sliver_fragments = pipeline->get_statistics().fragments_processed;
+    double sliver_area = 0.5 * (360.0 * 360.0 - 350.0 * 350.0);  // 0.5 * |e1 x e2| in pixels
+    TestFramework::assert_true(sliver_fragments > 0.9 * sliver_area && sliver_fragments < 1.1 * sliver_area,
+                               "Fragment count should match the triangle's pixel area");
+    
+    // Perspective-correct attributes: vertex 2 is 4x further away, so at the
+    // screen centroid its attribute weight is (1/12) / (1/3 + 1/3 + 1/12) = 1/9
+    float centroid_s = -1.0f;
+    pipeline->set_fragment_shader([&centroid_s](const Fragment& fragment) {
+        // Screen centroid of the triangle below is (200, 200)
+        if (fragment.position[0] == 200.0f && fragment.position[1] == 200.0f) {
+            centroid_s = fragment.texcoord[0];
+        }
+        return fragment;
+    });
+    std::vector<Vertex> perspective = {
+        vertex(-0.6f, -0.4985f, 1.0f, 0.0f), vertex(0.6f, -0.4985f, 1.0f, 0.0f), vertex(0.0f, 1.0f, 4.0f, 1.0f)
+    };
+    pipeline->begin_frame();
+    pipeline->draw_triangles(perspective);
+    pipeline->end_frame();
+    TestFramework::assert_true(std::abs(centroid_s - 1.0f / 9.0f) < 0.01f,
+                               "Attributes should be interpolated perspective-correctly");
+    
+    // Stages stream through a fixed fragment batch, and bins and the raster
+    // pool's task deques keep their capacity: after warm-up, whole frames
+    // of a full-screen draw (binning, the tile tasks, rasterization,
+    // fragment and output merger stages, and the resolve) make no heap
+    // allocations
+    state.viewport_width = 1920;
+    state.viewport_height = 1080;
+    pipeline->set_pipeline_state(state);
+    pipeline->set_fragment_shader(nullptr);
+    std::vector<Vertex> full_screen = {
+        vertex(-1.0f, -1.0f, 1.0f, 0.0f), vertex(3.0f, -1.0f, 1.0f, 0.0f), vertex(-1.0f, 3.0f, 1.0f, 0.0f)
+    };
+    pipeline->begin_frame();
+    pipeline->draw_triangles(full_screen);
+    pipeline->end_frame();
+    uint64_t allocations_before = g_heap_allocations.load();
+    for (int frame = 0; frame < 4; ++frame) {
+        pipeline->begin_frame();
+        pipeline->draw_triangles(full_screen);
+        pipeline->end_frame();
+    }
+    uint64_t draw_allocations = g_heap_allocations.load() - allocations_before;
+    TestFramework::assert_equals(1920 * 1080, pipeline->get_statistics().fragments_processed,
+                                 "Full-screen triangle should cover every pixel");
+    TestFramework::assert_equals(0, draw_allocations, "Streaming frames should not touch the heap");
+    
+    std::cout << "Rasterizer tests passed!" << std::endl;
+}
+
+void test_indexed_drawing() {
+    std::cout << "\n=== Testing Indexed Drawing ===" << std::endl;
+    
+    auto pipeline = std::make_shared<GraphicsPipeline>();
+    pipeline->initialize(nullptr, nullptr, nullptr, nullptr);
+    
+    PipelineState state;
+    state.viewport_width = 256;
+    state.viewport_height = 256;
+    state.depth_test_enabled = false;
+    state.blending_enabled = false;
+    state.culling_enabled = true;
+    pipeline->set_pipeline_state(state);
+    
+    // 10x10 quad grid: 121 shared vertices, 200 triangles
+    const uint32_t grid = 10;
+    std::vector<Vertex> vertices;
+    for (uint32_t y = 0; y <= grid; ++y) {
+        for (uint32_t x = 0; x <= grid; ++x) {
+            float px = -0.8f + 1.6f * x / grid;
+            float py = -0.8f + 1.6f * y / grid;
+            vertices.push_back({{px, py, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}});
+        }
+    }
+    std::vector<uint32_t> indices;
+    for (uint32_t y = 0; y < grid; ++y) {
+        for (uint32_t x = 0; x < grid; ++x) {
+            uint32_t i0 = y * (grid + 1) + x;
+            uint32_t i1 = i0 + 1;
+            uint32_t i2 = i0 + grid + 1;
+            uint32_t i3 = i2 + 1;
+            indices.insert(indices.end(), {i0, i1, i3, i0, i3, i2});
+        }
+    }
+    
+    std::vector<Vertex> expanded;
+    for (uint32_t index : indices) {
+        expanded.push_back(vertices[index]);
+    }
+    pipeline->begin_frame();
+    pipeline->draw_triangles(expanded);
+    pipeline->end_frame();
+    auto expanded_stats = pipeline->get_statistics();
+    
+    uint32_t shader_calls = 0;
+    pipeline->set_vertex_shader([&shader_calls](const Vertex& vertex) {
+        shader_calls++;
+        return vertex;
+    });
+    pipeline->begin_frame();
+    pipeline->draw_indexed(vertices, indices);
+    pipeline->end_frame();
+    auto stats = pipeline->get_statistics();
+    
+    TestFramework::assert_equals(expanded_stats.fragments_processed, stats.fragments_processed,
+                                 "Indexed draw should rasterize the same pixels as the expanded list");
+    TestFramework::assert_equals(200, stats.triangles_drawn, "Indexed draw should draw every triangle");
+    TestFramework::assert_equals(indices.size(), stats.vertex_cache_hits + stats.vertex_cache_misses,
+                                 "Every index should look up the vertex cache");
+    TestFramework::assert_equals(stats.vertex_cache_misses, shader_calls,
+                                 "The vertex shader should run only on cache misses");
+    TestFramework::assert_true(stats.vertex_cache_misses < indices.size() / 2,
+                               "Shared grid vertices should mostly hit the cache");
+    
+    // Out-of-range indices drop their triangle; a disabled cache shades every index
+    state.vertex_cache_size = 0;
+    pipeline->set_pipeline_state(state);
+    shader_calls = 0;
+    std::vector<uint32_t> bad_indices = {0, 1, 12, 0, 1, 9999};
+    pipeline->begin_frame();
+    pipeline->draw_indexed(vertices, bad_indices);
+    pipeline->end_frame();
+    stats = pipeline->get_statistics();
+    TestFramework::assert_equals(1, stats.triangles_drawn, "Triangles with invalid indices should be skipped");
+    TestFramework::assert_equals(3, shader_calls, "Without a cache every valid index should be shaded");
+    TestFramework::assert_equals(0, stats.vertex_cache_hits, "A disabled cache should never hit");
+    
+    std::cout << "Indexed drawing tests passed!" << std::endl;
+}
+
+void test_tile_binning() {
+    std::cout << "\n=== Testing Tile Binning ===" << std::endl;
+    
+    PipelineState state;
+    state.viewport_width = 300;  // Not a multiple of the bin tile size
+    state.viewport_height = 200;
+    state.depth_test_enabled = true;
+    state.blending_enabled = false;
+    state.culling_enabled = false;
+    
+    // Overlapping triangles at varying depths and windings; the last one
+    // lies entirely off screen
+    std::vector<Vertex> triangles;
+    for (int i = 0; i < 24; ++i) {
+        float cx = -0.9f + 0.08f * i;
+        float cy = (i % 2 ? 0.3f : -0.3f);
+        float depth = 0.1f + 0.035f * ((i * 7) % 24);
+        float r = (i % 3) / 2.0f, g = (i % 5) / 4.0f, b = (i % 7) / 6.0f;
+        float sign = (i % 2) ? 1.0f : -1.0f;
+        triangles.push_back({{cx - 0.5f, cy - 0.6f, depth, 1.0f}, {r, g, b, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}});
+        triangles.push_back({{cx + 0.5f, cy - 0.6f * sign, depth, 1.0f}, {g, b, r, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}});
+        triangles.push_back({{cx, cy + 0.6f * sign, depth, 1.0f}, {b, r, g, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}});
+    }
+    triangles.push_back({{2.0f, 2.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}});
+    triangles.push_back({{3.0f, 2.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}});
+    triangles.push_back({{2.0f, 3.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}});
+    
+    auto render = [&](uint32_t worker_threads) {
+        auto pipeline = std::make_shared<GraphicsPipeline>(worker_threads);
+        pipeline->initialize(nullptr, nullptr, nullptr, nullptr);
+        pipeline->set_pipeline_state(state);
+        pipeline->begin_frame();
+        pipeline->draw_triangles(triangles);
+        pipeline->end_frame();
+        return std::make_pair(pipeline->get_color_buffer(), pipeline->get_statistics());
+    };
+    
+    auto serial = render(1);
+    auto parallel = render(4);
+    
+    TestFramework::assert_true(serial.first == parallel.first,
+                               "Tile workers should resolve the same image as a single worker");
+    TestFramework::assert_equals(serial.second.fragments_processed, parallel.second.fragments_processed,
+                                 "Fragment counts should not depend on the worker count");
+    TestFramework::assert_equals(25, parallel.second.triangles_drawn, "Every triangle should be counted");
+    
+    // Draws outside a frame resolve immediately, and state changes render
+    // pending bins under the state they were drawn with
+    GraphicsPipeline pipeline(2);
+    pipeline.initialize(nullptr, nullptr, nullptr, nullptr);
+    pipeline.set_pipeline_state(state);
+    pipeline.begin_frame();  // Clear
+    pipeline.end_frame();
+    pipeline.draw_triangles(triangles);
+    TestFramework::assert_true(pipeline.get_color_buffer() == serial.first,
+                               "A draw outside a frame should resolve when it returns");
+    
+    pipeline.begin_frame();
+    pipeline.draw_triangles(triangles);
+    state.depth_test_enabled = false;
+    pipeline.set_pipeline_state(state);
+    pipeline.end_frame();
+    TestFramework::assert_true(pipeline.get_color_buffer() == serial.first,
+                               "State changes should render pending bins first");
+    
+    std::cout << "Tile binning tests passed!" << std::endl;
+}
+
+void test_command_buffer() {
+    std::cout << "\n=== Testing Command Buffers ===" << std::endl;
+    
+    auto memory = std::make_shared<MemoryHierarchy>();
+    auto texture_cache = std::make_shared<TextureCache>(16);
+    texture_cache->initialize(memory, nullptr);
+    
+    auto make_texture = [](uint8_t seed) {
+        Texture texture;
+        texture.width = 16;
+        texture.height = 16;
+        texture.format = 0;
+        texture.mip_levels = 1;
+        texture.data.resize(16 * 16 * 4);
+        for (size_t i = 0; i < texture.data.size(); ++i) {
+            texture.data[i] = static_cast<uint8_t>(i * seed);
+        }
+        return texture;
+    };
+    uint64_t texture_a = texture_cache->register_texture(make_texture(3));
+    uint64_t texture_b = texture_cache->register_texture(make_texture(11));
+    
+    auto triangle_at = [](float x, float y, float z) {
+        return std::vector<Vertex>{
+            {{x, y, z, 1.0f}, {1.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+            {{x + 0.4f, y, z, 1.0f}, {0.0f, 1.0f, 0.0f, 1.0f}, {1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+            {{x, y + 0.4f, z, 1.0f}, {0.0f, 0.0f, 1.0f, 1.0f}, {0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}}};
+    };
+    std::vector<Vertex> t0 = triangle_at(-0.9f, -0.9f, 0.5f);
+    std::vector<Vertex> t1 = triangle_at(-0.4f, -0.9f, 0.5f);
+    std::vector<Vertex> t2 = triangle_at(0.1f, -0.9f, 0.5f);
+    std::vector<Vertex> t3 = triangle_at(0.5f, -0.9f, 0.5f);
+    t3.push_back(t3[0]);  // Trailing partial triangle is dropped
+    std::vector<Vertex> quad = triangle_at(-0.5f, 0.0f, 0.3f);
+    quad.push_back({{-0.1f, 0.4f, 0.3f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}});
+    std::vector<uint32_t> quad_indices = {0, 1, 2, 1, 3, 2};
+    
+    PipelineState state;
+    state.depth_test_enabled = true;
+    state.culling_enabled = false;
+    state.viewport_width = 96;
+    state.viewport_height = 80;
+    
+    auto make_pipeline = [&](std::shared_ptr<PerformanceMonitor> perf_monitor) {
+        auto pipeline = std::make_shared<GraphicsPipeline>(2);
+        pipeline->initialize(nullptr, memory, texture_cache, perf_monitor);
+        return pipeline;
+    };
+    
+    // Immediate-mode reference
+    auto immediate = make_pipeline(nullptr);
+    immediate->begin_frame();
+    immediate->set_pipeline_state(state);
+    immediate->bind_texture(0, texture_a);
+    immediate->draw_triangles(t0);
+    immediate->bind_texture(0, texture_b);
+    immediate->draw_triangles(t1);
+    immediate->bind_texture(0, texture_a);
+    immediate->draw_triangles(t2);
+    immediate->draw_triangles(t3);
+    immediate->bind_texture(0, texture_b);
+    immediate->draw_indexed(quad, quad_indices);
+    immediate->end_frame();
+    auto reference = immediate->get_statistics();
+    
+    CommandBuffer buffer;
+    buffer.set_pipeline_state(state);
+    buffer.bind_texture(0, texture_a);
+    buffer.draw_triangles(t0);
+    buffer.bind_texture(0, texture_b);
+    buffer.draw_triangles(t1);
+    buffer.bind_texture(0, texture_a);
+    buffer.draw_triangles(t2);
+    buffer.set_pipeline_state(state);  // Redundant, does not split the batch
+    buffer.draw_triangles(t3);
+    buffer.bind_texture(0, texture_b);
+    buffer.draw_indexed(quad, quad_indices);
+    t0.clear();  // Geometry was copied at record time
+    TestFramework::assert_equals(5, buffer.get_draw_count(), "Buffer should count recorded draws");
+    
+    auto submit_frame = [&](const GraphicsPipeline::SubmitOptions& options,
+                            std::shared_ptr<PerformanceMonitor> perf_monitor) {
+        auto pipeline = make_pipeline(perf_monitor);
+        pipeline->begin_frame();
+        pipeline->submit(buffer, options);
+        pipeline->end_frame();
+        return pipeline;
+    };
+    auto matches_reference = [&](const std::shared_ptr<GraphicsPipeline>& pipeline) {
+        auto stats = pipeline->get_statistics();
+        return pipeline->get_color_buffer() == immediate->get_color_buffer() &&
+               stats.fragments_processed == reference.fragments_processed &&
+               stats.texture_samples == reference.texture_samples &&
+               stats.triangles_drawn == reference.triangles_drawn &&
+               stats.vertices_processed == reference.vertices_processed;
+    };
+    TestFramework::assert_greater_than(reference.texture_samples, 0, "Reference frame should sample textures");
+    
+    auto perf_monitor = std::make_shared<PerformanceMonitor>();
+    GraphicsPipeline::SubmitOptions options;
+    TestFramework::assert_true(matches_reference(submit_frame(options, perf_monitor)),
+                               "Submitted buffer should render the immediate-mode frame");
+    TestFramework::assert_equals(4, perf_monitor->get_counter("submitted_batches"),
+                                 "Texture changes should split batches, redundant state should not");
+    TestFramework::assert_equals(6, perf_monitor->get_counter("triangles_drawn"),
+                                 "Merged draws should still count every triangle");
+    
+    options.merge_draws = false;
+    options.overlap_vertex_processing = false;
+    TestFramework::assert_true(matches_reference(submit_frame(options, nullptr)),
+                               "Unmerged serial submission should render the same frame");
+    
+    // This scene is depth-tested and non-overlapping, so sorting is safe
+    auto sorted_monitor = std::make_shared<PerformanceMonitor>();
+    options = GraphicsPipeline::SubmitOptions();
+    options.sort_by_texture = true;
+    TestFramework::assert_true(matches_reference(submit_frame(options, sorted_monitor)),
+                               "Texture-sorted submission should render the same frame");
+    TestFramework::assert_equals(2, sorted_monitor->get_counter("submitted_batches"),
+                                 "Sorting should merge batches that share a texture");
+    
+    // A texture bound by value before submit stays usable by batches that
+    // sorting moves after a rebind of its unit
+    auto bind_by_value = [&](std::shared_ptr<GraphicsPipeline> pipeline) {
+        pipeline->set_pipeline_state(state);
+        pipeline->bind_texture(0, make_texture(7));
+        pipeline->begin_frame();
+        return pipeline;
+    };
+    CommandBuffer rebinding;
+    rebinding.draw_triangles(t1);
+    rebinding.bind_texture(0, texture_a);
+    rebinding.draw_triangles(t2);
+    auto immediate_rebind = bind_by_value(make_pipeline(nullptr));
+    immediate_rebind->draw_triangles(t1);
+    immediate_rebind->bind_texture(0, texture_a);
+    immediate_rebind->draw_triangles(t2);
+    immediate_rebind->end_frame();
+    auto sorted_rebind = bind_by_value(make_pipeline(nullptr));
+    sorted_rebind->submit(rebinding, options);
+    sorted_rebind->end_frame();
+    TestFramework::assert_true(sorted_rebind->get_color_buffer() == immediate_rebind->get_color_buffer(),
+                               "Sorted batches should still draw with a texture bound by value");
+    TestFramework::assert_equals(immediate_rebind->get_statistics().texture_samples,
+                                 sorted_rebind->get_statistics().texture_samples,
+                                 "Every sorted batch should sample its texture");
+    
+    // Outside a frame the buffer is resolved once submit returns
+    auto unframed = make_pipeline(nullptr);
+    unframed->set_pipeline_state(state);
+    unframed->submit(buffer);
+    bool drawn = std::any_of(unframed->get_color_buffer().begin(), unframed->get_color_buffer().end(),
+                             [](uint32_t pixel) { return pixel != 0; });
+    TestFramework::assert_true(drawn, "Submit outside a frame should resolve to the frame buffer");
+    
+    buffer.reset();
+    TestFramework::assert_true(buffer.empty() && buffer.get_draw_count() == 0, "Reset should clear the buffer");
+    
+    texture_cache->invalidate_texture(texture_a);
+    texture_cache->invalidate_texture(texture_b);
+    std::cout << "Command buffer tests passed!" << std::endl;
+}
+
+void test_framebuffer_formats() {
+    std::cout << "\n=== Testing Frame Buffer Formats ===" << std::endl;
+    
+    auto memory = std::make_shared<MemoryHierarchy>();
+    auto pipeline = std::make_shared<GraphicsPipeline>(2);
+    pipeline->initialize(nullptr, memory, nullptr, nullptr);
+    
+    auto full_screen = [](float z, float r, float g, float b, float a) {
+        Vertex corners[4] = {
+            {{-1.0f, -1.0f, z, 1.0f}, {r, g, b, a}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+            {{1.0f, -1.0f, z, 1.0f}, {r, g, b, a}, {1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+            {{-1.0f, 1.0f, z, 1.0f}, {r, g, b, a}, {0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+            {{1.0f, 1.0f, z, 1.0f}, {r, g, b, a}, {1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}}};
+        return std::vector<Vertex>{corners[0], corners[1], corners[2], corners[1], corners[3], corners[2]};
+    };
+    
+    PipelineState state;
+    state.depth_test_enabled = true;
+    state.culling_enabled = false;
+    state.viewport_width = 80;
+    state.viewport_height = 48;
+    state.depth_format = DepthFormat::UNORM16;
+    pipeline->set_pipeline_state(state);
+    
+    // A cleared frame reads back the clear values without any tile rendered
+    pipeline->begin_frame();
+    pipeline->end_frame();
+    const std::vector<uint32_t>& cleared = pipeline->get_color_buffer();
+    bool all_clear = true;
+    for (uint32_t color : cleared) {
+        all_clear = all_clear && color == 0x000000FF;
+    }
+    TestFramework::assert_true(all_clear, "Fast-cleared frame should read back the clear color");
+    TestFramework::assert_true(pipeline->get_depth(40, 20) == 1.0f, "Fast-cleared tile should read back the clear depth");
+    
+    // UNORM16 stores depth to 1/65535
+    pipeline->begin_frame();
+    pipeline->draw_triangles(full_screen(0.25f, 1.0f, 0.0f, 0.0f, 1.0f));
+    pipeline->end_frame();
+    float depth = pipeline->get_depth(40, 20);
+    float steps = depth * 65535.0f;
+    TestFramework::assert_true(std::fabs(depth - 0.25f) <= 1.0f / 65535.0f, "UNORM16 depth should be within one step");
+    TestFramework::assert_true(std::fabs(steps - std::round(steps)) < 1e-2f, "UNORM16 depth should be quantized");
+    TestFramework::assert_equals(0xFF0000FFu, pipeline->get_color_buffer()[20 * 80 + 40], "Opaque fragment should replace the color");
+    
+    // Blending over the red frame; the depth test still applies
+    PipelineState blend_state = state;
+    blend_state.blending_enabled = true;
+    pipeline->set_pipeline_state(blend_state);
+    pipeline->draw_triangles(full_screen(0.5f, 0.0f, 0.0f, 1.0f, 0.5f));
+    TestFramework::assert_equals(0xFF0000FFu, pipeline->get_color_buffer()[20 * 80 + 40], "Occluded fragment should be rejected");
+    pipeline->draw_triangles(full_screen(0.1f, 0.0f, 0.0f, 1.0f, 0.5f));
+    const std::vector<uint32_t>& blended = pipeline->get_color_buffer();
+    bool all_blended = true;
+    for (uint32_t color : blended) {
+        all_blended = all_blended && color == 0x7F007FFFu;
+    }
+    TestFramework::assert_true(all_blended, "Every pixel should blend half and half");
+    
+    // Switching formats converts the stored depth
+    PipelineState unorm24_state = blend_state;
+    unorm24_state.depth_format = DepthFormat::UNORM24;
+    pipeline->set_pipeline_state(unorm24_state);
+    depth = pipeline->get_depth(40, 20);
+    TestFramework::assert_true(std::fabs(depth - 0.1f) <= 1.0f / 65535.0f, "Depth should survive a format switch");
+    
+    // UNORM24 keeps nearby depths apart that UNORM16 merges
+    unorm24_state.blending_enabled = false;
+    pipeline->set_pipeline_state(unorm24_state);
+    pipeline->draw_triangles(full_screen(depth - 2.0f / 16777215.0f, 0.0f, 1.0f, 0.0f, 1.0f));
+    TestFramework::assert_equals(0x00FF00FFu, pipeline->get_color_buffer()[20 * 80 + 40], "UNORM24 should resolve a two-step depth difference");
+    TestFramework::assert_true(pipeline->get_depth(40, 20) < depth, "Nearer UNORM24 depth should be stored");
+    
+    // Blended layers of a three-pixel strip: each group of four fragments
+    // hits a pixel twice, so the merger must apply them in order
+    PipelineState layer_state = state;
+    layer_state.depth_test_enabled = false;
+    layer_state.blending_enabled = true;
+    pipeline->set_pipeline_state(layer_state);
+    auto strip = [](float r, float g, float b) {
+        const float x0 = -1.0f + 16.0f / 80.0f, x1 = -1.0f + 22.0f / 80.0f;
+        const float y0 = -1.0f + 16.0f / 48.0f, y1 = -1.0f + 18.0f / 48.0f;
+        Vertex corners[4] = {
+            {{x0, y0, 0.5f, 1.0f}, {r, g, b, 0.5f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+            {{x1, y0, 0.5f, 1.0f}, {r, g, b, 0.5f}, {1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+            {{x0, y1, 0.5f, 1.0f}, {r, g, b, 0.5f}, {0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+            {{x1, y1, 0.5f, 1.0f}, {r, g, b, 0.5f}, {1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}}};
+        return std::vector<Vertex>{corners[0], corners[1], corners[2], corners[1], corners[3], corners[2]};
+    };
+    pipeline->begin_frame();
+    pipeline->draw_triangles(strip(1.0f, 0.0f, 0.0f));
+    pipeline->draw_triangles(strip(0.0f, 0.0f, 1.0f));
+    pipeline->draw_triangles(strip(0.0f, 1.0f, 0.0f));
+    pipeline->end_frame();
+    // Red, then blue, then green, each at half alpha over black
+    uint64_t layered = 0;
+    bool layers_in_order = true;
+    for (uint32_t color : pipeline->get_color_buffer()) {
+        if (color == 0x000000FF) continue;
+        layered++;
+        layers_in_order = layers_in_order && color == 0x1F7F3FFFu;
+    }
+    TestFramework::assert_equals(3, layered, "The strip should cover three pixels");
+    TestFramework::assert_true(layers_in_order, "Overlapping fragments in one group should blend in draw order");
+    
+    std::cout << "Frame buffer format tests passed!" << std::endl;
+}
+
+void test_early_depth() {
+    std::cout << "\n=== Testing Early Depth Rejection ===" << std::endl;
+    
+    auto vertex = [](float x, float y, float depth, float r) {
+        return Vertex{{x, y, depth, 1.0f}, {r, 0.5f, 1.0f - r, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+    };
+    
+    // A near occluder over the left half, then farther triangles spanning
+    // the screen drawn behind it and a nearer one partly in front
+    std::vector<Vertex> scene = {
+        vertex(-1.0f, -1.0f, 0.2f, 0.0f), vertex(0.0f, -1.0f, 0.2f, 0.0f), vertex(0.0f, 1.0f, 0.2f, 0.0f),
+        vertex(-1.0f, -1.0f, 0.2f, 0.0f), vertex(0.0f, 1.0f, 0.2f, 0.0f), vertex(-1.0f, 1.0f, 0.2f, 0.0f),
+        vertex(-1.0f, -1.0f, 0.8f, 1.0f), vertex(1.0f, -1.0f, 0.6f, 0.5f), vertex(-1.0f, 1.0f, 0.7f, 0.2f),
+        vertex(-0.8f, -0.9f, 0.5f, 0.7f), vertex(0.9f, 0.8f, 0.9f, 0.3f), vertex(-0.9f, 0.9f, 0.4f, 0.9f),
+        vertex(-0.5f, -0.5f, 0.1f, 0.4f), vertex(0.5f, -0.5f, 0.1f, 0.4f), vertex(0.0f, 0.5f, 0.1f, 0.4f)
+    };
+    
+    PipelineState state;
+    state.viewport_width = 256;
+    state.viewport_height = 256;
+    state.depth_test_enabled = true;
+    state.blending_enabled = false;
+    state.culling_enabled = true;
+    
+    auto render = [&](bool early_z, bool writes_depth, uint64_t& shader_calls) {
+        auto pipeline = std::make_shared<GraphicsPipeline>(2);
+        pipeline->initialize(nullptr, nullptr, nullptr, nullptr);
+        state.early_z_enabled = early_z;
+        state.fragment_shader_writes_depth = writes_depth;
+        pipeline->set_pipeline_state(state);
+        std::atomic<uint64_t> calls{0};
+        pipeline->set_fragment_shader([&calls](const Fragment& fragment) {
+            calls++;
+            return fragment;
+        });
+        pipeline->begin_frame();
+        pipeline->draw_triangles(scene);
+        pipeline->end_frame();
+        shader_calls = calls.load();
+        return std::make_pair(pipeline->get_color_buffer(), pipeline->get_statistics());
+    };
+    
+    uint64_t late_calls, early_calls, depth_writer_calls;
+    auto late = render(false, false, late_calls);
+    auto early = render(true, false, early_calls);
+    auto depth_writer = render(true, true, depth_writer_calls);
+    
+    TestFramework::assert_true(late.first == early.first, "Early depth rejection should not change the image");
+    TestFramework::assert_greater_than(early.second.early_z_rejected_fragments, 0,
+                                       "Occluded fragments should be rejected before shading");
+    TestFramework::assert_greater_than(early.second.hiz_culled_blocks, 0,
+                                       "Fully occluded blocks should be culled by Hi-Z");
+    TestFramework::assert_true(early_calls < late_calls, "Early-Z should skip fragment shader invocations");
+    TestFramework::assert_equals(early.second.fragments_processed, early_calls,
+                                 "Only shaded fragments should count as processed");
+    TestFramework::assert_equals(0, late.second.early_z_rejected_fragments + late.second.hiz_culled_blocks,
+                                 "Disabled early-Z should reject nothing early");
+    TestFramework::assert_equals(late_calls, depth_writer_calls,
+                                 "Shaders that write depth should disable early rejection");
+    
+    std::cout << "Early depth rejection tests passed!" << std::endl;
+}
+
+void test_shader_dispatch() {
+    std::cout << "\n=== Testing Shader Dispatch ===" << std::endl;
+    
+    PipelineState state;
+    state.viewport_width = 128;
+    state.viewport_height = 128;
+    state.depth_test_enabled = true;
+    state.blending_enabled = false;
+    state.culling_enabled = true;
+    
+    std::vector<Vertex> triangles;
+    for (int i = 0; i < 40; ++i) {
+        float x = -0.9f + 0.04f * i;
+        float depth = 0.9f - 0.02f * i;
+        triangles.push_back({{x, -0.8f, depth, 1.0f}, {0.2f, 0.4f, 0.6f, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}});
+        triangles.push_back({{x + 0.5f, -0.8f, depth, 1.0f}, {0.6f, 0.2f, 0.4f, 1.0f}, {1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}});
+        triangles.push_back({{x + 0.2f, 0.8f, depth, 1.0f}, {0.4f, 0.6f, 0.2f, 1.0f}, {0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}});
+    }
+    
+    auto shift = [](const Vertex& vertex) {
+        Vertex shifted = vertex;
+        shifted.position[1] += 0.1f;
+        return shifted;
+    };
+    auto tint = [](const Fragment& fragment) {
+        Fragment tinted = fragment;
+        tinted.color[0] = 1.0f - fragment.color[0];
+        tinted.color[2] *= fragment.texcoord[0];
+        return tinted;
+    };
+    
+    auto render = [&](const std::function<void(GraphicsPipeline&)>& bind_shaders) {
+        GraphicsPipeline pipeline(2);
+        pipeline.initialize(nullptr, nullptr, nullptr, nullptr);
+        pipeline.set_pipeline_state(state);
+        bind_shaders(pipeline);
+        pipeline.begin_frame();
+        pipeline.draw_triangles(triangles);
+        pipeline.end_frame();
+        return std::make_pair(pipeline.get_color_buffer(), pipeline.get_statistics());
+    };
+    
+    auto generic = render([&](GraphicsPipeline& pipeline) {
+        pipeline.set_vertex_shader(shift);
+        pipeline.set_fragment_shader(tint);
+    });
+    auto inlined = render([&](GraphicsPipeline& pipeline) {
+        pipeline.set_vertex_shader_inline(shift);
+        pipeline.set_fragment_shader_inline(tint);
+    });
+    
+    std::atomic<uint64_t> vertex_batches{0}, fragment_batches{0}, batched_fragments{0};
+    auto batched = render([&](GraphicsPipeline& pipeline) {
+        pipeline.set_vertex_batch_shader([&](const Vertex* input, Vertex* output, size_t count) {
+            vertex_batches++;
+            for (size_t i = 0; i < count; ++i) output[i] = shift(input[i]);
+        });
+        pipeline.set_fragment_batch_shader([&](Fragment* fragments, size_t count) {
+            fragment_batches++;
+            batched_fragments += count;
+            for (size_t i = 0; i < count; ++i) fragments[i] = tint(fragments[i]);
+        });
+    });
+    
+    TestFramework::assert_true(generic.first == inlined.first, "Inline shaders should match std::function shaders");
+    TestFramework::assert_true(generic.first == batched.first, "Batch shaders should match std::function shaders");
+    TestFramework::assert_equals(generic.second.fragments_processed, batched_fragments.load(),
+                                 "Batch shaders should see every shaded fragment");
+    TestFramework::assert_equals(2, vertex_batches.load(), "120 vertices should shade in two batches");
+    TestFramework::assert_true(fragment_batches.load() * 8 < batched_fragments.load(),
+                               "Fragment shaders should be called per batch, not per fragment");
+    
+    std::cout << "Shader dispatch tests passed!" << std::endl;
+}
+
+void test_fragment_stream() {
+    std::cout << "\n=== Testing Fragment Stream ===" << std::endl;
+    
+    PipelineState state;
+    state.viewport_width = 64;
+    state.viewport_height = 64;
+    state.depth_test_enabled = true;
+    state.culling_enabled = false;
+    
+    auto full_screen = [](float z, float r, float g, float b, float a) {
+        Vertex corners[4] = {
+            {{-1.0f, -1.0f, z, 1.0f}, {r, g, b, a}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+            {{1.0f, -1.0f, z, 1.0f}, {r, g, b, a}, {1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+            {{-1.0f, 1.0f, z, 1.0f}, {r, g, b, a}, {0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+            {{1.0f, 1.0f, z, 1.0f}, {r, g, b, a}, {1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}}};
+        return std::vector<Vertex>{corners[0], corners[1], corners[2], corners[1], corners[3], corners[2]};
+    };
+    
+    // Pulls the fragment in front of the red layer it was drawn behind,
+    // discards every fourth column and blends the rest
+    auto overlay = [](const Fragment& fragment) {
+        Fragment shaded = fragment;
+        shaded.depth = 0.25f;
+        shaded.valid = static_cast<int>(fragment.position[0]) % 4 != 0;
+        return shaded;
+    };
+    
+    auto render = [&](const std::function<void(GraphicsPipeline&)>& bind_shader) {
+        auto pipeline = std::make_shared<GraphicsPipeline>(2);
+        pipeline->initialize(nullptr, nullptr, nullptr, nullptr);
+        pipeline->set_pipeline_state(state);
+        pipeline->begin_frame();
+        pipeline->draw_triangles(full_screen(0.5f, 1.0f, 0.0f, 0.0f, 1.0f));
+        
+        PipelineState overlay_state = state;
+        overlay_state.blending_enabled = true;
+        overlay_state.fragment_shader_writes_depth = true;
+        pipeline->set_pipeline_state(overlay_state);
+        bind_shader(*pipeline);
+        pipeline->draw_triangles(full_screen(0.9f, 0.0f, 0.0f, 1.0f, 0.5f));
+        pipeline->end_frame();
+        return pipeline;
+    };
+    
+    auto generic = render([&](GraphicsPipeline& pipeline) { pipeline.set_fragment_shader(overlay); });
+    auto inlined = render([&](GraphicsPipeline& pipeline) { pipeline.set_fragment_shader_inline(overlay); });
+    auto batched = render([&](GraphicsPipeline& pipeline) {
+        pipeline.set_fragment_batch_shader([&](Fragment* fragments, size_t count) {
+            for (size_t i = 0; i < count; ++i) fragments[i] = overlay(fragments[i]);
+        });
+    });
+    
+    TestFramework::assert_true(generic->get_color_buffer() == inlined->get_color_buffer() &&
+                               generic->get_color_buffer() == batched->get_color_buffer(),
+                               "Blended, depth-writing shaders should match across dispatch forms");
+    
+    bool colors_match = true;
+    bool depths_match = true;
+    for (uint32_t y = 0; y < 64; ++y) {
+        for (uint32_t x = 0; x < 64; ++x) {
+            bool discarded = x % 4 == 0;
+            uint32_t expected_color = discarded ? 0xFF0000FFu : 0x7F007FFFu;
+            float expected_depth = discarded ? 0.5f : 0.25f;
+            colors_match = colors_match && batched->get_color_buffer()[y * 64 + x] == expected_color;
+            depths_match = depths_match && std::fabs(batched->get_depth(x, y) - expected_depth) < 1e-6f &&
+                           std::fabs(inlined->get_depth(x, y) - expected_depth) < 1e-6f;
+        }
+    }
+    TestFramework::assert_true(colors_match, "Shaded fragments should blend over the red layer and discarded ones keep it");
+    TestFramework::assert_true(depths_match, "Shader-written depth should be tested and stored");
+    
+    std::cout << "Fragment stream tests passed!" << std::endl;
+}
+
 void test_performance_monitor() {
     std::cout << "\n=== Testing Performance Monitor ===" << std::endl;
     
@@ -223,6 +1752,402 @@ void test_performance_monitor() {
     std::cout << "Performance Monitor tests passed!" << std::endl;
 }
 
+void test_counter_handles() {
+    std::cout << "\n=== Testing Performance Counter Handles ===" << std::endl;
+    
+    PerformanceMonitor perf_monitor;
+    auto counter = perf_monitor.register_counter("handle_counter");
+    TestFramework::assert_true(perf_monitor.register_counter("handle_counter") == counter,
+                               "Registering a name twice should return the same handle");
+    auto cache = perf_monitor.register_cache("handle_cache");
+    
+    // Threads increment their own slots; reads sum every thread's slot
+    {
+        ThreadPool pool(4);
+        for (int task = 0; task < 64; ++task) {
+            pool.submit([&perf_monitor, counter, cache, task] {
+                for (int i = 0; i < 1000; ++i) {
+                    perf_monitor.increment_counter(counter);
+                    perf_monitor.record_cache_access(cache, (i + task) % 4 != 0);
+                }
+            });
+        }
+        pool.wait_idle();
+    }
+    TestFramework::assert_equals(64000, perf_monitor.get_counter(counter),
+                                 "Concurrent increments should all be counted");
+    TestFramework::assert_equals(64000, perf_monitor.get_counter("handle_counter"),
+                                 "Name and handle should read the same counter");
+    auto report = perf_monitor.generate_report();
+    TestFramework::assert_equals(64000, report.counter_data["handle_counter"],
+                                 "Report should aggregate per-thread counters");
+    TestFramework::assert_true(std::abs(report.cache_hit_rates["handle_cache"] - 0.75) < 1e-9,
+                               "Report should aggregate per-thread cache accesses");
+    
+    // Setting overrides the per-thread slots; reset keeps handles valid
+    perf_monitor.set_counter(counter, 7);
+    perf_monitor.increment_counter(counter, 3);
+    TestFramework::assert_equals(10, perf_monitor.get_counter(counter), "Set should override earlier increments");
+    perf_monitor.reset_all_metrics();
+    perf_monitor.increment_counter(counter, 2);
+    TestFramework::assert_equals(2, perf_monitor.get_counter(counter), "Handles should survive a reset");
+    
+    // Counters past the per-thread slots still count correctly
+    PerformanceMonitor::CounterId last = 0;
+    for (int i = 0; i < 300; ++i) {
+        last = perf_monitor.register_counter("overflow_" + std::to_string(i));
+    }
+    perf_monitor.increment_counter(last, 5);
+    perf_monitor.increment_counter("overflow_299", 1);
+    TestFramework::assert_equals(6, perf_monitor.get_counter(last), "Overflow counters should still count");
+    
+    std::cout << "Performance counter handle tests passed!" << std::endl;
+}
+
+void test_latency_percentiles() {
+    std::cout << "\n=== Testing Latency Percentiles ===" << std::endl;
+    
+    QuantileSketch sketch;
+    TestFramework::assert_true(sketch.quantile(0.5) == 0.0, "An empty sketch should report 0");
+    sketch.record(4.25);
+    TestFramework::assert_true(sketch.quantile(0.99) == 4.25, "A single sample should be reported exactly");
+    
+    // Frames 1..2000 ms: the history keeps the last 1000, the sketch sees all
+    PerformanceMonitor perf_monitor;
+    for (int frame = 1; frame <= 2000; ++frame) {
+        perf_monitor.record_frame_metrics(static_cast<double>(frame), 1, 10);
+    }
+    auto report = perf_monitor.generate_report();
+    TestFramework::assert_true(report.min_frame_time_ms == 1001.0 && report.max_frame_time_ms == 2000.0,
+                               "Frame history should keep only the most recent frames");
+    TestFramework::assert_true(std::abs(report.avg_frame_time_ms - 1500.5) < 1e-9,
+                               "Average frame time should cover the frame history");
+    TestFramework::assert_equals(1000, report.total_triangles, "Triangle totals should cover the frame history");
+    TestFramework::assert_true(std::abs(report.frame_time_percentiles.p50_ms - 1000.0) < 10.0,
+                               "p50 frame time should be within 1% of the true median");
+    TestFramework::assert_true(std::abs(report.frame_time_percentiles.p95_ms - 1900.0) < 19.0,
+                               "p95 frame time should be within 1%");
+    TestFramework::assert_true(std::abs(report.frame_time_percentiles.p99_ms - 1980.0) < 19.8,
+                               "p99 frame time should be within 1%");
+    
+    perf_monitor.start_timer("stage");
+    perf_monitor.end_timer("stage");
+    report = perf_monitor.generate_report();
+    TestFramework::assert_true(report.timing_percentiles.count("stage") == 1,
+                               "Timers should report latency percentiles");
+    
+    perf_monitor.reset_all_metrics();
+    report = perf_monitor.generate_report();
+    TestFramework::assert_true(report.frame_time_percentiles.p99_ms == 0.0 && report.timing_percentiles.empty(),
+                               "Reset should clear the latency sketches");
+    
+    std::cout << "Latency percentile tests passed!" << std::endl;
+}
+
+void test_scoped_profiling() {
+    std::cout << "\n=== Testing Scoped Profiling ===" << std::endl;
+    
+    PerformanceMonitor perf_monitor;
+    auto outer = perf_monitor.register_timer("outer");
+    auto inner = perf_monitor.register_timer("inner");
+    
+    // Disabled scopes record nothing
+    {
+        PerformanceMonitor::ScopedTimer scope(&perf_monitor, outer);
+    }
+    TestFramework::assert_true(perf_monitor.generate_report().call_tree.empty(),
+                               "Disabled profiling should not record scopes");
+    
+    perf_monitor.enable_profiling(true);
+    for (int i = 0; i < 3; ++i) {
+        PerformanceMonitor::ScopedTimer outer_scope(&perf_monitor, outer);
+        {
+            PerformanceMonitor::ScopedTimer inner_scope(&perf_monitor, inner);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            PerformanceMonitor::ScopedTimer recursive_scope(&perf_monitor, inner);
+        }
+    }
+    {
+        PerformanceMonitor::ScopedTimer root_scope(&perf_monitor, inner);
+    }
+    
+    auto tree = perf_monitor.generate_report().call_tree;
+    TestFramework::assert_equals(4, tree.size(), "Each distinct call path should get one entry");
+    if (tree.size() == 4) {
+        TestFramework::assert_true(tree[0].path == "outer" && tree[1].path == "outer/inner" &&
+                                   tree[2].path == "outer/inner/inner" && tree[3].path == "inner",
+                                   "Call tree should be depth-first with children after their parent");
+        TestFramework::assert_equals(2, tree[2].depth, "Nested scopes should record their depth");
+        TestFramework::assert_equals(3, tree[1].calls, "Scopes should count their calls");
+        TestFramework::assert_true(tree[0].total_ms >= tree[1].total_ms && tree[1].total_ms >= 6.0,
+                                   "A scope's time should include its children");
+        TestFramework::assert_true(tree[0].self_ms < tree[0].total_ms - 5.0,
+                                   "Self time should exclude child scopes");
+    }
+    
+    // Flat timers pair up like brackets when re-entered
+    perf_monitor.start_timer("reentrant");
+    perf_monitor.start_timer("reentrant");
+    perf_monitor.end_timer("reentrant");
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    perf_monitor.end_timer("reentrant");
+    auto reentrant = perf_monitor.generate_report().timing_percentiles["reentrant"];
+    TestFramework::assert_true(reentrant.p99_ms >= 2.0 && reentrant.p50_ms < 2.0,
+                               "Re-entered timers should keep both start times");
+    
+    // A recording scope feeds its flat timer whether or not profiling is on,
+    // measuring each span once
+    auto recorded = perf_monitor.register_timer("recorded");
+    {
+        PerformanceMonitor::ScopedTimer scope(&perf_monitor, recorded, true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    perf_monitor.enable_profiling(false);
+    {
+        PerformanceMonitor::ScopedTimer scope(&perf_monitor, recorded, true);
+    }
+    perf_monitor.enable_profiling(true);
+    auto recorded_report = perf_monitor.generate_report();
+    auto recorded_times = recorded_report.timing_percentiles["recorded"];
+    TestFramework::assert_true(recorded_times.p99_ms >= 2.0 && recorded_times.p50_ms < 2.0,
+                               "Recording scopes should add one sample per span");
+    auto recorded_scope = std::find_if(recorded_report.call_tree.begin(), recorded_report.call_tree.end(),
+                                       [](const PerformanceMonitor::ProfileEntry& entry) { return entry.path == "recorded"; });
+    TestFramework::assert_true(recorded_scope != recorded_report.call_tree.end() && recorded_scope->calls == 1,
+                               "Only the profiled span should join the call tree");
+    
+    // The pipeline's stages appear under the tile workers' render_tile scope
+    auto shared_monitor = std::make_shared<PerformanceMonitor>();
+    shared_monitor->enable_profiling(true);
+    auto memory = std::make_shared<MemoryHierarchy>();
+    auto gpu_core = std::make_shared<GPUCore>(4);
+    auto texture_cache = std::make_shared<TextureCache>(16);
+    GraphicsPipeline pipeline(2);
+    gpu_core->initialize(memory, shared_monitor);
+    texture_cache->initialize(memory, shared_monitor);
+    pipeline.initialize(gpu_core, memory, texture_cache, shared_monitor);
+    PipelineState state;
+    state.viewport_width = 64;
+    state.viewport_height = 64;
+    pipeline.set_pipeline_state(state);
+    
+    Vertex v0 = {{-1.0f, -1.0f, 0.5f, 1.0f}, {1.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+    Vertex v1 = {{1.0f, -1.0f, 0.5f, 1.0f}, {0.0f, 1.0f, 0.0f, 1.0f}, {1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+    Vertex v2 = {{0.0f, 1.0f, 0.5f, 1.0f}, {0.0f, 0.0f, 1.0f, 1.0f}, {0.5f, 1.0f}, {0.0f, 0.0f, 1.0f}};
+    pipeline.begin_frame();
+    pipeline.draw_triangles({v0, v1, v2});
+    pipeline.end_frame();
+    
+    auto has_scope = [](const std::vector<PerformanceMonitor::ProfileEntry>& entries, const std::string& path) {
+        return std::any_of(entries.begin(), entries.end(),
+                           [&](const PerformanceMonitor::ProfileEntry& entry) { return entry.path == path; });
+    };
+    auto pipeline_tree = shared_monitor->generate_report().call_tree;
+    TestFramework::assert_true(has_scope(pipeline_tree, "draw_triangles/vertex_stage"),
+                               "Vertex stage should nest under the draw call");
+    TestFramework::assert_true(has_scope(pipeline_tree, "render_tile/rasterization_stage/fragment_stage") &&
+                               has_scope(pipeline_tree, "render_tile/rasterization_stage/output_merger_stage"),
+                               "Fragment and output merger stages should nest under rasterization");
+    
+    std::cout << "Scoped profiling tests passed!" << std::endl;
+}
+
+void test_trace_export() {
+    std::cout << "\n=== Testing Trace Export ===" << std::endl;
+    
+    const std::string trace_path = "gpu_sim_test_trace.json";
+    auto perf_monitor = std::make_shared<PerformanceMonitor>();
+    auto memory = std::make_shared<MemoryHierarchy>();
+    auto gpu_core = std::make_shared<GPUCore>(2, 2);
+    auto texture_cache = std::make_shared<TextureCache>(16);
+    GraphicsPipeline pipeline(2);
+    gpu_core->initialize(memory, perf_monitor);
+    texture_cache->initialize(memory, perf_monitor);
+    pipeline.initialize(gpu_core, memory, texture_cache, perf_monitor);
+    PipelineState state;
+    state.viewport_width = 64;
+    state.viewport_height = 64;
+    pipeline.set_pipeline_state(state);
+    
+    TestFramework::assert_true(perf_monitor->start_trace(trace_path), "Trace should start");
+    TestFramework::assert_true(!perf_monitor->start_trace(trace_path), "Only one trace should run at a time");
+    
+    Vertex v0 = {{-1.0f, -1.0f, 0.5f, 1.0f}, {1.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+    Vertex v1 = {{1.0f, -1.0f, 0.5f, 1.0f}, {0.0f, 1.0f, 0.0f, 1.0f}, {1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+    Vertex v2 = {{0.0f, 1.0f, 0.5f, 1.0f}, {0.0f, 0.0f, 1.0f, 1.0f}, {0.5f, 1.0f}, {0.0f, 0.0f, 1.0f}};
+    pipeline.begin_frame();
+    pipeline.draw_triangles({v0, v1, v2});
+    pipeline.end_frame();
+    
+    std::vector<uint32_t> program = {0x01, 0, 1, 2};
+    gpu_core->dispatch_compute(program, 128);
+    gpu_core->wait_for_completion();
+    
+    uint8_t bytes[64];
+    texture_cache->read_texture(5, 0, 0, bytes, sizeof(bytes));
+    perf_monitor->stop_trace();
+    
+    std::ifstream trace_file(trace_path);
+    std::stringstream contents;
+    contents << trace_file.rdbuf();
+    std::string trace = contents.str();
+    std::remove(trace_path.c_str());
+    
+    auto count_of = [&trace](const std::string& needle) {
+        size_t count = 0;
+        for (size_t at = trace.find(needle); at != std::string::npos; at = trace.find(needle, at + 1)) {
+            count++;
+        }
+        return count;
+    };
+    auto stats = perf_monitor->get_trace_stats();
+    TestFramework::assert_true(trace.rfind("{\"traceEvents\":[", 0) == 0 && trace.find("]}") != std::string::npos,
+                               "Trace should be a complete Chrome trace JSON object");
+    TestFramework::assert_greater_than(stats.events_written, 0, "Trace should record events");
+    TestFramework::assert_equals(stats.events_written, count_of("\"ph\":\"X\"") + count_of("\"ph\":\"i\""),
+                                 "Every written event should be in the file");
+    TestFramework::assert_true(count_of("\"name\":\"draw_triangles\"") > 0 &&
+                               count_of("\"name\":\"rasterization_stage\"") > 0,
+                               "Draws and pipeline stages should be traced as spans");
+    TestFramework::assert_true(trace.find("\"name\":\"compute_chunk\",\"ph\":\"X\"") != std::string::npos &&
+                               trace.find("\"pid\":2,\"tid\":1}") != std::string::npos,
+                               "Compute chunks should be traced on their shader core's track");
+    TestFramework::assert_true(count_of("\"name\":\"texture_miss\"") > 0, "Texture misses should be traced");
+    
+    // The event budget caps long runs
+    TestFramework::assert_true(perf_monitor->start_trace(trace_path, 5), "Trace should restart after stopping");
+    auto marker = perf_monitor->register_timer("marker");
+    for (int i = 0; i < 20; ++i) {
+        perf_monitor->trace_instant(marker, i);
+    }
+    perf_monitor->stop_trace();
+    std::remove(trace_path.c_str());
+    auto limited = perf_monitor->get_trace_stats();
+    TestFramework::assert_equals(5, limited.events_written, "Trace should stop recording at its event limit");
+    TestFramework::assert_equals(15, limited.events_dropped, "Events past the limit should be counted as dropped");
+    
+    std::cout << "Trace export tests passed!" << std::endl;
+}
+
+void test_command_stream() {
+    std::cout << "\n=== Testing Command Stream Capture and Replay ===" << std::endl;
+    
+    const std::string stream_path = "gpu_sim_test_stream.gcs";
+    struct Device {
+        std::shared_ptr<MemoryHierarchy> memory = std::make_shared<MemoryHierarchy>();
+        std::shared_ptr<GPUCore> gpu_core = std::make_shared<GPUCore>(2, 2);
+        std::shared_ptr<TextureCache> texture_cache = std::make_shared<TextureCache>(16);
+        std::shared_ptr<GraphicsPipeline> pipeline = std::make_shared<GraphicsPipeline>(2);
+        
+        Device() {
+            gpu_core->initialize(memory, nullptr);
+            texture_cache->initialize(memory, nullptr);
+            pipeline->initialize(gpu_core, memory, texture_cache, nullptr);
+        }
+    };
+    
+    Texture texture;
+    texture.width = 8;
+    texture.height = 8;
+    texture.format = 0;
+    texture.mip_levels = 1;
+    texture.data.resize(8 * 8 * 4);
+    for (size_t i = 0; i < texture.data.size(); ++i) {
+        texture.data[i] = static_cast<uint8_t>(i * 7);
+    }
+    
+    Vertex v0 = {{-1.0f, -1.0f, 0.5f, 1.0f}, {1.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+    Vertex v1 = {{1.0f, -1.0f, 0.5f, 1.0f}, {0.0f, 1.0f, 0.0f, 1.0f}, {1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+    Vertex v2 = {{0.0f, 1.0f, 0.5f, 1.0f}, {0.0f, 0.0f, 1.0f, 1.0f}, {0.5f, 1.0f}, {0.0f, 0.0f, 1.0f}};
+    Vertex v3 = {{-1.0f, 1.0f, 0.2f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}};
+    
+    // Capture a frame with both texture binding forms, both draw forms and a dispatch
+    Device captured;
+    auto writer = std::make_shared<CommandStreamWriter>();
+    TestFramework::assert_true(writer->open(stream_path), "Command stream should open for writing");
+    captured.gpu_core->set_command_capture(writer);
+    captured.texture_cache->set_command_capture(writer);
+    captured.pipeline->set_command_capture(writer);
+    
+    PipelineState state;
+    state.depth_test_enabled = true;
+    state.viewport_width = 64;
+    state.viewport_height = 48;
+    captured.pipeline->set_pipeline_state(state);
+    uint64_t texture_id = captured.texture_cache->register_texture(texture);
+    captured.pipeline->bind_texture(0, texture_id);
+    captured.pipeline->begin_frame();
+    captured.pipeline->draw_triangles({v0, v1, v2});
+    captured.pipeline->bind_texture(1, texture);
+    captured.pipeline->draw_indexed({v0, v1, v2, v3}, {0, 2, 3, 0, 1, 2});
+    captured.pipeline->end_frame();
+    captured.gpu_core->dispatch_compute({0x01, 0, 1, 2}, 128);
+    captured.gpu_core->wait_for_completion();
+    writer->close();
+    
+    TestFramework::assert_true(writer->good(), "Capture should write without errors");
+    TestFramework::assert_equals(11, writer->get_command_count(), "Every captured call should be one command");
+    
+    // Replay into a fresh device reproduces the frame
+    Device replayed;
+    CommandStreamReplayer replayer;
+    TestFramework::assert_true(replayer.open(stream_path), "Command stream should map for replay");
+    TestFramework::assert_true(replayer.replay(replayed.pipeline, replayed.gpu_core, replayed.texture_cache),
+                               "Replay should run the whole stream");
+    auto replay_stats = replayer.get_last_replay_stats();
+    TestFramework::assert_equals(11, replay_stats.commands, "Replay should execute every command");
+    TestFramework::assert_equals(2, replay_stats.draws, "Replay should issue both draws");
+    TestFramework::assert_equals(1, replay_stats.frames, "Replay should complete the frame");
+    TestFramework::assert_equals(2, replay_stats.texture_uploads, "Replay should upload both textures");
+    
+    auto captured_stats = captured.pipeline->get_statistics();
+    auto replayed_stats = replayed.pipeline->get_statistics();
+    TestFramework::assert_greater_than(replayed_stats.texture_samples, 0, "Replayed draws should sample textures");
+    TestFramework::assert_equals(captured_stats.fragments_processed, replayed_stats.fragments_processed,
+                                 "Replay should shade the captured fragments");
+    TestFramework::assert_equals(captured_stats.texture_samples, replayed_stats.texture_samples,
+                                 "Replay should sample the captured textures");
+    TestFramework::assert_true(captured.pipeline->get_color_buffer() == replayed.pipeline->get_color_buffer(),
+                               "Replay should render the captured frame");
+    
+    uint64_t captured_threads = 0, replayed_threads = 0;
+    for (const auto& core : captured.gpu_core->get_shader_cores()) captured_threads += core->get_instruction_count();
+    for (const auto& core : replayed.gpu_core->get_shader_cores()) replayed_threads += core->get_instruction_count();
+    TestFramework::assert_equals(captured_threads, replayed_threads, "Replay should run the captured dispatch");
+    
+    // Streams are replayable repeatedly; textures are re-uploaded under the same ids
+    TestFramework::assert_true(replayer.replay(replayed.pipeline, replayed.gpu_core, replayed.texture_cache),
+                               "Stream should replay more than once");
+    TestFramework::assert_true(captured.pipeline->get_color_buffer() == replayed.pipeline->get_color_buffer(),
+                               "A second replay should render the same frame");
+    
+    // Truncated and foreign files are rejected
+    size_t stream_bytes = replayer.get_stream_bytes();
+    replayer.close();
+    std::vector<char> bytes(stream_bytes);
+    {
+        std::ifstream in(stream_path, std::ios::binary);
+        in.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+    {
+        std::ofstream out(stream_path, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size() - 40));
+    }
+    Device truncated;
+    TestFramework::assert_true(replayer.open(stream_path), "Truncated stream should still have a valid header");
+    TestFramework::assert_true(!replayer.replay(truncated.pipeline, truncated.gpu_core, truncated.texture_cache),
+                               "Replay should report a truncated command");
+    replayer.close();
+    {
+        std::ofstream out(stream_path, std::ios::binary | std::ios::trunc);
+        out << "not a command stream";
+    }
+    TestFramework::assert_true(!replayer.open(stream_path), "Files without the stream header should be rejected");
+    std::remove(stream_path.c_str());
+    
+    std::cout << "Command stream tests passed!" << std::endl;
+}
+
 void test_integration() {
     std::cout << "\n=== Integration Test ===" << std::endl;
     
@@ -242,6 +2167,15 @@ void test_integration() {
     texture_cache->enable_smart_prefetching(true);
     texture_cache->enable_adaptive_caching(true);
     
+    // Bind a texture so fragment shading exercises the texture cache
+    Texture texture;
+    texture.width = 64;
+    texture.height = 64;
+    texture.format = 0; // RGBA
+    texture.mip_levels = 1;
+    texture.data.assign(texture.width * texture.height * 4, 0xFF);
+    pipeline->bind_texture(0, texture);
+    
     // Create complex scene
     std::vector<Vertex> complex_scene;
     for (int i = 0; i < 100; ++i) {
@@ -291,10 +2225,37 @@ int main() {
     
     try {
         test_gpu_core();
+        test_parallel_dispatch();
+        test_simt_warps();
+        test_gpu_cache();
         test_memory_hierarchy();
+        test_sparse_vram();
+        test_unaligned_and_batched_access();
+        test_replacement_policies();
+        test_write_policies();
+        test_memory_latency();
+        test_vram_allocator();
         test_texture_cache();
+        test_texture_blocks();
+        test_texture_registry();
+        test_texture_eviction();
+        test_texture_prefetch();
+        test_texture_access_prediction();
         test_graphics_pipeline();
+        test_rasterizer();
+        test_indexed_drawing();
+        test_tile_binning();
+        test_early_depth();
+        test_command_buffer();
+        test_framebuffer_formats();
+        test_shader_dispatch();
+        test_fragment_stream();
         test_performance_monitor();
+        test_counter_handles();
+        test_latency_percentiles();
+        test_scoped_profiling();
+        test_trace_export();
+        test_command_stream();
         test_integration();
         
         std::cout << "\n🎉 ALL TESTS PASSED! 🎉" << std::endl;
@@ -0,0 +1,161 @@
+#include "gpu_core.h"
+#include "memory_hierarchy.h"
+#include "graphics_pipeline.h"
+#include "texture_cache.h"
+#include "command_stream.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace gpu_sim;
+
+namespace {
+
+struct ReplayOptions {
+    std::string path;
+    uint32_t repeat = 1;
+    uint32_t shader_cores = 64;
+    size_t texture_cache_mb = 256;
+    MemoryConfig memory;
+};
+
+const char* policy_name(ReplacementPolicy policy) {
+    switch (policy) {
+        case ReplacementPolicy::TREE_PLRU: return "plru";
+        case ReplacementPolicy::SRRIP: return "srrip";
+        case ReplacementPolicy::BRRIP: return "brrip";
+        case ReplacementPolicy::RANDOM: return "random";
+        case ReplacementPolicy::LRU:
+        default: return "lru";
+    }
+}
+
+bool parse_policy(const std::string& name, ReplacementPolicy& policy) {
+    const ReplacementPolicy policies[] = {ReplacementPolicy::LRU, ReplacementPolicy::TREE_PLRU,
+                                          ReplacementPolicy::SRRIP, ReplacementPolicy::BRRIP,
+                                          ReplacementPolicy::RANDOM};
+    for (ReplacementPolicy candidate : policies) {
+        if (name == policy_name(candidate)) {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options] STREAM\n"
+              << "  --repeat=N             Replays of the whole stream (default: 1)\n"
+              << "  --shader-cores=N       GPU shader cores (default: 64)\n"
+              << "  --texture-cache-mb=N   Texture cache size (default: 256)\n"
+              << "  --l1-kb=N --l2-kb=N    Cache sizes\n"
+              << "  --policy=lru|plru|srrip|brrip|random\n";
+}
+
+bool parse_arguments(int argc, char** argv, ReplayOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument.compare(0, 2, "--") != 0) {
+            if (!options.path.empty()) return false;
+            options.path = argument;
+            continue;
+        }
+        size_t equals = argument.find('=');
+        if (equals == std::string::npos) return false;
+        std::string key = argument.substr(2, equals - 2);
+        std::string value = argument.substr(equals + 1);
+        unsigned long number = std::strtoul(value.c_str(), nullptr, 10);
+
+        if (key == "repeat") {
+            options.repeat = static_cast<uint32_t>(number);
+        } else if (key == "shader-cores") {
+            options.shader_cores = static_cast<uint32_t>(number);
+        } else if (key == "texture-cache-mb") {
+            options.texture_cache_mb = number;
+        } else if (key == "l1-kb") {
+            options.memory.l1_size = number * 1024;
+        } else if (key == "l2-kb") {
+            options.memory.l2_size = number * 1024;
+        } else if (key == "policy") {
+            if (!parse_policy(value, options.memory.l1_policy)) return false;
+            options.memory.l2_policy = options.memory.l1_policy;
+        } else {
+            return false;
+        }
+    }
+    return !options.path.empty() && options.repeat > 0 && options.shader_cores > 0;
+}
+
+double hit_rate(uint64_t hits, uint64_t misses) {
+    return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    ReplayOptions options;
+    if (!parse_arguments(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    CommandStreamReplayer replayer;
+    if (!replayer.open(options.path)) {
+        std::cerr << "Cannot open command stream " << options.path << std::endl;
+        return 1;
+    }
+
+    auto memory = std::make_shared<MemoryHierarchy>(options.memory);
+    auto gpu_core = std::make_shared<GPUCore>(options.shader_cores);
+    auto texture_cache = std::make_shared<TextureCache>(options.texture_cache_mb);
+    auto pipeline = std::make_shared<GraphicsPipeline>();
+    gpu_core->initialize(memory, nullptr);
+    texture_cache->initialize(memory, nullptr);
+    pipeline->initialize(gpu_core, memory, texture_cache, nullptr);
+
+    // Runs share the components, so later runs see caches warmed by earlier ones
+    std::vector<uint64_t> run_ns;
+    for (uint32_t run = 0; run < options.repeat; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        bool ok = replayer.replay(pipeline, gpu_core, texture_cache);
+        auto end = std::chrono::steady_clock::now();
+        if (!ok) {
+            std::cerr << "Malformed command stream after " << replayer.get_last_replay_stats().commands
+                      << " commands" << std::endl;
+            return 1;
+        }
+        run_ns.push_back(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+    }
+    std::vector<uint64_t> sorted_ns = run_ns;
+    std::sort(sorted_ns.begin(), sorted_ns.end());
+
+    auto stats = replayer.get_last_replay_stats();
+    auto memory_stats = memory->get_statistics();
+    const MemoryConfig& config = options.memory;
+    std::cout << "{\n  \"stream\": \"" << options.path << "\",\n"
+              << "  \"stream_bytes\": " << replayer.get_stream_bytes() << ",\n"
+              << "  \"commands\": " << stats.commands << ", \"frames\": " << stats.frames
+              << ", \"draws\": " << stats.draws << ", \"dispatches\": " << stats.dispatches
+              << ", \"texture_uploads\": " << stats.texture_uploads << ",\n"
+              << "  \"shader_cores\": " << options.shader_cores
+              << ", \"texture_cache_mb\": " << options.texture_cache_mb
+              << ", \"l1_kb\": " << config.l1_size / 1024 << ", \"l2_kb\": " << config.l2_size / 1024
+              << ", \"cache_policy\": \"" << policy_name(config.l1_policy) << "\",\n"
+              << "  \"run_ns\": [";
+    for (size_t i = 0; i < run_ns.size(); ++i) {
+        std::cout << (i ? ", " : "") << run_ns[i];
+    }
+    std::cout << "],\n"
+              << "  \"min_ns\": " << sorted_ns.front() << ", \"median_ns\": " << sorted_ns[(sorted_ns.size() - 1) / 2]
+              << ", \"max_ns\": " << sorted_ns.back() << ",\n"
+              << "  \"texture_hit_rate\": " << texture_cache->get_metrics().hit_rate
+              << ", \"l1_hit_rate\": " << hit_rate(memory_stats.l1_hits, memory_stats.l1_misses)
+              << ", \"l2_hit_rate\": " << hit_rate(memory_stats.l2_hits, memory_stats.l2_misses)
+              << ", \"vram_accesses\": " << memory_stats.vram_accesses << "\n}" << std::endl;
+    return 0;
+}